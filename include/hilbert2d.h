@@ -0,0 +1,134 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HILBERT2D_H
+#define HILBERT2D_H
+
+#include <cstdint>
+#include <ostream>
+
+#include "hilbert_codec.h"
+#include "morton2d.h"
+
+/*
+2d Hilbert curve keys. Consecutive keys are always neighbor cells, unlike morton keys which jump at the border of
+each quadrant / octant : ranges of keys are more compact, at the price of a slower encoding.
+Coordinates are interleaved as a morton key first (pdep with BMI2), which is then transformed with the
+look up table state machine of hilbert_codec.h, 4 levels per lookup.
+
+  hilbert2 h = hilbert2(x, y);
+  h.decode(x, y);
+  morton2d<> m = h.toMorton();    // Same cell
+  hilbert2d<>(m) == h;
+
+32 bits per axis with 64 bits keys, 16 with 32 bits keys.
+*/
+static constexpr hilbert_table<2, 4> hilbert2dLUT = hilbert_table<2, 4>();
+
+template<class T = uint64_t, class Codec = morton_dispatch>
+struct hilbert2d
+{
+public:
+	typedef typename morton2d<T, Codec>::coord_type coord_type;
+
+	//Levels of the curve : bits per axis
+	static constexpr unsigned int levels = 8 * sizeof(T) / 2;
+
+	T key;
+
+public:
+
+	inline constexpr explicit hilbert2d() : key(0) {};
+	inline constexpr explicit hilbert2d(const T _key) : key(_key) {};
+
+	inline hilbert2d(const coord_type x, const coord_type y) : key(fromMorton(morton2d<T, Codec>(x, y).key)) {}
+
+	/* Hilbert key of the cell of a morton key */
+	template<class C>
+	inline explicit hilbert2d(const morton2d<T, C> m) : key(fromMorton(m.key)) {}
+
+	inline morton2d<T, Codec> toMorton() const
+	{
+		return morton2d<T, Codec>(hilbertTransform<2, 4>(hilbert2dLUT.decode, this->key, levels));
+	}
+
+	inline void decode(uint64_t& x, uint64_t& y) const
+	{
+		toMorton().decode(x, y);
+	}
+
+	static inline T fromMorton(const T mortonKey)
+	{
+		return hilbertTransform<2, 4>(hilbert2dLUT.encode, mortonKey, levels);
+	}
+
+	inline constexpr bool operator==(const hilbert2d h) const
+	{
+		return this->key == h.key;
+	}
+
+	inline constexpr bool operator!=(const hilbert2d h) const
+	{
+		return !operator==(h);
+	}
+};
+
+template<class T, class C> constexpr unsigned int hilbert2d<T, C>::levels;
+
+template<class T, class C>
+inline constexpr bool operator< (const hilbert2d<T, C>& lhs, const hilbert2d<T, C>& rhs)
+{
+	return (lhs.key) < (rhs.key);
+}
+
+template<class T, class C>
+inline constexpr bool operator> (const hilbert2d<T, C>& lhs, const hilbert2d<T, C>& rhs)
+{
+	return (lhs.key) > (rhs.key);
+}
+
+template<class T, class C>
+inline constexpr bool operator>= (const hilbert2d<T, C>& lhs, const hilbert2d<T, C>& rhs)
+{
+	return (lhs.key) >= (rhs.key);
+}
+
+template<class T, class C>
+inline constexpr bool operator<= (const hilbert2d<T, C>& lhs, const hilbert2d<T, C>& rhs)
+{
+	return (lhs.key) <= (rhs.key);
+}
+
+template<class T, class C>
+std::ostream& operator<<(std::ostream& os, const hilbert2d<T, C>& m)
+{
+	uint64_t x, y;
+	m.decode(x, y);
+	mortonWriteKey(os, m.key);
+	os << ": " << x << ", " << y;
+	return os;
+}
+
+typedef hilbert2d<> hilbert2;
+
+#endif
@@ -0,0 +1,134 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HILBERT3D_H
+#define HILBERT3D_H
+
+#include <cstdint>
+#include <ostream>
+
+#include "hilbert_codec.h"
+#include "morton3d.h"
+
+/*
+3d Hilbert curve keys. Consecutive keys are always neighbor cells, unlike morton keys which jump at the border of
+each quadrant / octant : ranges of keys are more compact, at the price of a slower encoding.
+Coordinates are interleaved as a morton key first (pdep with BMI2), which is then transformed with the
+look up table state machine of hilbert_codec.h, 3 levels per lookup.
+
+  hilbert3 h = hilbert3(x, y, z);
+  h.decode(x, y, z);
+  morton3d<> m = h.toMorton();    // Same cell
+  hilbert3d<>(m) == h;
+
+21 bits per axis with 64 bits keys, 10 with 32 bits keys.
+*/
+static constexpr hilbert_table<3, 3> hilbert3dLUT = hilbert_table<3, 3>();
+
+template<class T = uint64_t, class Codec = morton_dispatch>
+struct hilbert3d
+{
+public:
+	typedef typename morton3d<T, Codec>::coord_type coord_type;
+
+	//Levels of the curve : bits per axis
+	static constexpr unsigned int levels = 8 * sizeof(T) / 3;
+
+	T key;
+
+public:
+
+	inline constexpr explicit hilbert3d() : key(0) {};
+	inline constexpr explicit hilbert3d(const T _key) : key(_key) {};
+
+	inline hilbert3d(const coord_type x, const coord_type y, const coord_type z) : key(fromMorton(morton3d<T, Codec>(x, y, z).key)) {}
+
+	/* Hilbert key of the cell of a morton key */
+	template<class C>
+	inline explicit hilbert3d(const morton3d<T, C> m) : key(fromMorton(m.key)) {}
+
+	inline morton3d<T, Codec> toMorton() const
+	{
+		return morton3d<T, Codec>(hilbertTransform<3, 3>(hilbert3dLUT.decode, this->key, levels));
+	}
+
+	inline void decode(uint64_t& x, uint64_t& y, uint64_t& z) const
+	{
+		toMorton().decode(x, y, z);
+	}
+
+	static inline T fromMorton(const T mortonKey)
+	{
+		return hilbertTransform<3, 3>(hilbert3dLUT.encode, mortonKey, levels);
+	}
+
+	inline constexpr bool operator==(const hilbert3d h) const
+	{
+		return this->key == h.key;
+	}
+
+	inline constexpr bool operator!=(const hilbert3d h) const
+	{
+		return !operator==(h);
+	}
+};
+
+template<class T, class C> constexpr unsigned int hilbert3d<T, C>::levels;
+
+template<class T, class C>
+inline constexpr bool operator< (const hilbert3d<T, C>& lhs, const hilbert3d<T, C>& rhs)
+{
+	return (lhs.key) < (rhs.key);
+}
+
+template<class T, class C>
+inline constexpr bool operator> (const hilbert3d<T, C>& lhs, const hilbert3d<T, C>& rhs)
+{
+	return (lhs.key) > (rhs.key);
+}
+
+template<class T, class C>
+inline constexpr bool operator>= (const hilbert3d<T, C>& lhs, const hilbert3d<T, C>& rhs)
+{
+	return (lhs.key) >= (rhs.key);
+}
+
+template<class T, class C>
+inline constexpr bool operator<= (const hilbert3d<T, C>& lhs, const hilbert3d<T, C>& rhs)
+{
+	return (lhs.key) <= (rhs.key);
+}
+
+template<class T, class C>
+std::ostream& operator<<(std::ostream& os, const hilbert3d<T, C>& m)
+{
+	uint64_t x, y, z;
+	m.decode(x, y, z);
+	mortonWriteKey(os, m.key);
+	os << ": " << x << ", " << y << ", " << z;
+	return os;
+}
+
+typedef hilbert3d<> hilbert3;
+
+#endif
@@ -0,0 +1,144 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef HILBERT_CODEC_H
+#define HILBERT_CODEC_H
+
+#include <cstdint>
+
+/*
+Hilbert keys are computed from morton keys : the morton key gives the D bits of the coordinates at each level,
+and a state machine turns each of them into the D bits of the hilbert index of the level, from the highest level down.
+The state (entry corner e, direction d) is the rotation and reflection of the sub cube.
+Tables below run the state machine on L levels at once.
+Ref : C. Hamilton, "Compact Hilbert Indices", 2006 (algorithm 2)
+Ref : https://en.wikipedia.org/wiki/Hilbert_curve
+*/
+
+inline constexpr uint32_t hilbertGray(const uint32_t i)
+{
+	return i ^ (i >> 1);
+}
+
+inline constexpr uint32_t hilbertGrayInverse(const uint32_t g)
+{
+	uint32_t i = g;
+	for (uint32_t shift = 1; (g >> shift) != 0; ++shift)
+		i ^= g >> shift;
+	return i;
+}
+
+/* Rotations of the D lowest bits */
+inline constexpr uint32_t hilbertRotateRight(const uint32_t v, const uint32_t r, const uint32_t D)
+{
+	return ((v >> (r % D)) | (v << (D - r % D))) & ((1u << D) - 1);
+}
+
+inline constexpr uint32_t hilbertRotateLeft(const uint32_t v, const uint32_t r, const uint32_t D)
+{
+	return hilbertRotateRight(v, D - r % D, D);
+}
+
+inline constexpr uint32_t hilbertTrailingOnes(uint32_t i)
+{
+	uint32_t count = 0;
+	for (; (i & 1) != 0; i >>= 1)
+		++count;
+	return count;
+}
+
+/* Entry corner and direction of sub cube w */
+inline constexpr uint32_t hilbertEntry(const uint32_t w)
+{
+	return w == 0 ? 0 : hilbertGray(2 * ((w - 1) / 2));
+}
+
+inline constexpr uint32_t hilbertDirection(const uint32_t w, const uint32_t D)
+{
+	return w == 0 ? 0 : (w % 2 == 0 ? hilbertTrailingOnes(w - 1) : hilbertTrailingOnes(w)) % D;
+}
+
+/*
+State machine on L levels of D bits. An entry holds the D * L output bits, and the next state above them.
+States are e * D + d.
+*/
+template<unsigned int D, unsigned int L>
+struct hilbert_table
+{
+	static constexpr unsigned int bits = D * L;
+	static constexpr unsigned int states = D << D;
+
+	uint16_t encode[states << bits]; // Morton bits to hilbert bits
+	uint16_t decode[states << bits]; // Hilbert bits to morton bits
+
+	constexpr hilbert_table() : encode(), decode()
+	{
+		for (uint32_t state = 0; state < states; ++state)
+		{
+			for (uint32_t in = 0; in < (1u << bits); ++in)
+			{
+				uint32_t e = state / D, d = state % D, hilbert = 0;
+				uint32_t eInv = e, dInv = d, morton = 0;
+				for (int level = L - 1; level >= 0; --level)
+				{
+					//Morton digit to hilbert digit
+					const uint32_t l = (in >> (level * D)) & ((1u << D) - 1);
+					const uint32_t w = hilbertGrayInverse(hilbertRotateRight(l ^ e, d + 1, D));
+					hilbert |= w << (level * D);
+					e ^= hilbertRotateLeft(hilbertEntry(w), d + 1, D);
+					d = (d + hilbertDirection(w, D) + 1) % D;
+
+					//Hilbert digit to morton digit
+					const uint32_t wInv = (in >> (level * D)) & ((1u << D) - 1);
+					morton |= (hilbertRotateLeft(hilbertGray(wInv), dInv + 1, D) ^ eInv) << (level * D);
+					eInv ^= hilbertRotateLeft(hilbertEntry(wInv), dInv + 1, D);
+					dInv = (dInv + hilbertDirection(wInv, D) + 1) % D;
+				}
+				encode[(state << bits) | in] = static_cast<uint16_t>(hilbert | (e * D + d) << bits);
+				decode[(state << bits) | in] = static_cast<uint16_t>(morton | (eInv * D + dInv) << bits);
+			}
+		}
+	}
+};
+
+/*
+Runs the state machine of a table on the lowest D * levels bits of a key, L levels per lookup.
+Levels above are read as zeros, which leave the entry corner of the first state unchanged and give zeros.
+*/
+template<unsigned int D, unsigned int L, class T>
+inline T hilbertTransform(const uint16_t* table, const T key, const unsigned int levels)
+{
+	const unsigned int bits = D * L;
+	const T in = D * levels >= 8 * sizeof(T) ? key : key & ((static_cast<T>(1) << (D * levels)) - 1);
+	uint32_t state = 0;
+	T out = 0;
+	for (int chunk = static_cast<int>((levels + L - 1) / L) - 1; chunk >= 0; --chunk)
+	{
+		const uint32_t entry = table[(state << bits) | (static_cast<uint32_t>(in >> (chunk * bits)) & ((1u << bits) - 1))];
+		out |= static_cast<T>(entry & ((1u << bits) - 1)) << (chunk * bits);
+		state = entry >> bits;
+	}
+	return out;
+}
+
+#endif
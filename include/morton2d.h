@@ -29,17 +29,20 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <array>
 #include <algorithm>
 #include <assert.h>
+#include <ostream>
+#include <type_traits>
 #include <immintrin.h>
 
+#include "morton_codec.h"
+
 /*
 BMI2(Bit Manipulation Instruction Set 2) is a special set of instructions available for intel core i5, i7(since Haswell architecture) and Xeon E3.
 Some instructions are not available for Microsoft Visual Studio older than 2013.
+
+By default, the encoding strategy (BMI2, look up table or magic bits) is selected at runtime, see mortonCodec().
+Define USE_BMI2 to always use BMI2 without any runtime check, or give the strategy as template parameter of morton2d.
 */
-#if _MSC_VER
-#define USE_BMI2
-#endif
 
-#ifndef USE_BMI2
 //mortonkey(x+1) = (mortonkey(x) - MAXMORTONKEY) & MAXMORTONKEY
 static const uint32_t morton2dLUT[256] =
 { 0x0000, 0x0001, 0x0004, 0x0005, 0x0010, 0x0011, 0x0014, 0x0015,
@@ -75,29 +78,111 @@ static const uint32_t morton2dLUT[256] =
   0x5500, 0x5501, 0x5504, 0x5505, 0x5510, 0x5511, 0x5514, 0x5515,
   0x5540, 0x5541, 0x5544, 0x5545, 0x5550, 0x5551, 0x5554, 0x5555
 };
-#endif
 
-const uint64_t x2_mask = 0xAAAAAAAAAAAAAAAA; //0b...10101010
-const uint64_t y2_mask = 0x5555555555555555; //0b...01010101
+constexpr uint64_t x2_mask = 0xAAAAAAAAAAAAAAAA; //0b...10101010
+constexpr uint64_t y2_mask = 0x5555555555555555; //0b...01010101
 
-template<class T = uint64_t>
-struct morton2d
+/* Spread the 32 bits of n, one zero between each bit */
+inline constexpr uint64_t spreadBits2(uint64_t n)
 {
-public:
-	T key;
+	n &= 0x00000000ffffffff;
+	n = (n | (n << 16)) & 0x0000ffff0000ffff;
+	n = (n | (n << 8)) & 0x00ff00ff00ff00ff;
+	n = (n | (n << 4)) & 0x0f0f0f0f0f0f0f0f;
+	n = (n | (n << 2)) & 0x3333333333333333;
+	n = (n | (n << 1)) & 0x5555555555555555;
+	return n;
+}
 
-public:
+inline constexpr uint64_t compactBits2(uint64_t n)
+{
+	n &= 0x5555555555555555;
+	n = (n ^ (n >> 1)) & 0x3333333333333333;
+	n = (n ^ (n >> 2)) & 0x0f0f0f0f0f0f0f0f;
+	n = (n ^ (n >> 4)) & 0x00ff00ff00ff00ff;
+	n = (n ^ (n >> 8)) & 0x0000ffff0000ffff;
+	n = (n ^ (n >> 16)) & 0x00000000ffffffff;
+	return n;
+}
 
-	inline morton2d() : key(0) {};
-	inline explicit morton2d(T _key) : key(_key) {};
+/* Inverse look up table : one entry per byte of a key, holding 4 bits of each axis.
+y is stored in the lower 32 bits of the entry and x in the upper ones,
+so that the entries of the 8 bytes of a key are merged with a shift and an or. */
+struct morton2d_decode_table
+{
+	uint64_t entries[256];
 
-	/* If BMI2 intrinsics are not available, we rely on a look up table of precomputed morton codes. */
-	inline morton2d(const uint32_t x, const uint32_t y) : key(0) {
+	constexpr morton2d_decode_table() : entries()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+			entries[i] = compactBits2(i) | compactBits2(i >> 1) << 32;
+	}
+};
 
-#ifdef USE_BMI2
-		key = static_cast<T>(_pdep_u64(y, y2_mask) | _pdep_u64(x, x2_mask));
-#else
-		key = morton2dLUT[(x >> 24) & 0xFF] << 1 |
+static constexpr morton2d_decode_table morton2dDecodeLUT = morton2d_decode_table();
+
+/* 16 bits look up table, built on first use */
+struct morton2d_lut16_table
+{
+	uint32_t entries[65536];
+
+	morton2d_lut16_table()
+	{
+		for (uint32_t i = 0; i < 65536; ++i)
+			entries[i] = static_cast<uint32_t>(spreadBits2(i));
+	}
+};
+
+inline const uint32_t* morton2dLUT16()
+{
+	static const morton2d_lut16_table table;
+	return table.entries;
+}
+
+/*
+Encoding strategies, one specialization for each tag of morton_codec.h.
+All of them give the same keys.
+*/
+template<class Codec>
+struct morton2d_codec;
+
+template<>
+struct morton2d_codec<morton_bmi2>
+{
+	MORTON_TARGET("bmi2") static inline uint64_t encode(const uint32_t x, const uint32_t y)
+	{
+		return _pdep_u64(y, y2_mask) | _pdep_u64(x, x2_mask);
+	}
+
+	MORTON_TARGET("bmi2") static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y)
+	{
+		x = _pext_u64(key, x2_mask);
+		y = _pext_u64(key, y2_mask);
+	}
+};
+
+template<>
+struct morton2d_codec<morton_magicbits>
+{
+	static inline constexpr uint64_t encode(const uint32_t x, const uint32_t y)
+	{
+		return spreadBits2(x) << 1 | spreadBits2(y);
+	}
+
+	static inline constexpr void decode(const uint64_t key, uint64_t& x, uint64_t& y)
+	{
+		x = compactBits2(key >> 1);
+		y = compactBits2(key);
+	}
+};
+
+/* Look up tables strategies all decode with the byte inverse table, morton2dDecodeLUT. */
+template<>
+struct morton2d_codec<morton_lut8>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y)
+	{
+		uint64_t key = morton2dLUT[(x >> 24) & 0xFF] << 1 |
 			morton2dLUT[(y >> 24) & 0xFF];
 		key = key << 16 |
 			morton2dLUT[(x >> 16) & 0xFF] << 1 |
@@ -108,200 +193,338 @@ public:
 		key = key << 16 |
 			morton2dLUT[x & 0xFF] << 1 |
 			morton2dLUT[y & 0xFF];
+		return key;
+	}
+
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y)
+	{
+		const uint64_t* lut = morton2dDecodeLUT.entries;
+		const uint64_t xy = lut[key & 0xFF] |
+			lut[(key >> 8) & 0xFF] << 4 |
+			lut[(key >> 16) & 0xFF] << 8 |
+			lut[(key >> 24) & 0xFF] << 12 |
+			lut[(key >> 32) & 0xFF] << 16 |
+			lut[(key >> 40) & 0xFF] << 20 |
+			lut[(key >> 48) & 0xFF] << 24 |
+			lut[key >> 56] << 28;
+		x = xy >> 32;
+		y = xy & 0xFFFFFFFF;
+	}
+};
+
+template<>
+struct morton2d_codec<morton_lut16>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y)
+	{
+		const uint32_t* lut = morton2dLUT16();
+		const uint64_t xx = static_cast<uint64_t>(lut[x >> 16]) << 32 | lut[x & 0xFFFF];
+		const uint64_t yy = static_cast<uint64_t>(lut[y >> 16]) << 32 | lut[y & 0xFFFF];
+		return xx << 1 | yy;
+	}
+
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y)
+	{
+		morton2d_codec<morton_lut8>::decode(key, x, y);
+	}
+};
+
+/* Fast encode of morton2 code when BMI2 instructions aren't available.
+This does not work for values greater than 256.
+
+This function takes roughly the same time as a full encode (64 bits) using BMI2 intrinsic.*/
+template<>
+struct morton2d_codec<morton_lut256>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y)
+	{
+		assert(x < 256 && y < 256);
+		return morton2dLUT[x] << 1 |
+			morton2dLUT[y];
+	}
+
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y)
+	{
+		morton2d_codec<morton_lut8>::decode(key, x, y);
+	}
+};
+
+/* Strategy selected at runtime, see mortonCodec() */
+template<>
+struct morton2d_codec<morton_dispatch>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y)
+	{
+#ifdef USE_BMI2
+		return morton2d_codec<morton_bmi2>::encode(x, y);
+#else
+		switch (mortonCodec())
+		{
+		case MORTON_CODEC_BMI2: return morton2d_codec<morton_bmi2>::encode(x, y);
+		case MORTON_CODEC_MAGICBITS: return morton2d_codec<morton_magicbits>::encode(x, y);
+		default: return morton2d_codec<morton_lut8>::encode(x, y);
+		}
 #endif
 	}
 
-	inline void decode(uint64_t& x, uint64_t& y) const
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y)
 	{
 #ifdef USE_BMI2
-		x = _pext_u64(this->key, x2_mask);
-		y = _pext_u64(this->key, y2_mask);
+		morton2d_codec<morton_bmi2>::decode(key, x, y);
 #else
-		x = compactBits(this->key >> 1);
-		y = compactBits(this->key);
+		//The byte inverse table is no faster than magic bits in 2d : 8 lookups against 6 shift / mask steps
+		if (mortonCodec() == MORTON_CODEC_BMI2)
+			morton2d_codec<morton_bmi2>::decode(key, x, y);
+		else
+			morton2d_codec<morton_magicbits>::decode(key, x, y);
 #endif
 	}
+};
+
+/*
+Properties of a key type. Masks of keys narrower than 64 bits are truncated, like the keys themselves.
+128 bits keys hold 64 bits per axis.
+*/
+template<class T>
+struct morton2d_traits
+{
+	typedef typename std::conditional<(sizeof(T) > 8), uint64_t, uint32_t>::type coord_type;
+
+	static constexpr T x_mask = mortonMask<T>(2, 1);
+	static constexpr T y_mask = mortonMask<T>(2, 0);
+};
+
+template<class T> constexpr T morton2d_traits<T>::x_mask;
+template<class T> constexpr T morton2d_traits<T>::y_mask;
+
+/* Encoding of a key of type T with a 64 bits codec. Magic bits are used in constant expressions. */
+template<class T, class Codec, bool Wide = (sizeof(T) > 8)>
+struct morton2d_encoder
+{
+	static inline constexpr T encode(const uint32_t x, const uint32_t y)
+	{
+		return static_cast<T>(MORTON_CONSTANT_EVALUATED() ?
+			morton2d_codec<morton_magicbits>::encode(x, y) : morton2d_codec<Codec>::encode(x, y));
+	}
+
+	static inline constexpr void decode(const T key, uint64_t& x, uint64_t& y)
+	{
+		if (MORTON_CONSTANT_EVALUATED())
+			morton2d_codec<morton_magicbits>::decode(key, x, y);
+		else
+			morton2d_codec<Codec>::decode(key, x, y);
+	}
+};
+
+/* Keys wider than 64 bits are encoded as two 64 bits halves, each one holding 32 bits of each axis. */
+template<class T, class Codec>
+struct morton2d_encoder<T, Codec, true>
+{
+	typedef morton2d_encoder<uint64_t, Codec> half;
+
+	static inline constexpr T encode(const uint64_t x, const uint64_t y)
+	{
+		const uint64_t lo = half::encode(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+		const uint64_t hi = half::encode(static_cast<uint32_t>(x >> 32), static_cast<uint32_t>(y >> 32));
+		return static_cast<T>(hi) << 64 | lo;
+	}
+
+	static inline constexpr void decode(const T key, uint64_t& x, uint64_t& y)
+	{
+		uint64_t xl = 0, yl = 0;
+		half::decode(static_cast<uint64_t>(key), xl, yl);
+		half::decode(static_cast<uint64_t>(key >> 64), x, y);
+		x = x << 32 | xl;
+		y = y << 32 | yl;
+	}
+};
+
+template<class T = uint64_t, class Codec = morton_dispatch>
+struct morton2d
+{
+public:
+	typedef morton2d_traits<T> traits;
+	typedef typename traits::coord_type coord_type;
+
+	T key;
+
+public:
+
+	inline constexpr morton2d() : key(0) {};
+	inline constexpr explicit morton2d(T _key) : key(_key) {};
+
+	inline constexpr morton2d(const coord_type x, const coord_type y) : key(morton2d_encoder<T, Codec>::encode(x, y)) {}
+
+	inline constexpr void decode(uint64_t& x, uint64_t& y) const
+	{
+		morton2d_encoder<T, Codec>::decode(this->key, x, y);
+	}
 
 	//Binary operators
-	inline bool operator==(const morton2d m1) const
+	inline constexpr bool operator==(const morton2d m1) const
 	{
 		return this->key == m1.key;
 	}
 
-	inline bool operator!=(const morton2d m1) const
+	inline constexpr bool operator!=(const morton2d m1) const
 	{
 		return !operator==(m1);
 	}
 
-	inline morton2d operator|(const morton2d m1) const
+	inline constexpr morton2d operator|(const morton2d m1) const
 	{
-		return morton2d<T>(this->key | m1.key);
+		return morton2d(this->key | m1.key);
 	}
 
-	inline morton2d operator&(const morton2d m1) const
+	inline constexpr morton2d operator&(const morton2d m1) const
 	{
-		return morton2d<T>(this->key & m1.key);
+		return morton2d(this->key & m1.key);
 	}
 
-	inline morton2d operator >> (const uint64_t d) const
+	inline constexpr morton2d operator >> (const uint64_t d) const
 	{
-		return morton2d<T>(this->key >> (2 * d));
+		return morton2d(this->key >> (2 * d));
 	}
 
-	inline morton2d operator<<(const uint64_t d) const
+	inline constexpr morton2d operator<<(const uint64_t d) const
 	{
-		return morton2d<T>(this->key << (2 * d));
+		return morton2d(this->key << (2 * d));
 	}
 
-	inline void operator+=(const morton2d<T> rhs)
+	inline constexpr void operator+=(const morton2d rhs)
 	{
-		T x_sum = (this->key | y2_mask) + (rhs.key & x2_mask);
-		T y_sum = (this->key | x2_mask) + (rhs.key & y2_mask);
-		this->key = (x_sum & x2_mask) | (y_sum & y2_mask);
+		T x_sum = (this->key | traits::y_mask) + (rhs.key & traits::x_mask);
+		T y_sum = (this->key | traits::x_mask) + (rhs.key & traits::y_mask);
+		this->key = (x_sum & traits::x_mask) | (y_sum & traits::y_mask);
 	}
 
-	inline void operator-=(const morton2d<T> rhs)
+	inline constexpr void operator-=(const morton2d rhs)
 	{
-		T x_diff = (this->key & x2_mask) - (rhs.key & x2_mask);
-		T y_diff = (this->key & y2_mask) - (rhs.key & y2_mask);
-		this->key = (x_diff & x2_mask) | (y_diff & y2_mask);
+		T x_diff = (this->key & traits::x_mask) - (rhs.key & traits::x_mask);
+		T y_diff = (this->key & traits::y_mask) - (rhs.key & traits::y_mask);
+		this->key = (x_diff & traits::x_mask) | (y_diff & traits::y_mask);
 	}
 
 	/* Increment X part of a morton2 code (xy interleaving)
 	morton2(4,5).incX() == morton2(5,5);
 
 	Ref : http://bitmath.blogspot.fr/2012/11/tesseral-arithmetic-useful-snippets.html */
-	inline morton2d incX() const
+	inline constexpr morton2d incX() const
 	{
-		const T x_sum = static_cast<T>((this->key | y2_mask) + 2);
-		return morton2d<T>((x_sum & x2_mask) | (this->key & y2_mask));
+		const T x_sum = static_cast<T>((this->key | traits::y_mask) + 2);
+		return morton2d((x_sum & traits::x_mask) | (this->key & traits::y_mask));
 	}
 
-	inline morton2d incY() const
+	inline constexpr morton2d incY() const
 	{
-		const T y_sum = static_cast<T>((this->key | x2_mask) + 1);
-		return morton2d<T>((y_sum & y2_mask) | (this->key & x2_mask));
+		const T y_sum = static_cast<T>((this->key | traits::x_mask) + 1);
+		return morton2d((y_sum & traits::y_mask) | (this->key & traits::x_mask));
 	}
 
-	inline morton2d decX() const
+	inline constexpr morton2d decX() const
 	{
-		const T x_diff = static_cast<T>((this->key & x2_mask) - 2);
-		return morton2d<T>((x_diff & x2_mask) | (this->key & y2_mask));
+		const T x_diff = static_cast<T>((this->key & traits::x_mask) - 2);
+		return morton2d((x_diff & traits::x_mask) | (this->key & traits::y_mask));
 	}
 
-	inline morton2d decY() const
+	inline constexpr morton2d decY() const
 	{
-		const T y_diff = static_cast<T>((this->key & y2_mask) - 1);
-		return morton2d<T>((y_diff & y2_mask) | (this->key & x2_mask));
+		const T y_diff = static_cast<T>((this->key & traits::y_mask) - 1);
+		return morton2d((y_diff & traits::y_mask) | (this->key & traits::x_mask));
 	}
 
 	/*
 	  min(morton2(4,5), morton2(8,3)) == morton2(4,3);
 	  Ref : http://asgerhoedt.dk/?p=276
 	*/
-	static inline morton2d min(const morton2d lhs, const morton2d rhs)
+	static inline constexpr morton2d min(const morton2d lhs, const morton2d rhs)
 	{
-		T lhsX = lhs.key & x2_mask;
-		T rhsX = rhs.key & x2_mask;
-		T lhsY = lhs.key & y2_mask;
-		T rhsY = rhs.key & y2_mask;
-		return morton2d<T>(std::min(lhsX, rhsX) + std::min(lhsY, rhsY));
+		T lhsX = lhs.key & traits::x_mask;
+		T rhsX = rhs.key & traits::x_mask;
+		T lhsY = lhs.key & traits::y_mask;
+		T rhsY = rhs.key & traits::y_mask;
+		return morton2d(std::min(lhsX, rhsX) + std::min(lhsY, rhsY));
 	}
 
 	/*
 	  max(morton2(4,5), morton2(8,3)) == morton2(8,5);
 	*/
-	static inline morton2d max(const morton2d lhs, const morton2d rhs)
+	static inline constexpr morton2d max(const morton2d lhs, const morton2d rhs)
 	{
-		T lhsX = lhs.key & x2_mask;
-		T rhsX = rhs.key & x2_mask;
-		T lhsY = lhs.key & y2_mask;
-		T rhsY = rhs.key & y2_mask;
-		return morton2d<T>(std::max(lhsX, rhsX) + std::max(lhsY, rhsY));
+		T lhsX = lhs.key & traits::x_mask;
+		T rhsX = rhs.key & traits::x_mask;
+		T lhsY = lhs.key & traits::y_mask;
+		T rhsY = rhs.key & traits::y_mask;
+		return morton2d(std::max(lhsX, rhsX) + std::max(lhsY, rhsY));
 	}
 
-#ifndef USE_BMI2
-
-	/* Fast encode of morton2 code when BMI2 instructions aren't available.
-	This does not work for values greater than 256.
-
-	This function takes roughly the same time as a full encode (64 bits) using BMI2 intrinsic.*/
-	static inline morton2d morton2d_256(const uint32_t x, const uint32_t y)
-	{
-		assert(x < 256 && y < 256);
-		T key = morton2dLUT[x] << 1 |
-			morton2dLUT[y];
-		return morton2d(key);
-	}
-
-private:
-	inline uint64_t compactBits(uint64_t n) const
+	/* Same as morton2d<T, morton_lut256>(x, y) */
+	static inline constexpr morton2d morton2d_256(const uint32_t x, const uint32_t y)
 	{
-		n &= 0x5555555555555555;
-		n = (n ^ (n >> 1)) & 0x3333333333333333;
-		n = (n ^ (n >> 2)) & 0x0f0f0f0f0f0f0f0f;
-		n = (n ^ (n >> 4)) & 0x00ff00ff00ff00ff;
-		n = (n ^ (n >> 8)) & 0x0000ffff0000ffff;
-		n = (n ^ (n >> 16)) & 0x00000000ffffffff;
-		return n;
+		return morton2d(morton2d_encoder<T, morton_lut256>::encode(x, y));
 	}
-#endif
 
 };
 
 /* Add two morton keys (xy interleaving)
 morton2(4,5) + morton3(1,2) == morton2(5,7); */
-template<class T>
-inline morton2d<T> operator+(const morton2d<T> lhs, const morton2d<T> rhs)
+template<class T, class C>
+inline constexpr morton2d<T, C> operator+(const morton2d<T, C> lhs, const morton2d<T, C> rhs)
 {
-	T x_sum = (lhs.key | y2_mask) + (rhs.key & x2_mask);
-	T y_sum = (lhs.key | x2_mask) + (rhs.key & y2_mask);
-	return morton2d<T>((x_sum & x2_mask) | (y_sum & y2_mask));
+	typedef morton2d_traits<T> traits;
+	T x_sum = (lhs.key | traits::y_mask) + (rhs.key & traits::x_mask);
+	T y_sum = (lhs.key | traits::x_mask) + (rhs.key & traits::y_mask);
+	return morton2d<T, C>((x_sum & traits::x_mask) | (y_sum & traits::y_mask));
 }
 
 /* Substract two mortons keys (xy interleaving)
   morton2(4,5) - morton2(1,2) == morton2(3,3); */
-template<class T>
-inline morton2d<T> operator-(const morton2d<T> lhs, const morton2d<T> rhs)
+template<class T, class C>
+inline constexpr morton2d<T, C> operator-(const morton2d<T, C> lhs, const morton2d<T, C> rhs)
 {
-	T x_diff = (lhs.key & x2_mask) - (rhs.key & x2_mask);
-	T y_diff = (lhs.key & y2_mask) - (rhs.key & y2_mask);
-	return morton2d<T>((x_diff & x2_mask) | (y_diff & y2_mask));
+	typedef morton2d_traits<T> traits;
+	T x_diff = (lhs.key & traits::x_mask) - (rhs.key & traits::x_mask);
+	T y_diff = (lhs.key & traits::y_mask) - (rhs.key & traits::y_mask);
+	return morton2d<T, C>((x_diff & traits::x_mask) | (y_diff & traits::y_mask));
 }
 
-template<class T>
-inline bool operator< (const morton2d<T>& lhs, const morton2d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator< (const morton2d<T, C>& lhs, const morton2d<T, C>& rhs)
 {
 	return (lhs.key) < (rhs.key);
 }
 
-template<class T>
-inline bool operator> (const morton2d<T>& lhs, const morton2d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator> (const morton2d<T, C>& lhs, const morton2d<T, C>& rhs)
 {
 	return (lhs.key) > (rhs.key);
 }
 
-template<class T>
-inline bool operator>= (const morton2d<T>& lhs, const morton2d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator>= (const morton2d<T, C>& lhs, const morton2d<T, C>& rhs)
 {
 	return (lhs.key) >= (rhs.key);
 }
 
-template<class T>
-inline bool operator<= (const morton2d<T>& lhs, const morton2d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator<= (const morton2d<T, C>& lhs, const morton2d<T, C>& rhs)
 {
 	return (lhs.key) <= (rhs.key);
 }
 
-template<class T>
-std::ostream& operator<<(std::ostream& os, const morton2d<T>& m)
+template<class T, class C>
+std::ostream& operator<<(std::ostream& os, const morton2d<T, C>& m)
 {
 	uint64_t x, y;
 	m.decode(x, y);
-	os << m.key << ": " << x << ", " << y;
+	mortonWriteKey(os, m.key);
+	os << ": " << x << ", " << y;
 	return os;
 }
 
 typedef morton2d<> morton2;
+#ifdef __SIZEOF_INT128__
+typedef morton2d<morton_uint128> morton2_128;
+#endif
 
 #endif
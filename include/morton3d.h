@@ -26,7 +26,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <cstdint>
 #include <array>
+#include <algorithm>
 #include <assert.h>
+#include <ostream>
+#include <type_traits>
 
 #if _MSC_VER
 #include <immintrin.h>
@@ -36,16 +39,16 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <x86intrin.h>
 #endif
 
+#include "morton_codec.h"
 
 /*
 BMI2 (Bit Manipulation Instruction Set 2) is a special set of instructions available for intel core i5, i7 (since Haswell architecture) and Xeon E3.
 Some instructions are not available for Microsoft Visual Studio older than 2013.
+
+By default, the encoding strategy (BMI2, look up table or magic bits) is selected at runtime, see mortonCodec().
+Define USE_BMI2 to always use BMI2 without any runtime check, or give the strategy as template parameter of morton3d.
 */
-#if _MSC_VER
-#define USE_BMI2
-#endif
 
-#ifndef USE_BMI2
 //mortonkey(x+1) = (mortonkey(x) - MAXMORTONKEY) & MAXMORTONKEY
 static const uint32_t morton3dLUT[256] =
 {
@@ -82,33 +85,118 @@ static const uint32_t morton3dLUT[256] =
   0x00249000, 0x00249001, 0x00249008, 0x00249009, 0x00249040, 0x00249041, 0x00249048, 0x00249049,
   0x00249200, 0x00249201, 0x00249208, 0x00249209, 0x00249240, 0x00249241, 0x00249248, 0x00249249
 };
-#endif
 
-const uint64_t x3_mask = 0x4924924924924924; // 0b...00100100
-const uint64_t y3_mask = 0x2492492492492492; // 0b...10010010
-const uint64_t z3_mask = 0x9249249249249249; // 0b...01001001
-const uint64_t xy3_mask = x3_mask | y3_mask;
-const uint64_t xz3_mask = x3_mask | z3_mask;
-const uint64_t yz3_mask = y3_mask | z3_mask;
+constexpr uint64_t x3_mask = 0x4924924924924924; // 0b...00100100
+constexpr uint64_t y3_mask = 0x2492492492492492; // 0b...10010010
+constexpr uint64_t z3_mask = 0x9249249249249249; // 0b...01001001
+constexpr uint64_t xy3_mask = x3_mask | y3_mask;
+constexpr uint64_t xz3_mask = x3_mask | z3_mask;
+constexpr uint64_t yz3_mask = y3_mask | z3_mask;
 
-template<class T = uint64_t>
-struct morton3d
+/* Spread the 21 lower bits of n, two zeros between each bit */
+inline constexpr uint64_t spreadBits3(uint64_t n)
 {
-public:
-	T key;
+	n &= 0x1fffff;
+	n = (n | n << 32) & 0x1f00000000ffff;
+	n = (n | n << 16) & 0x1f0000ff0000ff;
+	n = (n | n << 8) & 0x100f00f00f00f00f;
+	n = (n | n << 4) & 0x10c30c30c30c30c3;
+	n = (n | n << 2) & 0x1249249249249249;
+	return n;
+}
 
-public:
+inline constexpr uint64_t compactBits3(uint64_t n)
+{
+	n &= 0x1249249249249249;
+	n = (n ^ (n >> 2)) & 0x30c30c30c30c30c3;
+	n = (n ^ (n >> 4)) & 0xf00f00f00f00f00f;
+	n = (n ^ (n >> 8)) & 0x00ff0000ff0000ff;
+	n = (n ^ (n >> 16)) & 0x00ff00000000ffff;
+	n = (n ^ (n >> 32)) & 0x1fffff;
+	return n;
+}
 
-	inline explicit morton3d() : key(0) {};
-	inline explicit morton3d(const T _key) : key(_key) {};
+/* Inverse look up table : one entry per 9 bits chunk of a key, holding 3 bits of each axis.
+x is stored in bits [0, 21), y in bits [21, 42) and z in bits [42, 63) of the entry,
+so that the entries of the 7 chunks of a key are merged with a shift and an or. */
+struct morton3d_decode_table
+{
+	uint64_t entries[512];
 
-	/* If BMI2 intrinsics are not available, we rely on a look up table of precomputed morton codes.
-	Ref : http://www.forceflow.be/2013/10/07/morton-encodingdecoding-through-bit-interleaving-implementations/ */
-	inline morton3d(const uint32_t x, const uint32_t y, const uint32_t z) : key(0) {
-#ifdef USE_BMI2
-		key = static_cast<T>(_pdep_u64(z, z3_mask) | _pdep_u64(y, y3_mask) | _pdep_u64(x, x3_mask));
-#else
-		key = morton3dLUT[(x >> 16) & 0xFF] << 2 |
+	constexpr morton3d_decode_table() : entries()
+	{
+		for (uint32_t i = 0; i < 512; ++i)
+			entries[i] = compactBits3(i >> 2) | compactBits3(i >> 1) << 21 | compactBits3(i) << 42;
+	}
+};
+
+static constexpr morton3d_decode_table morton3dDecodeLUT = morton3d_decode_table();
+
+/* 16 bits look up table, built on first use */
+struct morton3d_lut16_table
+{
+	uint64_t entries[65536];
+
+	morton3d_lut16_table()
+	{
+		for (uint32_t i = 0; i < 65536; ++i)
+			entries[i] = spreadBits3(i);
+	}
+};
+
+inline const uint64_t* morton3dLUT16()
+{
+	static const morton3d_lut16_table table;
+	return table.entries;
+}
+
+/*
+Encoding strategies, one specialization for each tag of morton_codec.h.
+All of them give the same keys. Bit 21 of z goes to bit 63 of the key, as with _pdep_u64(z, z3_mask).
+*/
+template<class Codec>
+struct morton3d_codec;
+
+template<>
+struct morton3d_codec<morton_bmi2>
+{
+	MORTON_TARGET("bmi2") static inline uint64_t encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+		return _pdep_u64(z, z3_mask) | _pdep_u64(y, y3_mask) | _pdep_u64(x, x3_mask);
+	}
+
+	MORTON_TARGET("bmi2") static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		x = _pext_u64(key, x3_mask);
+		y = _pext_u64(key, y3_mask);
+		z = _pext_u64(key, z3_mask);
+	}
+};
+
+template<>
+struct morton3d_codec<morton_magicbits>
+{
+	static inline constexpr uint64_t encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+		return spreadBits3(x) << 2 | spreadBits3(y) << 1 | spreadBits3(z) | static_cast<uint64_t>(z & 0x200000) << 42;
+	}
+
+	static inline constexpr void decode(const uint64_t key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		x = compactBits3(key >> 2);
+		y = compactBits3(key >> 1);
+		z = compactBits3(key) | ((key >> 42) & 0x200000);
+	}
+};
+
+/* Look up tables strategies all decode with the 9 bits inverse table, morton3dDecodeLUT.
+Ref : http://www.forceflow.be/2013/10/07/morton-encodingdecoding-through-bit-interleaving-implementations/ */
+template<>
+struct morton3d_codec<morton_lut8>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+		uint64_t key = morton3dLUT[(x >> 16) & 0xFF] << 2 |
 			morton3dLUT[(y >> 16) & 0xFF] << 1 |
 			morton3dLUT[(z >> 16) & 0xFF];
 		key = key << 24 |
@@ -119,126 +207,291 @@ public:
 			morton3dLUT[x & 0xFF] << 2 |
 			morton3dLUT[y & 0xFF] << 1 |
 			morton3dLUT[z & 0xFF];
+		return key;
+	}
+
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		const uint64_t* lut = morton3dDecodeLUT.entries;
+		const uint64_t xyz = lut[key & 0x1ff] |
+			lut[(key >> 9) & 0x1ff] << 3 |
+			lut[(key >> 18) & 0x1ff] << 6 |
+			lut[(key >> 27) & 0x1ff] << 9 |
+			lut[(key >> 36) & 0x1ff] << 12 |
+			lut[(key >> 45) & 0x1ff] << 15 |
+			lut[(key >> 54) & 0x1ff] << 18;
+		x = xyz & 0x1fffff;
+		y = (xyz >> 21) & 0x1fffff;
+		z = (xyz >> 42) | ((key >> 42) & 0x200000);
+	}
+};
+
+template<>
+struct morton3d_codec<morton_lut16>
+{
+	/* Bits above 63 are shifted out, like with the 8 bits table */
+	static inline uint64_t encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+		const uint64_t* lut = morton3dLUT16();
+		const uint64_t xx = lut[(x >> 16) & 0xFF] << 48 | lut[x & 0xFFFF];
+		const uint64_t yy = lut[(y >> 16) & 0xFF] << 48 | lut[y & 0xFFFF];
+		const uint64_t zz = lut[(z >> 16) & 0xFF] << 48 | lut[z & 0xFFFF];
+		return xx << 2 | yy << 1 | zz;
+	}
+
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		morton3d_codec<morton_lut8>::decode(key, x, y, z);
+	}
+};
+
+/* Fast encode of morton3 code when BMI2 instructions aren't available.
+This does not work for values greater than 256.
+
+This function takes roughly the same time as a full encode (64 bits) using BMI2 intrinsic.*/
+template<>
+struct morton3d_codec<morton_lut256>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+		assert(x < 256 && y < 256 && z < 256);
+		return morton3dLUT[x] << 2 |
+			morton3dLUT[y] << 1 |
+			morton3dLUT[z];
+	}
+
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		morton3d_codec<morton_lut8>::decode(key, x, y, z);
+	}
+};
+
+/* Strategy selected at runtime, see mortonCodec() */
+template<>
+struct morton3d_codec<morton_dispatch>
+{
+	static inline uint64_t encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+#ifdef USE_BMI2
+		return morton3d_codec<morton_bmi2>::encode(x, y, z);
+#else
+		switch (mortonCodec())
+		{
+		case MORTON_CODEC_BMI2: return morton3d_codec<morton_bmi2>::encode(x, y, z);
+		case MORTON_CODEC_MAGICBITS: return morton3d_codec<morton_magicbits>::encode(x, y, z);
+		default: return morton3d_codec<morton_lut8>::encode(x, y, z);
+		}
 #endif
 	}
 
-	inline void decode(uint64_t& x, uint64_t& y, uint64_t& z) const
+	static inline void decode(const uint64_t key, uint64_t& x, uint64_t& y, uint64_t& z)
 	{
 #ifdef USE_BMI2
-		x = _pext_u64(this->key, x3_mask);
-		y = _pext_u64(this->key, y3_mask);
-		z = _pext_u64(this->key, z3_mask);
+		morton3d_codec<morton_bmi2>::decode(key, x, y, z);
 #else
-		x = compactBits(this->key >> 2);
-		y = compactBits(this->key >> 1);
-		z = compactBits(this->key);
+		switch (mortonCodec())
+		{
+		case MORTON_CODEC_BMI2: morton3d_codec<morton_bmi2>::decode(key, x, y, z); break;
+		case MORTON_CODEC_MAGICBITS: morton3d_codec<morton_magicbits>::decode(key, x, y, z); break;
+		default: morton3d_codec<morton_lut8>::decode(key, x, y, z); break;
+		}
 #endif
 	}
+};
+
+/*
+Properties of a key type. Masks of keys narrower than 64 bits are truncated, like the keys themselves.
+128 bits keys hold 42 bits per axis (43 for z) : their last bit isn't part of any axis, so that increments wrap on 42 bits.
+*/
+template<class T>
+struct morton3d_traits
+{
+	typedef typename std::conditional<(sizeof(T) > 8), uint64_t, uint32_t>::type coord_type;
+
+	//Maximum level shift for operator>> and operator<<
+	static constexpr unsigned int levels = ((sizeof(T) > 8 ? 8 * sizeof(T) : 64) + 2) / 3;
+
+	//Bits filled by the encoders : two halves of 63 bits for 128 bits keys
+	static constexpr T key_mask = sizeof(T) > 8 ? static_cast<T>(~static_cast<T>(0) >> 1) : static_cast<T>(~static_cast<T>(0));
+
+	static constexpr T x_mask = mortonMask<T>(3, 2) & key_mask;
+	static constexpr T y_mask = mortonMask<T>(3, 1) & key_mask;
+	static constexpr T z_mask = mortonMask<T>(3, 0) & key_mask;
+	static constexpr T xy_mask = x_mask | y_mask;
+	static constexpr T xz_mask = x_mask | z_mask;
+	static constexpr T yz_mask = y_mask | z_mask;
+};
+
+template<class T> constexpr unsigned int morton3d_traits<T>::levels;
+template<class T> constexpr T morton3d_traits<T>::key_mask;
+template<class T> constexpr T morton3d_traits<T>::x_mask;
+template<class T> constexpr T morton3d_traits<T>::y_mask;
+template<class T> constexpr T morton3d_traits<T>::z_mask;
+template<class T> constexpr T morton3d_traits<T>::xy_mask;
+template<class T> constexpr T morton3d_traits<T>::xz_mask;
+template<class T> constexpr T morton3d_traits<T>::yz_mask;
+
+/* Encoding of a key of type T with a 64 bits codec. Magic bits are used in constant expressions. */
+template<class T, class Codec, bool Wide = (sizeof(T) > 8)>
+struct morton3d_encoder
+{
+	static inline constexpr T encode(const uint32_t x, const uint32_t y, const uint32_t z)
+	{
+		return static_cast<T>(MORTON_CONSTANT_EVALUATED() ?
+			morton3d_codec<morton_magicbits>::encode(x, y, z) : morton3d_codec<Codec>::encode(x, y, z));
+	}
+
+	static inline constexpr void decode(const T key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		if (MORTON_CONSTANT_EVALUATED())
+			morton3d_codec<morton_magicbits>::decode(key, x, y, z);
+		else
+			morton3d_codec<Codec>::decode(key, x, y, z);
+	}
+};
+
+/* Keys wider than 64 bits are encoded as two 63 bits halves, each one holding 21 bits of each axis.
+63 being a multiple of 3, bit 0 of the high half is a z bit, just like bit 0 of the low one, so the axis masks hold on the whole key. */
+template<class T, class Codec>
+struct morton3d_encoder<T, Codec, true>
+{
+	typedef morton3d_encoder<uint64_t, Codec> half;
+
+	static inline constexpr T encode(const uint64_t x, const uint64_t y, const uint64_t z)
+	{
+		const uint64_t lo = half::encode(x & 0x1fffff, y & 0x1fffff, z & 0x1fffff);
+		const uint64_t hi = half::encode(static_cast<uint32_t>(x >> 21),
+			static_cast<uint32_t>(y >> 21), static_cast<uint32_t>(z >> 21));
+		return static_cast<T>(hi) << 63 | lo;
+	}
+
+	static inline constexpr void decode(const T key, uint64_t& x, uint64_t& y, uint64_t& z)
+	{
+		uint64_t xl = 0, yl = 0, zl = 0;
+		half::decode(static_cast<uint64_t>(key) & 0x7fffffffffffffff, xl, yl, zl);
+		half::decode(static_cast<uint64_t>(key >> 63), x, y, z);
+		x = x << 21 | xl;
+		y = y << 21 | yl;
+		z = z << 21 | zl;
+	}
+};
+
+template<class T = uint64_t, class Codec = morton_dispatch>
+struct morton3d
+{
+public:
+	typedef morton3d_traits<T> traits;
+	typedef typename traits::coord_type coord_type;
+
+	T key;
+
+public:
+
+	inline constexpr explicit morton3d() : key(0) {};
+	inline constexpr explicit morton3d(const T _key) : key(_key) {};
+
+	inline constexpr morton3d(const coord_type x, const coord_type y, const coord_type z) : key(morton3d_encoder<T, Codec>::encode(x, y, z)) {}
+
+	inline constexpr void decode(uint64_t& x, uint64_t& y, uint64_t& z) const
+	{
+		morton3d_encoder<T, Codec>::decode(this->key, x, y, z);
+	}
 
 	//Binary operators
-	inline bool operator==(const morton3d m1) const
+	inline constexpr bool operator==(const morton3d m1) const
 	{
 		return this->key == m1.key;
 	}
 
-	inline bool operator!=(const morton3d m1) const
+	inline constexpr bool operator!=(const morton3d m1) const
 	{
 		return !operator==(m1);
 	}
 
-	inline morton3d operator|(const morton3d m1) const
+	inline constexpr morton3d operator|(const morton3d m1) const
 	{
-		return morton3d<T>(this->key | m1.key);
+		return morton3d(this->key | m1.key);
 	}
 
-	inline morton3d operator&(const morton3d m1) const
+	inline constexpr morton3d operator&(const morton3d m1) const
 	{
-		return morton3d<T>(this->key & m1.key);
+		return morton3d(this->key & m1.key);
 	}
 
-	inline morton3d operator >> (const uint64_t d) const
+	inline constexpr morton3d operator >> (const uint64_t d) const
 	{
-		assert(d < 22);
-		return morton3d<T>(this->key >> (3 * d));
+		assert(d < traits::levels);
+		return morton3d(this->key >> (3 * d));
 	}
 
-	inline morton3d operator<<(const uint64_t d) const
+	inline constexpr morton3d operator<<(const uint64_t d) const
 	{
-		assert(d < 22);
-		return morton3d<T>(this->key << (3 * d));
+		assert(d < traits::levels);
+		return morton3d(this->key << (3 * d));
 	}
 
-	inline void operator+=(const morton3d<T> m1)
+	inline constexpr void operator+=(const morton3d m1)
 	{
-		T x_sum = (this->key | yz3_mask) + (m1.key & x3_mask);
-		T y_sum = (this->key | xz3_mask) + (m1.key & y3_mask);
-		T z_sum = (this->key | xy3_mask) + (m1.key & z3_mask);
-		this->key = ((x_sum & x3_mask) | (y_sum & y3_mask) | (z_sum & z3_mask));
+		T x_sum = (this->key | traits::yz_mask) + (m1.key & traits::x_mask);
+		T y_sum = (this->key | traits::xz_mask) + (m1.key & traits::y_mask);
+		T z_sum = (this->key | traits::xy_mask) + (m1.key & traits::z_mask);
+		this->key = ((x_sum & traits::x_mask) | (y_sum & traits::y_mask) | (z_sum & traits::z_mask));
 	}
 
-	inline void operator-=(const morton3d<T> m1)
+	inline constexpr void operator-=(const morton3d m1)
 	{
-		T x_diff = (this->key & x3_mask) - (m1.key & x3_mask);
-		T y_diff = (this->key & y3_mask) - (m1.key & y3_mask);
-		T z_diff = (this->key & z3_mask) - (m1.key & z3_mask);
-		this->key = ((x_diff & x3_mask) | (y_diff & y3_mask) | (z_diff & z3_mask));
+		T x_diff = (this->key & traits::x_mask) - (m1.key & traits::x_mask);
+		T y_diff = (this->key & traits::y_mask) - (m1.key & traits::y_mask);
+		T z_diff = (this->key & traits::z_mask) - (m1.key & traits::z_mask);
+		this->key = ((x_diff & traits::x_mask) | (y_diff & traits::y_mask) | (z_diff & traits::z_mask));
 	}
 
-#ifndef USE_BMI2
-	/* Fast encode of morton3 code when BMI2 instructions aren't available.
-	This does not work for values greater than 256.
-
-	This function takes roughly the same time as a full encode (64 bits) using BMI2 intrinsic.*/
-	static inline morton3d morton3d_256(const uint32_t x, const uint32_t y, const uint32_t z)
+	/* Same as morton3d<T, morton_lut256>(x, y, z) */
+	static inline constexpr morton3d morton3d_256(const uint32_t x, const uint32_t y, const uint32_t z)
 	{
-		assert(x < 256 && y < 256 && z < 256);
-		uint64_t key = morton3dLUT[x] << 2 |
-			morton3dLUT[y] << 1 |
-			morton3dLUT[z];
-		return morton3d(key);
+		return morton3d(morton3d_encoder<T, morton_lut256>::encode(x, y, z));
 	}
-#endif
 
 	/* Increment X part of a morton3 code (xyz interleaving)
 	   morton3(4,5,6).incX() == morton3(5,5,6);
 
 	   Ref : http://bitmath.blogspot.fr/2012/11/tesseral-arithmetic-useful-snippets.html */
-	inline morton3d incX() const
+	inline constexpr morton3d incX() const
 	{
-		const T x_sum = static_cast<T>((this->key | yz3_mask) + 4);
-		return morton3d<T>((x_sum & x3_mask) | (this->key & yz3_mask));
+		const T x_sum = static_cast<T>((this->key | traits::yz_mask) + 4);
+		return morton3d((x_sum & traits::x_mask) | (this->key & traits::yz_mask));
 	}
 
-	inline morton3d incY() const
+	inline constexpr morton3d incY() const
 	{
-		const T y_sum = static_cast<T>((this->key | xz3_mask) + 2);
-		return morton3d<T>((y_sum & y3_mask) | (this->key & xz3_mask));
+		const T y_sum = static_cast<T>((this->key | traits::xz_mask) + 2);
+		return morton3d((y_sum & traits::y_mask) | (this->key & traits::xz_mask));
 	}
 
-	inline morton3d incZ() const
+	inline constexpr morton3d incZ() const
 	{
-		const T z_sum = static_cast<T>((this->key | xy3_mask) + 1);
-		return morton3d<T>((z_sum & z3_mask) | (this->key & xy3_mask));
+		const T z_sum = static_cast<T>((this->key | traits::xy_mask) + 1);
+		return morton3d((z_sum & traits::z_mask) | (this->key & traits::xy_mask));
 	}
 
 	/* Decrement X part of a morton3 code (xyz interleaving)
 	   morton3(4,5,6).decX() == morton3(3,5,6); */
-	inline morton3d decX() const
+	inline constexpr morton3d decX() const
 	{
-		const T x_diff = (this->key & x3_mask) - 4;
-		return morton3d<T>((x_diff & x3_mask) | (this->key & yz3_mask));
+		const T x_diff = (this->key & traits::x_mask) - 4;
+		return morton3d((x_diff & traits::x_mask) | (this->key & traits::yz_mask));
 	}
 
-	inline morton3d decY() const
+	inline constexpr morton3d decY() const
 	{
-		const T y_diff = (this->key & y3_mask) - 2;
-		return morton3d<T>((y_diff & y3_mask) | (this->key & xz3_mask));
+		const T y_diff = (this->key & traits::y_mask) - 2;
+		return morton3d((y_diff & traits::y_mask) | (this->key & traits::xz_mask));
 	}
 
-	inline morton3d decZ() const
+	inline constexpr morton3d decZ() const
 	{
-		const T z_diff = (this->key & z3_mask) - 1;
-		return morton3d<T>((z_diff & z3_mask) | (this->key & xy3_mask));
+		const T z_diff = (this->key & traits::z_mask) - 1;
+		return morton3d((z_diff & traits::z_mask) | (this->key & traits::xy_mask));
 	}
 
 
@@ -246,41 +499,29 @@ public:
 	  min(morton3(4,5,6), morton3(8,3,7)) == morton3(4,3,6);
 	  Ref : http://asgerhoedt.dk/?p=276
 	*/
-	static inline morton3d min(const morton3d lhs, const morton3d rhs)
+	static inline constexpr morton3d min(const morton3d lhs, const morton3d rhs)
 	{
-		T lhsX = lhs.key & x3_mask;
-		T rhsX = rhs.key & x3_mask;
-		T lhsY = lhs.key & y3_mask;
-		T rhsY = rhs.key & y3_mask;
-		T lhsZ = lhs.key & z3_mask;
-		T rhsZ = rhs.key & z3_mask;
-		return morton3d<T>(std::min(lhsX, rhsX) + std::min(lhsY, rhsY) + std::min(lhsZ, rhsZ));
+		T lhsX = lhs.key & traits::x_mask;
+		T rhsX = rhs.key & traits::x_mask;
+		T lhsY = lhs.key & traits::y_mask;
+		T rhsY = rhs.key & traits::y_mask;
+		T lhsZ = lhs.key & traits::z_mask;
+		T rhsZ = rhs.key & traits::z_mask;
+		return morton3d(std::min(lhsX, rhsX) + std::min(lhsY, rhsY) + std::min(lhsZ, rhsZ));
 	}
 
 	/*
 	  max(morton3(4,5,6), morton3(8,3,7)) == morton3(8,5,7);
 	*/
-	static inline morton3d max(const morton3d lhs, const morton3d rhs)
-	{
-		T lhsX = lhs.key & x3_mask;
-		T rhsX = rhs.key & x3_mask;
-		T lhsY = lhs.key & y3_mask;
-		T rhsY = rhs.key & y3_mask;
-		T lhsZ = lhs.key & z3_mask;
-		T rhsZ = rhs.key & z3_mask;
-		return morton3d<T>(std::max(lhsX, rhsX) + std::max(lhsY, rhsY) + std::max(lhsZ, rhsZ));
-	}
-
-private:
-	inline uint64_t compactBits(uint64_t n) const
+	static inline constexpr morton3d max(const morton3d lhs, const morton3d rhs)
 	{
-		n &= 0x1249249249249249;
-		n = (n ^ (n >> 2)) & 0x30c30c30c30c30c3;
-		n = (n ^ (n >> 4)) & 0xf00f00f00f00f00f;
-		n = (n ^ (n >> 8)) & 0x00ff0000ff0000ff;
-		n = (n ^ (n >> 16)) & 0x00ff00000000ffff;
-		n = (n ^ (n >> 32)) & 0x1fffff;
-		return n;
+		T lhsX = lhs.key & traits::x_mask;
+		T rhsX = rhs.key & traits::x_mask;
+		T lhsY = lhs.key & traits::y_mask;
+		T rhsY = rhs.key & traits::y_mask;
+		T lhsZ = lhs.key & traits::z_mask;
+		T rhsZ = rhs.key & traits::z_mask;
+		return morton3d(std::max(lhsX, rhsX) + std::max(lhsY, rhsY) + std::max(lhsZ, rhsZ));
 	}
 
 };
@@ -288,59 +529,65 @@ private:
 
 /* Add two morton keys (xyz interleaving)
   morton3(4,5,6) + morton3(1,2,3) == morton3(5,7,9);*/
-template<class T>
-inline morton3d<T> operator+(const morton3d<T> m1, const morton3d<T> m2)
+template<class T, class C>
+inline constexpr morton3d<T, C> operator+(const morton3d<T, C> m1, const morton3d<T, C> m2)
 {
-	T x_sum = (m1.key | yz3_mask) + (m2.key & x3_mask);
-	T y_sum = (m1.key | xz3_mask) + (m2.key & y3_mask);
-	T z_sum = (m1.key | xy3_mask) + (m2.key & z3_mask);
-	return morton3d<T>((x_sum & x3_mask) | (y_sum & y3_mask) | (z_sum & z3_mask));
+	typedef morton3d_traits<T> traits;
+	T x_sum = (m1.key | traits::yz_mask) + (m2.key & traits::x_mask);
+	T y_sum = (m1.key | traits::xz_mask) + (m2.key & traits::y_mask);
+	T z_sum = (m1.key | traits::xy_mask) + (m2.key & traits::z_mask);
+	return morton3d<T, C>((x_sum & traits::x_mask) | (y_sum & traits::y_mask) | (z_sum & traits::z_mask));
 }
 
 /* Substract two morton keys (xyz interleaving)
    morton3(4,5,6) - morton3(1,2,3) == morton3(3,3,3);*/
-template<class T>
-inline morton3d<T> operator-(const morton3d<T> m1, const morton3d<T> m2)
+template<class T, class C>
+inline constexpr morton3d<T, C> operator-(const morton3d<T, C> m1, const morton3d<T, C> m2)
 {
-	T x_diff = (m1.key & x3_mask) - (m2.key & x3_mask);
-	T y_diff = (m1.key & y3_mask) - (m2.key & y3_mask);
-	T z_diff = (m1.key & z3_mask) - (m2.key & z3_mask);
-	return morton3d<T>((x_diff & x3_mask) | (y_diff & y3_mask) | (z_diff & z3_mask));
+	typedef morton3d_traits<T> traits;
+	T x_diff = (m1.key & traits::x_mask) - (m2.key & traits::x_mask);
+	T y_diff = (m1.key & traits::y_mask) - (m2.key & traits::y_mask);
+	T z_diff = (m1.key & traits::z_mask) - (m2.key & traits::z_mask);
+	return morton3d<T, C>((x_diff & traits::x_mask) | (y_diff & traits::y_mask) | (z_diff & traits::z_mask));
 }
 
-template<class T>
-inline bool operator< (const morton3d<T>& lhs, const morton3d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator< (const morton3d<T, C>& lhs, const morton3d<T, C>& rhs)
 {
 	return (lhs.key) < (rhs.key);
 }
 
-template<class T>
-inline bool operator> (const morton3d<T>& lhs, const morton3d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator> (const morton3d<T, C>& lhs, const morton3d<T, C>& rhs)
 {
 	return (lhs.key) > (rhs.key);
 }
 
-template<class T>
-inline bool operator>= (const morton3d<T>& lhs, const morton3d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator>= (const morton3d<T, C>& lhs, const morton3d<T, C>& rhs)
 {
 	return (lhs.key) >= (rhs.key);
 }
 
-template<class T>
-inline bool operator<= (const morton3d<T>& lhs, const morton3d<T>& rhs)
+template<class T, class C>
+inline constexpr bool operator<= (const morton3d<T, C>& lhs, const morton3d<T, C>& rhs)
 {
 	return (lhs.key) <= (rhs.key);
 }
 
-template<class T>
-std::ostream& operator<<(std::ostream& os, const morton3d<T>& m)
+template<class T, class C>
+std::ostream& operator<<(std::ostream& os, const morton3d<T, C>& m)
 {
 	uint64_t x, y, z;
 	m.decode(x, y, z);
-	os << m.key << ": " << x << ", " << y << ", " << z;
+	mortonWriteKey(os, m.key);
+	os << ": " << x << ", " << y << ", " << z;
 	return os;
 }
 
 typedef morton3d<> morton3;
+#ifdef __SIZEOF_INT128__
+typedef morton3d<morton_uint128> morton3_128;
+#endif
 
 #endif
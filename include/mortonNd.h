@@ -0,0 +1,426 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTONND_H
+#define MORTONND_H
+
+#include <cstdint>
+#include <algorithm>
+#include <assert.h>
+#include <ostream>
+#include <type_traits>
+
+#if _MSC_VER
+#include <immintrin.h>
+#endif
+
+#if __GNUC__
+#include <x86intrin.h>
+#endif
+
+#include "morton_codec.h"
+#include "morton2d.h"
+#include "morton3d.h"
+
+/*
+Morton keys interleaving D axes (2 <= D <= 8), for instance x, y, z, t :
+
+  mortonNd<4> m(x, y, z, t);
+  m.inc(3) == mortonNd<4>(x, y, z, t + 1);
+
+Axis 0 (x) holds the most significant bit of each level, axis D - 1 the least significant one,
+so that mortonNd<2> and mortonNd<3> give the same keys as morton2d and morton3d.
+Use morton<D> to get morton2d / morton3d for D = 2 and D = 3, and mortonNd otherwise.
+*/
+
+/*
+Masks of a D axes key, computed at compile time :
+- axis[i] : bits of axis i
+- spread[k] : blocks of 2^k bits every D * 2^k bits, used by magic bits encoding / decoding
+*/
+template<unsigned int D, class T>
+struct mortonNd_masks
+{
+	T axis[D];
+	T spread[8];
+
+	constexpr mortonNd_masks() : axis(), spread()
+	{
+		for (unsigned int i = 0; i < D; ++i)
+			axis[i] = mortonMask<T>(D, D - 1 - i);
+		for (unsigned int k = 0; k < 8; ++k)
+			for (unsigned int b = 0; b < 8 * sizeof(T); ++b)
+				if (b % (D << k) < (1u << k))
+					spread[k] |= static_cast<T>(1) << b;
+	}
+};
+
+/*
+Properties of a D axes key type. The last axis gets the remaining bits when 8 * sizeof(T) is not a multiple of D,
+like z in morton3d.
+*/
+template<unsigned int D, class T>
+struct mortonNd_traits
+{
+	static_assert(D >= 2 && D <= 8, "mortonNd supports 2 to 8 axes");
+
+	//Bits of the widest axis, also the maximum level shift for operator>> and operator<<
+	static constexpr unsigned int levels = (8 * sizeof(T) + D - 1) / D;
+
+	typedef typename std::conditional<(levels > 32), uint64_t, uint32_t>::type coord_type;
+
+	//Number of magic bits steps : blocks of 2^steps bits hold a whole coordinate
+	static constexpr unsigned int steps = levels <= 1 ? 0 : levels <= 2 ? 1 : levels <= 4 ? 2 : levels <= 8 ? 3 :
+		levels <= 16 ? 4 : levels <= 32 ? 5 : 6;
+
+	static constexpr mortonNd_masks<D, T> masks = mortonNd_masks<D, T>();
+};
+
+template<unsigned int D, class T> constexpr unsigned int mortonNd_traits<D, T>::levels;
+template<unsigned int D, class T> constexpr unsigned int mortonNd_traits<D, T>::steps;
+template<unsigned int D, class T> constexpr mortonNd_masks<D, T> mortonNd_traits<D, T>::masks;
+
+/*
+Encoding strategies. Magic bits are the generic one : look up table strategies use it too,
+their tables being specific to 2 and 3 axes.
+Ref : https://graphics.stanford.edu/~seander/bithacks.html#InterleaveBMN
+*/
+template<unsigned int D, class T, class Codec>
+struct mortonNd_codec
+{
+	typedef mortonNd_traits<D, T> traits;
+
+	static inline constexpr T spreadBits(const uint64_t v)
+	{
+		T x = static_cast<T>(v) & traits::masks.spread[traits::steps];
+		for (unsigned int k = traits::steps; k-- > 0;)
+			x = (x | (x << ((D - 1) << k))) & traits::masks.spread[k];
+		return x;
+	}
+
+	static inline constexpr uint64_t compactBits(T x)
+	{
+		x &= traits::masks.spread[0];
+		for (unsigned int k = 0; k < traits::steps; ++k)
+			x = (x | (x >> ((D - 1) << k))) & traits::masks.spread[k + 1];
+		return static_cast<uint64_t>(x);
+	}
+
+	static inline constexpr T encode(const typename traits::coord_type (&c)[D])
+	{
+		T key = 0;
+		for (unsigned int i = 0; i < D; ++i)
+			key |= spreadBits(c[i]) << (D - 1 - i);
+		return key;
+	}
+
+	static inline constexpr void decode(const T key, uint64_t (&c)[D])
+	{
+		for (unsigned int i = 0; i < D; ++i)
+			c[i] = compactBits(key >> (D - 1 - i));
+	}
+};
+
+/* pdep / pext. Keys wider than 64 bits use magic bits. */
+template<unsigned int D, class T>
+struct mortonNd_codec<D, T, morton_bmi2>
+{
+	typedef mortonNd_traits<D, T> traits;
+	typedef mortonNd_codec<D, T, morton_magicbits> fallback;
+
+	MORTON_TARGET("bmi2") static inline T encode(const typename traits::coord_type (&c)[D])
+	{
+		if (sizeof(T) > 8)
+			return fallback::encode(c);
+		uint64_t key = 0;
+		for (unsigned int i = 0; i < D; ++i)
+			key |= _pdep_u64(c[i], static_cast<uint64_t>(traits::masks.axis[i]));
+		return static_cast<T>(key);
+	}
+
+	MORTON_TARGET("bmi2") static inline void decode(const T key, uint64_t (&c)[D])
+	{
+		if (sizeof(T) > 8)
+			return fallback::decode(key, c);
+		for (unsigned int i = 0; i < D; ++i)
+			c[i] = _pext_u64(static_cast<uint64_t>(key), static_cast<uint64_t>(traits::masks.axis[i]));
+	}
+};
+
+template<unsigned int D, class T>
+struct mortonNd_codec<D, T, morton_dispatch>
+{
+	typedef mortonNd_traits<D, T> traits;
+
+	static inline T encode(const typename traits::coord_type (&c)[D])
+	{
+#ifdef USE_BMI2
+		return mortonNd_codec<D, T, morton_bmi2>::encode(c);
+#else
+		if (mortonCodec() == MORTON_CODEC_BMI2)
+			return mortonNd_codec<D, T, morton_bmi2>::encode(c);
+		return mortonNd_codec<D, T, morton_magicbits>::encode(c);
+#endif
+	}
+
+	static inline void decode(const T key, uint64_t (&c)[D])
+	{
+#ifdef USE_BMI2
+		mortonNd_codec<D, T, morton_bmi2>::decode(key, c);
+#else
+		if (mortonCodec() == MORTON_CODEC_BMI2)
+			mortonNd_codec<D, T, morton_bmi2>::decode(key, c);
+		else
+			mortonNd_codec<D, T, morton_magicbits>::decode(key, c);
+#endif
+	}
+};
+
+/* Magic bits are used in constant expressions. */
+template<unsigned int D, class T, class Codec>
+struct mortonNd_encoder
+{
+	typedef typename mortonNd_traits<D, T>::coord_type coord_type;
+
+	static inline constexpr T encode(const coord_type (&c)[D])
+	{
+		return MORTON_CONSTANT_EVALUATED() ?
+			mortonNd_codec<D, T, morton_magicbits>::encode(c) : mortonNd_codec<D, T, Codec>::encode(c);
+	}
+
+	static inline constexpr void decode(const T key, uint64_t (&c)[D])
+	{
+		if (MORTON_CONSTANT_EVALUATED())
+			mortonNd_codec<D, T, morton_magicbits>::decode(key, c);
+		else
+			mortonNd_codec<D, T, Codec>::decode(key, c);
+	}
+};
+
+template<unsigned int D, class T = uint64_t, class Codec = morton_dispatch>
+struct mortonNd
+{
+public:
+	typedef mortonNd_traits<D, T> traits;
+	typedef typename traits::coord_type coord_type;
+
+	T key;
+
+public:
+
+	inline constexpr mortonNd() : key(0) {};
+	inline constexpr explicit mortonNd(const T _key) : key(_key) {};
+
+	inline constexpr explicit mortonNd(const coord_type (&c)[D]) : key(mortonNd_encoder<D, T, Codec>::encode(c)) {}
+
+	/* One coordinate per axis : mortonNd<4>(x, y, z, t) */
+	template<class... Coords>
+	inline constexpr mortonNd(const coord_type c0, const coord_type c1, const Coords... c)
+		: key(mortonNd_encoder<D, T, Codec>::encode({ c0, c1, static_cast<coord_type>(c)... }))
+	{
+		static_assert(sizeof...(Coords) + 2 == D, "mortonNd needs one coordinate per axis");
+	}
+
+	inline constexpr void decode(uint64_t (&c)[D]) const
+	{
+		mortonNd_encoder<D, T, Codec>::decode(this->key, c);
+	}
+
+	/* Coordinate of a single axis */
+	inline constexpr uint64_t coord(const unsigned int axis) const
+	{
+		return mortonNd_codec<D, T, morton_magicbits>::compactBits(this->key >> (D - 1 - axis));
+	}
+
+	//Binary operators
+	inline constexpr bool operator==(const mortonNd m1) const
+	{
+		return this->key == m1.key;
+	}
+
+	inline constexpr bool operator!=(const mortonNd m1) const
+	{
+		return !operator==(m1);
+	}
+
+	inline constexpr mortonNd operator|(const mortonNd m1) const
+	{
+		return mortonNd(this->key | m1.key);
+	}
+
+	inline constexpr mortonNd operator&(const mortonNd m1) const
+	{
+		return mortonNd(this->key & m1.key);
+	}
+
+	inline constexpr mortonNd operator >> (const uint64_t d) const
+	{
+		assert(d < traits::levels);
+		return mortonNd(this->key >> (D * d));
+	}
+
+	inline constexpr mortonNd operator<<(const uint64_t d) const
+	{
+		assert(d < traits::levels);
+		return mortonNd(this->key << (D * d));
+	}
+
+	inline constexpr void operator+=(const mortonNd m1)
+	{
+		T sum = 0;
+		for (unsigned int i = 0; i < D; ++i)
+			sum |= ((this->key | ~traits::masks.axis[i]) + (m1.key & traits::masks.axis[i])) & traits::masks.axis[i];
+		this->key = sum;
+	}
+
+	inline constexpr void operator-=(const mortonNd m1)
+	{
+		T diff = 0;
+		for (unsigned int i = 0; i < D; ++i)
+			diff |= ((this->key & traits::masks.axis[i]) - (m1.key & traits::masks.axis[i])) & traits::masks.axis[i];
+		this->key = diff;
+	}
+
+	/* Increment one axis of a morton key
+	   mortonNd<4>(4,5,6,7).inc(0) == mortonNd<4>(5,5,6,7);
+
+	   Ref : http://bitmath.blogspot.fr/2012/11/tesseral-arithmetic-useful-snippets.html */
+	inline constexpr mortonNd inc(const unsigned int axis) const
+	{
+		const T mask = traits::masks.axis[axis];
+		const T sum = static_cast<T>((this->key | ~mask) + (static_cast<T>(1) << (D - 1 - axis)));
+		return mortonNd((sum & mask) | (this->key & ~mask));
+	}
+
+	/* Decrement one axis of a morton key
+	   mortonNd<4>(4,5,6,7).dec(3) == mortonNd<4>(4,5,6,6); */
+	inline constexpr mortonNd dec(const unsigned int axis) const
+	{
+		const T mask = traits::masks.axis[axis];
+		const T diff = static_cast<T>((this->key & mask) - (static_cast<T>(1) << (D - 1 - axis)));
+		return mortonNd((diff & mask) | (this->key & ~mask));
+	}
+
+	/*
+	  min(mortonNd<4>(4,5,6,1), mortonNd<4>(8,3,7,2)) == mortonNd<4>(4,3,6,1);
+	  Ref : http://asgerhoedt.dk/?p=276
+	*/
+	static inline constexpr mortonNd min(const mortonNd lhs, const mortonNd rhs)
+	{
+		T key = 0;
+		for (unsigned int i = 0; i < D; ++i)
+			key |= std::min<T>(lhs.key & traits::masks.axis[i], rhs.key & traits::masks.axis[i]);
+		return mortonNd(key);
+	}
+
+	static inline constexpr mortonNd max(const mortonNd lhs, const mortonNd rhs)
+	{
+		T key = 0;
+		for (unsigned int i = 0; i < D; ++i)
+			key |= std::max<T>(lhs.key & traits::masks.axis[i], rhs.key & traits::masks.axis[i]);
+		return mortonNd(key);
+	}
+};
+
+/* Add two morton keys
+  mortonNd<4>(4,5,6,7) + mortonNd<4>(1,2,3,4) == mortonNd<4>(5,7,9,11);*/
+template<unsigned int D, class T, class C>
+inline constexpr mortonNd<D, T, C> operator+(mortonNd<D, T, C> m1, const mortonNd<D, T, C> m2)
+{
+	m1 += m2;
+	return m1;
+}
+
+/* Substract two morton keys
+   mortonNd<4>(4,5,6,7) - mortonNd<4>(1,2,3,4) == mortonNd<4>(3,3,3,3);*/
+template<unsigned int D, class T, class C>
+inline constexpr mortonNd<D, T, C> operator-(mortonNd<D, T, C> m1, const mortonNd<D, T, C> m2)
+{
+	m1 -= m2;
+	return m1;
+}
+
+template<unsigned int D, class T, class C>
+inline constexpr bool operator< (const mortonNd<D, T, C>& lhs, const mortonNd<D, T, C>& rhs)
+{
+	return (lhs.key) < (rhs.key);
+}
+
+template<unsigned int D, class T, class C>
+inline constexpr bool operator> (const mortonNd<D, T, C>& lhs, const mortonNd<D, T, C>& rhs)
+{
+	return (lhs.key) > (rhs.key);
+}
+
+template<unsigned int D, class T, class C>
+inline constexpr bool operator>= (const mortonNd<D, T, C>& lhs, const mortonNd<D, T, C>& rhs)
+{
+	return (lhs.key) >= (rhs.key);
+}
+
+template<unsigned int D, class T, class C>
+inline constexpr bool operator<= (const mortonNd<D, T, C>& lhs, const mortonNd<D, T, C>& rhs)
+{
+	return (lhs.key) <= (rhs.key);
+}
+
+template<unsigned int D, class T, class C>
+std::ostream& operator<<(std::ostream& os, const mortonNd<D, T, C>& m)
+{
+	uint64_t c[D];
+	m.decode(c);
+	mortonWriteKey(os, m.key);
+	os << ": " << c[0];
+	for (unsigned int i = 1; i < D; ++i)
+		os << ", " << c[i];
+	return os;
+}
+
+/* morton<D, T, Codec> : the dedicated morton2d and morton3d for 2 and 3 axes, mortonNd otherwise */
+template<unsigned int D, class T, class Codec>
+struct morton_select
+{
+	typedef mortonNd<D, T, Codec> type;
+};
+
+template<class T, class Codec>
+struct morton_select<2, T, Codec>
+{
+	typedef morton2d<T, Codec> type;
+};
+
+template<class T, class Codec>
+struct morton_select<3, T, Codec>
+{
+	typedef morton3d<T, Codec> type;
+};
+
+template<unsigned int D, class T = uint64_t, class Codec = morton_dispatch>
+using morton = typename morton_select<D, T, Codec>::type;
+
+typedef mortonNd<4> morton4;
+#ifdef __SIZEOF_INT128__
+typedef mortonNd<4, morton_uint128> morton4_128;
+#endif
+
+#endif
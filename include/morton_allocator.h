@@ -0,0 +1,207 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_ALLOCATOR_H
+#define MORTON_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#if __linux__
+#include <sys/mman.h>
+#endif
+
+#if _MSC_VER
+#include <malloc.h>
+#endif
+
+#include "morton_sort.h"
+
+/*
+Allocators for grids stored in morton order, std::vector<T, morton_allocator<T, ...>>.
+Random accesses to a large grid touch a new page almost every time : with 4 KiB pages the TLB misses cost more than the cache misses.
+
+  MORTON_PAGES_CACHE_LINE       : aligned on 64 bytes
+  MORTON_PAGES_ALIGNED          : aligned on 4 KiB
+  MORTON_PAGES_TRANSPARENT_HUGE : aligned on 2 MiB and madvise(MADV_HUGEPAGE), transparent huge pages if the kernel has them
+  MORTON_PAGES_HUGETLB          : mmap(MAP_HUGETLB) from the reserved huge pages (/proc/sys/vm/nr_hugepages), else as MORTON_PAGES_TRANSPARENT_HUGE
+
+With FirstTouch, each page is first written by one of the threads (one per core) which then process the grid as contiguous ranges,
+like mortonStencil or mortonSort : on NUMA hosts the kernel places a page on the node of the thread which touches it first.
+Huge pages fall back to 4 KiB aligned memory on systems other than linux.
+*/
+enum morton_pages
+{
+	MORTON_PAGES_CACHE_LINE,
+	MORTON_PAGES_ALIGNED,
+	MORTON_PAGES_TRANSPARENT_HUGE,
+	MORTON_PAGES_HUGETLB
+};
+
+static const size_t mortonPageSize = 1 << 12;
+static const size_t mortonHugePageSize = 1 << 21;
+
+inline void* mortonAlignedAlloc(const size_t bytes, const size_t alignment)
+{
+#if _MSC_VER
+	void* p = _aligned_malloc(bytes, alignment);
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, alignment, bytes) != 0)
+		p = nullptr;
+#endif
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+inline void mortonAlignedFree(void* p)
+{
+#if _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/* Bytes of a huge pages mapping of n bytes */
+inline size_t mortonHugeBytes(const size_t bytes)
+{
+	return (bytes + mortonHugePageSize - 1) & ~(mortonHugePageSize - 1);
+}
+
+inline void* mortonHugeAlloc(const size_t bytes, const bool hugetlb)
+{
+#if __linux__
+	const size_t size = mortonHugeBytes(bytes);
+#ifdef MAP_HUGETLB
+	if (hugetlb)
+	{
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+			return p;
+	}
+#endif
+	//Map one more huge page, and unmap what is before and after the first aligned huge page
+	char* map = static_cast<char*>(mmap(nullptr, size + mortonHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (map == MAP_FAILED)
+		throw std::bad_alloc();
+	char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(map) + mortonHugePageSize - 1) & ~(mortonHugePageSize - 1));
+	if (p != map)
+		munmap(map, p - map);
+	munmap(p + size, map + mortonHugePageSize - p);
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	return p;
+#else
+	(void)hugetlb;
+	return mortonAlignedAlloc(bytes, mortonPageSize);
+#endif
+}
+
+inline void mortonHugeFree(void* p, const size_t bytes)
+{
+#if __linux__
+	munmap(p, mortonHugeBytes(bytes));
+#else
+	(void)bytes;
+	mortonAlignedFree(p);
+#endif
+}
+
+/* Writes the first byte of each 4 KiB page, pages split in contiguous ranges between threads (0 : all cores).
+Huge pages are touched 4 KiB at a time too, as the kernel may not have backed them with a huge page. */
+inline void mortonFirstTouch(void* p, const size_t bytes, unsigned int threads = 0)
+{
+	char* data = static_cast<char*>(p);
+	const size_t pages = (bytes + mortonPageSize - 1) / mortonPageSize;
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threads, pages)));
+	mortonParallelFor(threads, [&](const unsigned int t)
+	{
+		for (size_t i = pages * t / threads; i < pages * (t + 1) / threads; ++i)
+			data[i * mortonPageSize] = 0;
+	});
+}
+
+template<class T, morton_pages Pages = MORTON_PAGES_CACHE_LINE, bool FirstTouch = false>
+struct morton_allocator
+{
+	typedef T value_type;
+
+	template<class U>
+	struct rebind
+	{
+		typedef morton_allocator<U, Pages, FirstTouch> other;
+	};
+
+	morton_allocator() = default;
+
+	template<class U>
+	morton_allocator(const morton_allocator<U, Pages, FirstTouch>&)
+	{
+	}
+
+	T* allocate(const size_t n)
+	{
+		const size_t bytes = std::max<size_t>(n * sizeof(T), 1);
+		void* p;
+		switch (Pages)
+		{
+		case MORTON_PAGES_CACHE_LINE: p = mortonAlignedAlloc((bytes + 63) & ~size_t(63), 64); break;
+		case MORTON_PAGES_ALIGNED: p = mortonAlignedAlloc(bytes, mortonPageSize); break;
+		default: p = mortonHugeAlloc(bytes, Pages == MORTON_PAGES_HUGETLB); break;
+		}
+		if (FirstTouch)
+			mortonFirstTouch(p, bytes);
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, const size_t n)
+	{
+		if (Pages >= MORTON_PAGES_TRANSPARENT_HUGE)
+			mortonHugeFree(p, std::max<size_t>(n * sizeof(T), 1));
+		else
+			mortonAlignedFree(p);
+	}
+};
+
+template<class T, class U, morton_pages Pages, bool FirstTouch>
+inline bool operator==(const morton_allocator<T, Pages, FirstTouch>&, const morton_allocator<U, Pages, FirstTouch>&)
+{
+	return true;
+}
+
+template<class T, class U, morton_pages Pages, bool FirstTouch>
+inline bool operator!=(const morton_allocator<T, Pages, FirstTouch>&, const morton_allocator<U, Pages, FirstTouch>&)
+{
+	return false;
+}
+
+#endif
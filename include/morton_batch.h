@@ -0,0 +1,702 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_BATCH_H
+#define MORTON_BATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+#include "morton2d.h"
+#include "morton3d.h"
+#include "morton_cpu.h"
+
+/*
+Encode / decode arrays of coordinates.
+
+Each function exists in three flavours : a scalar fallback which relies on the single key
+morton2d / morton3d constructors, and AVX2 (4 keys per instruction) and AVX-512 (8 keys per instruction)
+kernels using the "magic bits" shift and mask method. Decoding also has an SSE2 kernel (2 keys per instruction),
+used instead of the scalar one on hosts without AVX2 : it is faster than scalar look up tables and magic bits,
+but not than scalar pext. All of them give exactly the same keys as
+morton2(x, y) and morton3(x, y, z).
+encode2d(), decode2d(), encode3d() and decode3d() pick the widest kernel supported by the host.
+
+Ref : http://www.forceflow.be/2013/10/07/morton-encodingdecoding-through-bit-interleaving-implementations/
+*/
+
+//Scalar fallback
+inline void encode2d_scalar(const uint32_t* x, const uint32_t* y, uint64_t* out, const size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = morton2(x[i], y[i]).key;
+}
+
+inline void decode2d_scalar(const uint64_t* keys, uint32_t* x, uint32_t* y, const size_t n)
+{
+	uint64_t xx, yy;
+	for (size_t i = 0; i < n; ++i)
+	{
+		morton2(keys[i]).decode(xx, yy);
+		x[i] = static_cast<uint32_t>(xx);
+		y[i] = static_cast<uint32_t>(yy);
+	}
+}
+
+inline void encode3d_scalar(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* out, const size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = morton3(x[i], y[i], z[i]).key;
+}
+
+inline void decode3d_scalar(const uint64_t* keys, uint32_t* x, uint32_t* y, uint32_t* z, const size_t n)
+{
+	uint64_t xx, yy, zz;
+	for (size_t i = 0; i < n; ++i)
+	{
+		morton3(keys[i]).decode(xx, yy, zz);
+		x[i] = static_cast<uint32_t>(xx);
+		y[i] = static_cast<uint32_t>(yy);
+		z[i] = static_cast<uint32_t>(zz);
+	}
+}
+
+//SSE2 kernels : decode only, for hosts without AVX2. SSE2 is part of x86-64, no target attribute is needed
+static inline __m128i compactBits2_sse2(__m128i v)
+{
+	v = _mm_and_si128(v, _mm_set1_epi64x(0x5555555555555555));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 1)), _mm_set1_epi64x(0x3333333333333333));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 2)), _mm_set1_epi64x(0x0f0f0f0f0f0f0f0f));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 4)), _mm_set1_epi64x(0x00ff00ff00ff00ff));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 8)), _mm_set1_epi64x(0x0000ffff0000ffff));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 16)), _mm_set1_epi64x(0x00000000ffffffff));
+	return v;
+}
+
+static inline __m128i compactBits3_sse2(__m128i v)
+{
+	v = _mm_and_si128(v, _mm_set1_epi64x(0x1249249249249249));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 2)), _mm_set1_epi64x(0x30c30c30c30c30c3));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 4)), _mm_set1_epi64x(0xf00f00f00f00f00f));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 8)), _mm_set1_epi64x(0x00ff0000ff0000ff));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 16)), _mm_set1_epi64x(0x00ff00000000ffff));
+	v = _mm_and_si128(_mm_xor_si128(v, _mm_srli_epi64(v, 32)), _mm_set1_epi64x(0x1fffff));
+	return v;
+}
+
+/* Keep the lower 32 bits of each 64 bits lane, for two vectors */
+static inline void storeLow32_sse2(uint32_t* out, const __m128i lo, const __m128i hi)
+{
+	const __m128i packed = _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0)),
+		_mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+}
+
+inline void decode2d_sse2(const uint64_t* keys, uint32_t* x, uint32_t* y, const size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+		const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i + 2));
+		storeLow32_sse2(x + i, compactBits2_sse2(_mm_srli_epi64(lo, 1)), compactBits2_sse2(_mm_srli_epi64(hi, 1)));
+		storeLow32_sse2(y + i, compactBits2_sse2(lo), compactBits2_sse2(hi));
+	}
+	decode2d_scalar(keys + i, x + i, y + i, n - i);
+}
+
+inline void decode3d_sse2(const uint64_t* keys, uint32_t* x, uint32_t* y, uint32_t* z, const size_t n)
+{
+	const __m128i z21 = _mm_set1_epi64x(0x200000);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+		const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i + 2));
+		storeLow32_sse2(x + i, compactBits3_sse2(_mm_srli_epi64(lo, 2)), compactBits3_sse2(_mm_srli_epi64(hi, 2)));
+		storeLow32_sse2(y + i, compactBits3_sse2(_mm_srli_epi64(lo, 1)), compactBits3_sse2(_mm_srli_epi64(hi, 1)));
+		storeLow32_sse2(z + i, _mm_or_si128(compactBits3_sse2(lo), _mm_and_si128(_mm_srli_epi64(lo, 42), z21)),
+			_mm_or_si128(compactBits3_sse2(hi), _mm_and_si128(_mm_srli_epi64(hi, 42), z21)));
+	}
+	decode3d_scalar(keys + i, x + i, y + i, z + i, n - i);
+}
+
+//AVX2 kernels
+MORTON_TARGET("avx2") static inline __m256i spreadBits2_avx2(__m256i v)
+{
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 16)), _mm256_set1_epi64x(0x0000ffff0000ffff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 8)), _mm256_set1_epi64x(0x00ff00ff00ff00ff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 4)), _mm256_set1_epi64x(0x0f0f0f0f0f0f0f0f));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 2)), _mm256_set1_epi64x(0x3333333333333333));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 1)), _mm256_set1_epi64x(0x5555555555555555));
+	return v;
+}
+
+MORTON_TARGET("avx2") static inline __m256i compactBits2_avx2(__m256i v)
+{
+	v = _mm256_and_si256(v, _mm256_set1_epi64x(0x5555555555555555));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 1)), _mm256_set1_epi64x(0x3333333333333333));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 2)), _mm256_set1_epi64x(0x0f0f0f0f0f0f0f0f));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 4)), _mm256_set1_epi64x(0x00ff00ff00ff00ff));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 8)), _mm256_set1_epi64x(0x0000ffff0000ffff));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 16)), _mm256_set1_epi64x(0x00000000ffffffff));
+	return v;
+}
+
+/* Only the 21 lower bits are spread : bit 21 of z, which lands on bit 63 of the key, is handled by the caller. */
+MORTON_TARGET("avx2") static inline __m256i spreadBits3_avx2(__m256i v)
+{
+	v = _mm256_and_si256(v, _mm256_set1_epi64x(0x1fffff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 32)), _mm256_set1_epi64x(0x1f00000000ffff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 16)), _mm256_set1_epi64x(0x1f0000ff0000ff));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 8)), _mm256_set1_epi64x(0x100f00f00f00f00f));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 4)), _mm256_set1_epi64x(0x10c30c30c30c30c3));
+	v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 2)), _mm256_set1_epi64x(0x1249249249249249));
+	return v;
+}
+
+MORTON_TARGET("avx2") static inline __m256i compactBits3_avx2(__m256i v)
+{
+	v = _mm256_and_si256(v, _mm256_set1_epi64x(0x1249249249249249));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 2)), _mm256_set1_epi64x(0x30c30c30c30c30c3));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 4)), _mm256_set1_epi64x(0xf00f00f00f00f00f));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 8)), _mm256_set1_epi64x(0x00ff0000ff0000ff));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 16)), _mm256_set1_epi64x(0x00ff00000000ffff));
+	v = _mm256_and_si256(_mm256_xor_si256(v, _mm256_srli_epi64(v, 32)), _mm256_set1_epi64x(0x1fffff));
+	return v;
+}
+
+/* Keep the lower 32 bits of each 64 bits lane */
+MORTON_TARGET("avx2") static inline void storeLow32_avx2(uint32_t* out, const __m256i v)
+{
+	const __m256i packed = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+}
+
+MORTON_TARGET("avx2") static inline __m256i load32_avx2(const uint32_t* in)
+{
+	return _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+}
+
+MORTON_TARGET("avx2") inline void encode2d_avx2(const uint32_t* x, const uint32_t* y, uint64_t* out, const size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i xx = spreadBits2_avx2(load32_avx2(x + i));
+		const __m256i yy = spreadBits2_avx2(load32_avx2(y + i));
+		const __m256i key = _mm256_or_si256(_mm256_slli_epi64(xx, 1), yy);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), key);
+	}
+	encode2d_scalar(x + i, y + i, out + i, n - i);
+}
+
+MORTON_TARGET("avx2") inline void decode2d_avx2(const uint64_t* keys, uint32_t* x, uint32_t* y, const size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		storeLow32_avx2(x + i, compactBits2_avx2(_mm256_srli_epi64(key, 1)));
+		storeLow32_avx2(y + i, compactBits2_avx2(key));
+	}
+	decode2d_scalar(keys + i, x + i, y + i, n - i);
+}
+
+MORTON_TARGET("avx2") inline void encode3d_avx2(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* out, const size_t n)
+{
+	const __m256i z21 = _mm256_set1_epi64x(0x200000);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i xx = spreadBits3_avx2(load32_avx2(x + i));
+		const __m256i yy = spreadBits3_avx2(load32_avx2(y + i));
+		const __m256i zin = load32_avx2(z + i);
+		const __m256i zz = _mm256_or_si256(spreadBits3_avx2(zin), _mm256_slli_epi64(_mm256_and_si256(zin, z21), 42));
+		const __m256i key = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi64(xx, 2), _mm256_slli_epi64(yy, 1)), zz);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), key);
+	}
+	encode3d_scalar(x + i, y + i, z + i, out + i, n - i);
+}
+
+MORTON_TARGET("avx2") inline void decode3d_avx2(const uint64_t* keys, uint32_t* x, uint32_t* y, uint32_t* z, const size_t n)
+{
+	const __m256i z21 = _mm256_set1_epi64x(0x200000);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		storeLow32_avx2(x + i, compactBits3_avx2(_mm256_srli_epi64(key, 2)));
+		storeLow32_avx2(y + i, compactBits3_avx2(_mm256_srli_epi64(key, 1)));
+		storeLow32_avx2(z + i, _mm256_or_si256(compactBits3_avx2(key), _mm256_and_si256(_mm256_srli_epi64(key, 42), z21)));
+	}
+	decode3d_scalar(keys + i, x + i, y + i, z + i, n - i);
+}
+
+//AVX-512 kernels
+MORTON_TARGET("avx512f") static inline __m512i spreadBits2_avx512(__m512i v)
+{
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 16)), _mm512_set1_epi64(0x0000ffff0000ffff));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 8)), _mm512_set1_epi64(0x00ff00ff00ff00ff));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 4)), _mm512_set1_epi64(0x0f0f0f0f0f0f0f0f));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 2)), _mm512_set1_epi64(0x3333333333333333));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 1)), _mm512_set1_epi64(0x5555555555555555));
+	return v;
+}
+
+MORTON_TARGET("avx512f") static inline __m512i compactBits2_avx512(__m512i v)
+{
+	v = _mm512_and_si512(v, _mm512_set1_epi64(0x5555555555555555));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 1)), _mm512_set1_epi64(0x3333333333333333));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 2)), _mm512_set1_epi64(0x0f0f0f0f0f0f0f0f));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 4)), _mm512_set1_epi64(0x00ff00ff00ff00ff));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 8)), _mm512_set1_epi64(0x0000ffff0000ffff));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 16)), _mm512_set1_epi64(0x00000000ffffffff));
+	return v;
+}
+
+MORTON_TARGET("avx512f") static inline __m512i spreadBits3_avx512(__m512i v)
+{
+	v = _mm512_and_si512(v, _mm512_set1_epi64(0x1fffff));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 32)), _mm512_set1_epi64(0x1f00000000ffff));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 16)), _mm512_set1_epi64(0x1f0000ff0000ff));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 8)), _mm512_set1_epi64(0x100f00f00f00f00f));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 4)), _mm512_set1_epi64(0x10c30c30c30c30c3));
+	v = _mm512_and_si512(_mm512_or_si512(v, _mm512_slli_epi64(v, 2)), _mm512_set1_epi64(0x1249249249249249));
+	return v;
+}
+
+MORTON_TARGET("avx512f") static inline __m512i compactBits3_avx512(__m512i v)
+{
+	v = _mm512_and_si512(v, _mm512_set1_epi64(0x1249249249249249));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 2)), _mm512_set1_epi64(0x30c30c30c30c30c3));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 4)), _mm512_set1_epi64(0xf00f00f00f00f00f));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 8)), _mm512_set1_epi64(0x00ff0000ff0000ff));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 16)), _mm512_set1_epi64(0x00ff00000000ffff));
+	v = _mm512_and_si512(_mm512_xor_si512(v, _mm512_srli_epi64(v, 32)), _mm512_set1_epi64(0x1fffff));
+	return v;
+}
+
+MORTON_TARGET("avx512f") static inline __m512i load32_avx512(const uint32_t* in)
+{
+	return _mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in)));
+}
+
+MORTON_TARGET("avx512f") static inline void storeLow32_avx512(uint32_t* out, const __m512i v)
+{
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm512_cvtepi64_epi32(v));
+}
+
+MORTON_TARGET("avx512f") inline void encode2d_avx512(const uint32_t* x, const uint32_t* y, uint64_t* out, const size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i xx = spreadBits2_avx512(load32_avx512(x + i));
+		const __m512i yy = spreadBits2_avx512(load32_avx512(y + i));
+		_mm512_storeu_si512(out + i, _mm512_or_si512(_mm512_slli_epi64(xx, 1), yy));
+	}
+	encode2d_scalar(x + i, y + i, out + i, n - i);
+}
+
+MORTON_TARGET("avx512f") inline void decode2d_avx512(const uint64_t* keys, uint32_t* x, uint32_t* y, const size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i key = _mm512_loadu_si512(keys + i);
+		storeLow32_avx512(x + i, compactBits2_avx512(_mm512_srli_epi64(key, 1)));
+		storeLow32_avx512(y + i, compactBits2_avx512(key));
+	}
+	decode2d_scalar(keys + i, x + i, y + i, n - i);
+}
+
+MORTON_TARGET("avx512f") inline void encode3d_avx512(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* out, const size_t n)
+{
+	const __m512i z21 = _mm512_set1_epi64(0x200000);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i xx = spreadBits3_avx512(load32_avx512(x + i));
+		const __m512i yy = spreadBits3_avx512(load32_avx512(y + i));
+		const __m512i zin = load32_avx512(z + i);
+		const __m512i zz = _mm512_or_si512(spreadBits3_avx512(zin), _mm512_slli_epi64(_mm512_and_si512(zin, z21), 42));
+		const __m512i key = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi64(xx, 2), _mm512_slli_epi64(yy, 1)), zz);
+		_mm512_storeu_si512(out + i, key);
+	}
+	encode3d_scalar(x + i, y + i, z + i, out + i, n - i);
+}
+
+MORTON_TARGET("avx512f") inline void decode3d_avx512(const uint64_t* keys, uint32_t* x, uint32_t* y, uint32_t* z, const size_t n)
+{
+	const __m512i z21 = _mm512_set1_epi64(0x200000);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i key = _mm512_loadu_si512(keys + i);
+		storeLow32_avx512(x + i, compactBits3_avx512(_mm512_srli_epi64(key, 2)));
+		storeLow32_avx512(y + i, compactBits3_avx512(_mm512_srli_epi64(key, 1)));
+		storeLow32_avx512(z + i, _mm512_or_si512(compactBits3_avx512(key), _mm512_and_si512(_mm512_srli_epi64(key, 42), z21)));
+	}
+	decode3d_scalar(keys + i, x + i, y + i, z + i, n - i);
+}
+
+//Widest kernel available on the host
+inline void encode2d(const uint32_t* x, const uint32_t* y, uint64_t* out, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		encode2d_avx512(x, y, out, n);
+	else if (mortonCpu().avx2)
+		encode2d_avx2(x, y, out, n);
+	else
+		encode2d_scalar(x, y, out, n);
+}
+
+inline void decode2d(const uint64_t* keys, uint32_t* x, uint32_t* y, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		decode2d_avx512(keys, x, y, n);
+	else if (mortonCpu().avx2)
+		decode2d_avx2(keys, x, y, n);
+	else if (mortonCodec() == MORTON_CODEC_BMI2)
+		decode2d_scalar(keys, x, y, n);
+	else
+		decode2d_sse2(keys, x, y, n);
+}
+
+inline void encode3d(const uint32_t* x, const uint32_t* y, const uint32_t* z, uint64_t* out, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		encode3d_avx512(x, y, z, out, n);
+	else if (mortonCpu().avx2)
+		encode3d_avx2(x, y, z, out, n);
+	else
+		encode3d_scalar(x, y, z, out, n);
+}
+
+inline void decode3d(const uint64_t* keys, uint32_t* x, uint32_t* y, uint32_t* z, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		decode3d_avx512(keys, x, y, z, n);
+	else if (mortonCpu().avx2)
+		decode3d_avx2(keys, x, y, z, n);
+	else if (mortonCodec() == MORTON_CODEC_BMI2)
+		decode3d_scalar(keys, x, y, z, n);
+	else
+		decode3d_sse2(keys, x, y, z, n);
+}
+
+/*
+Tesseral arithmetic on arrays of keys, without decoding them :
+- add2d / add3d : out[i] = keys[i] + offset
+- sub2d / sub3d : out[i] = keys[i] - offset
+- clamp2d / clamp3d : clamps each axis of keys[i] between the ones of lo and hi (min and max of morton2d / morton3d)
+- inc2d / inc3d, dec2d / dec3d : moves all keys one step along an axis (0 is x)
+out may be equal to keys. Axes wrap around on overflow, as with morton2d and morton3d operators.
+
+Kernels are templates on the number of axes, taking the masks of each axis (morton2dAxes or morton3dAxes).
+Ref : http://bitmath.blogspot.fr/2012/11/tesseral-arithmetic-useful-snippets.html
+*/
+static const uint64_t morton2dAxes[2] = { x2_mask, y2_mask };
+static const uint64_t morton3dAxes[3] = { x3_mask, y3_mask, z3_mask };
+
+//Scalar fallback
+template<unsigned int D>
+inline void addKeys_scalar(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint64_t key = 0;
+		for (unsigned int a = 0; a < D; ++a)
+			key |= ((keys[i] | ~axes[a]) + (offset & axes[a])) & axes[a];
+		out[i] = key;
+	}
+}
+
+template<unsigned int D>
+inline void subKeys_scalar(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint64_t key = 0;
+		for (unsigned int a = 0; a < D; ++a)
+			key |= ((keys[i] & axes[a]) - (offset & axes[a])) & axes[a];
+		out[i] = key;
+	}
+}
+
+template<unsigned int D>
+inline void clampKeys_scalar(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t lo, const uint64_t hi, uint64_t* out, const size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint64_t key = 0;
+		for (unsigned int a = 0; a < D; ++a)
+			key |= std::min(std::max(keys[i] & axes[a], lo & axes[a]), hi & axes[a]);
+		out[i] = key;
+	}
+}
+
+//AVX2 kernels. AVX2 has no unsigned 64 bits min / max : flipping the sign bit turns them into signed comparisons
+MORTON_TARGET("avx2") static inline __m256i min_epu64_avx2(const __m256i a, const __m256i b)
+{
+	const __m256i sign = _mm256_set1_epi64x(static_cast<int64_t>(0x8000000000000000));
+	const __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+	return _mm256_blendv_epi8(a, b, gt);
+}
+
+MORTON_TARGET("avx2") static inline __m256i max_epu64_avx2(const __m256i a, const __m256i b)
+{
+	const __m256i sign = _mm256_set1_epi64x(static_cast<int64_t>(0x8000000000000000));
+	const __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+	return _mm256_blendv_epi8(b, a, gt);
+}
+
+template<unsigned int D>
+MORTON_TARGET("avx2") inline void addKeys_avx2(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	__m256i mask[D], others[D], off[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		mask[a] = _mm256_set1_epi64x(static_cast<int64_t>(axes[a]));
+		others[a] = _mm256_set1_epi64x(static_cast<int64_t>(~axes[a]));
+		off[a] = _mm256_set1_epi64x(static_cast<int64_t>(offset & axes[a]));
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		__m256i key = _mm256_setzero_si256();
+		for (unsigned int a = 0; a < D; ++a)
+			key = _mm256_or_si256(key, _mm256_and_si256(_mm256_add_epi64(_mm256_or_si256(k, others[a]), off[a]), mask[a]));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), key);
+	}
+	addKeys_scalar(axes, keys + i, offset, out + i, n - i);
+}
+
+template<unsigned int D>
+MORTON_TARGET("avx2") inline void subKeys_avx2(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	__m256i mask[D], off[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		mask[a] = _mm256_set1_epi64x(static_cast<int64_t>(axes[a]));
+		off[a] = _mm256_set1_epi64x(static_cast<int64_t>(offset & axes[a]));
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		__m256i key = _mm256_setzero_si256();
+		for (unsigned int a = 0; a < D; ++a)
+			key = _mm256_or_si256(key, _mm256_and_si256(_mm256_sub_epi64(_mm256_and_si256(k, mask[a]), off[a]), mask[a]));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), key);
+	}
+	subKeys_scalar(axes, keys + i, offset, out + i, n - i);
+}
+
+template<unsigned int D>
+MORTON_TARGET("avx2") inline void clampKeys_avx2(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t lo, const uint64_t hi, uint64_t* out, const size_t n)
+{
+	__m256i mask[D], low[D], high[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		mask[a] = _mm256_set1_epi64x(static_cast<int64_t>(axes[a]));
+		low[a] = _mm256_set1_epi64x(static_cast<int64_t>(lo & axes[a]));
+		high[a] = _mm256_set1_epi64x(static_cast<int64_t>(hi & axes[a]));
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		__m256i key = _mm256_setzero_si256();
+		for (unsigned int a = 0; a < D; ++a)
+			key = _mm256_or_si256(key, min_epu64_avx2(max_epu64_avx2(_mm256_and_si256(k, mask[a]), low[a]), high[a]));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), key);
+	}
+	clampKeys_scalar(axes, keys + i, lo, hi, out + i, n - i);
+}
+
+//AVX-512 kernels
+template<unsigned int D>
+MORTON_TARGET("avx512f") inline void addKeys_avx512(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	__m512i mask[D], others[D], off[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		mask[a] = _mm512_set1_epi64(static_cast<int64_t>(axes[a]));
+		others[a] = _mm512_set1_epi64(static_cast<int64_t>(~axes[a]));
+		off[a] = _mm512_set1_epi64(static_cast<int64_t>(offset & axes[a]));
+	}
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i k = _mm512_loadu_si512(keys + i);
+		__m512i key = _mm512_setzero_si512();
+		for (unsigned int a = 0; a < D; ++a)
+			key = _mm512_or_si512(key, _mm512_and_si512(_mm512_add_epi64(_mm512_or_si512(k, others[a]), off[a]), mask[a]));
+		_mm512_storeu_si512(out + i, key);
+	}
+	addKeys_scalar(axes, keys + i, offset, out + i, n - i);
+}
+
+template<unsigned int D>
+MORTON_TARGET("avx512f") inline void subKeys_avx512(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	__m512i mask[D], off[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		mask[a] = _mm512_set1_epi64(static_cast<int64_t>(axes[a]));
+		off[a] = _mm512_set1_epi64(static_cast<int64_t>(offset & axes[a]));
+	}
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i k = _mm512_loadu_si512(keys + i);
+		__m512i key = _mm512_setzero_si512();
+		for (unsigned int a = 0; a < D; ++a)
+			key = _mm512_or_si512(key, _mm512_and_si512(_mm512_sub_epi64(_mm512_and_si512(k, mask[a]), off[a]), mask[a]));
+		_mm512_storeu_si512(out + i, key);
+	}
+	subKeys_scalar(axes, keys + i, offset, out + i, n - i);
+}
+
+template<unsigned int D>
+MORTON_TARGET("avx512f") inline void clampKeys_avx512(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t lo, const uint64_t hi, uint64_t* out, const size_t n)
+{
+	__m512i mask[D], low[D], high[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		mask[a] = _mm512_set1_epi64(static_cast<int64_t>(axes[a]));
+		low[a] = _mm512_set1_epi64(static_cast<int64_t>(lo & axes[a]));
+		high[a] = _mm512_set1_epi64(static_cast<int64_t>(hi & axes[a]));
+	}
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i k = _mm512_loadu_si512(keys + i);
+		__m512i key = _mm512_setzero_si512();
+		for (unsigned int a = 0; a < D; ++a)
+			key = _mm512_or_si512(key, _mm512_min_epu64(_mm512_max_epu64(_mm512_and_si512(k, mask[a]), low[a]), high[a]));
+		_mm512_storeu_si512(out + i, key);
+	}
+	clampKeys_scalar(axes, keys + i, lo, hi, out + i, n - i);
+}
+
+//Widest kernel available on the host
+template<unsigned int D>
+inline void addKeys(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		addKeys_avx512(axes, keys, offset, out, n);
+	else if (mortonCpu().avx2)
+		addKeys_avx2(axes, keys, offset, out, n);
+	else
+		addKeys_scalar(axes, keys, offset, out, n);
+}
+
+template<unsigned int D>
+inline void subKeys(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t offset, uint64_t* out, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		subKeys_avx512(axes, keys, offset, out, n);
+	else if (mortonCpu().avx2)
+		subKeys_avx2(axes, keys, offset, out, n);
+	else
+		subKeys_scalar(axes, keys, offset, out, n);
+}
+
+template<unsigned int D>
+inline void clampKeys(const uint64_t (&axes)[D], const uint64_t* keys, const uint64_t lo, const uint64_t hi, uint64_t* out, const size_t n)
+{
+	if (mortonCpu().avx512f)
+		clampKeys_avx512(axes, keys, lo, hi, out, n);
+	else if (mortonCpu().avx2)
+		clampKeys_avx2(axes, keys, lo, hi, out, n);
+	else
+		clampKeys_scalar(axes, keys, lo, hi, out, n);
+}
+
+inline void add2d(const uint64_t* keys, const morton2 offset, uint64_t* out, const size_t n)
+{
+	addKeys(morton2dAxes, keys, offset.key, out, n);
+}
+
+inline void sub2d(const uint64_t* keys, const morton2 offset, uint64_t* out, const size_t n)
+{
+	subKeys(morton2dAxes, keys, offset.key, out, n);
+}
+
+inline void clamp2d(const uint64_t* keys, const morton2 lo, const morton2 hi, uint64_t* out, const size_t n)
+{
+	clampKeys(morton2dAxes, keys, lo.key, hi.key, out, n);
+}
+
+/* Lowest bit of axis 0 (x) is bit 1, the one of axis 1 (y) is bit 0 */
+inline void inc2d(const uint64_t* keys, const unsigned int axis, uint64_t* out, const size_t n)
+{
+	assert(axis < 2);
+	addKeys(morton2dAxes, keys, 2 >> axis, out, n);
+}
+
+inline void dec2d(const uint64_t* keys, const unsigned int axis, uint64_t* out, const size_t n)
+{
+	assert(axis < 2);
+	subKeys(morton2dAxes, keys, 2 >> axis, out, n);
+}
+
+inline void add3d(const uint64_t* keys, const morton3 offset, uint64_t* out, const size_t n)
+{
+	addKeys(morton3dAxes, keys, offset.key, out, n);
+}
+
+inline void sub3d(const uint64_t* keys, const morton3 offset, uint64_t* out, const size_t n)
+{
+	subKeys(morton3dAxes, keys, offset.key, out, n);
+}
+
+inline void clamp3d(const uint64_t* keys, const morton3 lo, const morton3 hi, uint64_t* out, const size_t n)
+{
+	clampKeys(morton3dAxes, keys, lo.key, hi.key, out, n);
+}
+
+inline void inc3d(const uint64_t* keys, const unsigned int axis, uint64_t* out, const size_t n)
+{
+	assert(axis < 3);
+	addKeys(morton3dAxes, keys, 4 >> axis, out, n);
+}
+
+inline void dec3d(const uint64_t* keys, const unsigned int axis, uint64_t* out, const size_t n)
+{
+	assert(axis < 3);
+	subKeys(morton3dAxes, keys, 4 >> axis, out, n);
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_CODEC_H
+#define MORTON_CODEC_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+
+#include "morton_cpu.h"
+
+/*
+Encoding strategies, given as second template parameter of morton2d and morton3d :
+
+  morton3d<uint64_t, morton_lut8> m(x, y, z);
+
+Choosing a strategy at compile time removes the runtime dispatch of the default one (morton_dispatch).
+*/
+struct morton_dispatch {};  // Selected at runtime for the host, see mortonCodec()
+struct morton_bmi2 {};      // pdep / pext instructions. BMI2 hosts only
+struct morton_lut8 {};      // 256 entries look up table, one lookup per byte of each coordinate
+struct morton_lut16 {};     // 65536 entries look up table, built on first use
+struct morton_magicbits {}; // Shifts and masks : no memory access, and usable in constant expressions
+struct morton_lut256 {};    // A single lookup per coordinate. Coordinates must be lower than 256
+
+/*
+Strategy used by morton_dispatch :
+- MORTON_CODEC_BMI2 : same as morton_bmi2
+- MORTON_CODEC_LUT : same as morton_lut8
+- MORTON_CODEC_MAGICBITS : same as morton_magicbits
+*/
+enum morton_codec
+{
+	MORTON_CODEC_BMI2,
+	MORTON_CODEC_LUT,
+	MORTON_CODEC_MAGICBITS
+};
+
+inline const char* mortonCodecName(const morton_codec codec)
+{
+	switch (codec)
+	{
+	case MORTON_CODEC_BMI2: return "bmi2";
+	case MORTON_CODEC_LUT: return "lut";
+	default: return "magicbits";
+	}
+}
+
+/*
+BMI2 when pdep/pext are fast, the look up table otherwise.
+The MORTON_CODEC environment variable ("bmi2", "lut" or "magicbits") overrides this choice.
+BMI2 is never selected on a host which doesn't support it.
+*/
+inline morton_codec mortonSelectCodec(const morton_cpu_features& cpu, const char* env)
+{
+	if (env)
+	{
+		if (strcmp(env, "bmi2") == 0 && cpu.bmi2)
+			return MORTON_CODEC_BMI2;
+		if (strcmp(env, "lut") == 0)
+			return MORTON_CODEC_LUT;
+		if (strcmp(env, "magicbits") == 0)
+			return MORTON_CODEC_MAGICBITS;
+	}
+	return (cpu.bmi2 && !cpu.slowBMI2) ? MORTON_CODEC_BMI2 : MORTON_CODEC_LUT;
+}
+
+/* Codec of the host, selected once on first use. */
+inline morton_codec mortonCodec()
+{
+	static const morton_codec codec = mortonSelectCodec(mortonCpu(), getenv("MORTON_CODEC"));
+	return codec;
+}
+
+/*
+morton2d and morton3d are usable in constant expressions. Encoding and decoding then always use magic bits,
+pdep / pext and look up tables being runtime only.
+MORTON_CONSTEXPR_DISPATCH is defined when the compiler can tell constant evaluation apart : otherwise,
+only keys with the morton_magicbits strategy can be encoded at compile time.
+*/
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define MORTON_CONSTEXPR_DISPATCH
+#endif
+#elif _MSC_VER >= 1925
+#define MORTON_CONSTEXPR_DISPATCH
+#endif
+
+#ifdef MORTON_CONSTEXPR_DISPATCH
+#define MORTON_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#else
+#define MORTON_CONSTANT_EVALUATED() false
+#endif
+
+/*
+Mask of the bits of one axis in a key interleaving dims axes : bits offset, offset + dims, offset + 2 * dims...
+mortonMask<uint64_t>(3, 2) == x3_mask
+*/
+template<class T>
+inline constexpr T mortonMask(const unsigned int dims, const unsigned int offset)
+{
+	T mask = 0;
+	for (unsigned int i = offset; i < 8 * sizeof(T); i += dims)
+		mask |= static_cast<T>(1) << i;
+	return mask;
+}
+
+template<class T>
+inline void mortonWriteKey(std::ostream& os, const T key)
+{
+	os << key;
+}
+
+#ifdef __SIZEOF_INT128__
+/* 128 bits keys (GCC and clang only) */
+typedef unsigned __int128 morton_uint128;
+
+inline void mortonWriteKey(std::ostream& os, morton_uint128 key)
+{
+	char digits[40];
+	int n = 0;
+	do
+	{
+		digits[n++] = static_cast<char>('0' + static_cast<int>(key % 10));
+		key /= 10;
+	} while (key != 0);
+	while (n > 0)
+		os << digits[--n];
+}
+#endif
+
+#endif
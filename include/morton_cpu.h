@@ -0,0 +1,133 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_CPU_H
+#define MORTON_CPU_H
+
+#include <cstdint>
+#include <cstring>
+
+#if _MSC_VER
+#include <intrin.h>
+#endif
+
+#if __GNUC__
+#include <cpuid.h>
+#endif
+
+/*
+SIMD kernels are compiled with a function level target attribute, so that the library can be built
+without -mavx2 / -mavx512f and still use them on hosts which support it.
+MSVC does not need it : all intrinsics are always available.
+*/
+#if __GNUC__
+#define MORTON_TARGET(arch) __attribute__((target(arch)))
+#else
+#define MORTON_TARGET(arch)
+#endif
+
+/*
+Forces inlining of the small steps of template unrolled loops : in large functions, compilers stop inlining them
+and the values they pass around go through memory.
+*/
+#if __GNUC__
+#define MORTON_INLINE inline __attribute__((always_inline))
+#elif _MSC_VER
+#define MORTON_INLINE __forceinline
+#else
+#define MORTON_INLINE inline
+#endif
+
+struct morton_cpu_features
+{
+	bool bmi2;
+	bool avx2;
+	bool avx512f;
+	bool slowBMI2; // pdep / pext are microcoded (AMD Zen1, Zen+ and Zen2)
+};
+
+static inline void mortonCpuid(const uint32_t leaf, const uint32_t subleaf, uint32_t regs[4])
+{
+#if _MSC_VER
+	__cpuidex(reinterpret_cast<int*>(regs), leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/* Extended control register 0 : tells which vector registers are saved by the OS. */
+static inline uint64_t mortonXgetbv()
+{
+#if _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static inline morton_cpu_features mortonDetectCpu()
+{
+	morton_cpu_features features = { false, false, false, false };
+	uint32_t regs[4];
+
+	mortonCpuid(0, 0, regs);
+	const uint32_t maxLeaf = regs[0];
+	char vendor[13];
+	memcpy(vendor, &regs[1], 4);
+	memcpy(vendor + 4, &regs[3], 4);
+	memcpy(vendor + 8, &regs[2], 4);
+	vendor[12] = 0;
+	if (maxLeaf < 7)
+		return features;
+
+	mortonCpuid(1, 0, regs);
+	uint32_t family = (regs[0] >> 8) & 0xf;
+	if (family == 0xf)
+		family += (regs[0] >> 20) & 0xff;
+	//Family 17h is Zen1 to Zen2 (18h is its Hygon clone). pdep/pext run at full speed since Zen3 (19h).
+	features.slowBMI2 = (strcmp(vendor, "AuthenticAMD") == 0 && family == 0x17) ||
+		(strcmp(vendor, "HygonGenuine") == 0 && family == 0x18);
+
+	const bool osxsave = (regs[2] & (1u << 27)) != 0;
+	const bool avx = (regs[2] & (1u << 28)) != 0;
+	const uint64_t xcr0 = osxsave ? mortonXgetbv() : 0;
+	const bool osAvx = avx && (xcr0 & 0x6) == 0x6;         // XMM and YMM state
+	const bool osAvx512 = osAvx && (xcr0 & 0xe0) == 0xe0;  // opmask, ZMM0-15 and ZMM16-31 state
+
+	mortonCpuid(7, 0, regs);
+	features.bmi2 = (regs[1] & (1u << 8)) != 0;
+	features.avx2 = osAvx && (regs[1] & (1u << 5)) != 0;
+	features.avx512f = osAvx512 && (regs[1] & (1u << 16)) != 0;
+	return features;
+}
+
+/* Features of the host, detected once on first use. */
+inline const morton_cpu_features& mortonCpu()
+{
+	static const morton_cpu_features features = mortonDetectCpu();
+	return features;
+}
+
+#endif
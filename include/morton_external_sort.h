@@ -0,0 +1,515 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_EXTERNAL_SORT_H
+#define MORTON_EXTERNAL_SORT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "morton3d.h"
+#include "morton_sort.h"
+#include "morton_file.h"
+
+/*
+Sorts more morton3 keys than fit in memory, each with a payload, into a sorted key file.
+
+  //read fills up to max keys and payloads, and returns how many it gave : 0 at the end of the input
+  auto read = [&](uint64_t* keys, uint32_t* payload, const size_t max) -> size_t { ... q.encode(x, y, z, keys, n); ... };
+  mortonExternalSort<uint32_t>("points.sorted", read, 1ull << 30);   //1 GiB of memory
+
+  morton_sorted_file<uint32_t> sorted;
+  sorted.open("points.sorted");
+  std::lower_bound(sorted.keys(), sorted.keys() + sorted.size(), morton3(x, y, z));
+
+The input is read in chunks sized so that a chunk, the scratch space of mortonSort and the copy of the previous chunk being written
+fit in the memory budget ; each chunk is radix sorted (mortonSort, on all cores) and written to a run file next to the output while
+the next chunk is read and sorted. The runs are then merged with a heap, reading each run
+and writing the output in large blocks, reads and writes being done by one I/O thread while the merge goes on.
+A merge opens at most memory / 16 MiB runs (two blocks of 4 MiB each in half of the budget) : with more runs, groups of them
+are first merged into longer runs, in as many passes as needed.
+The sort is stable : keys which are equal keep the order of the input.
+The output file is a header, the sorted keys (8 bytes each), then the payloads in the same order, both starting on a 4 KiB boundary.
+*/
+
+struct morton_sorted_header
+{
+	char magic[8];        // "MORTONKV"
+	uint32_t version;
+	uint32_t payloadSize; // sizeof(Payload)
+	uint64_t count;
+	uint64_t keys;        // Offset of the keys
+	uint64_t payload;     // Offset of the payloads
+};
+
+static const uint32_t mortonSortedVersion = 1;
+static const size_t mortonExternalBlock = 1 << 22; // Bytes per read or write, at least
+
+template<class Payload>
+struct morton_sort_record
+{
+	uint64_t key;
+	Payload payload;
+};
+
+/*
+One thread doing the reads and writes queued by the caller, in order, while the caller works on other buffers.
+Each job returns false on failure ; wait() then returns false.
+*/
+class morton_io_thread
+{
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::function<bool()>> jobs;
+	uint64_t queued = 0, done = 0;
+	bool ok = true, stop = false;
+	std::thread thread;
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			changed.wait(lock, [this]() { return stop || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			const std::function<bool()> job = std::move(jobs.front());
+			jobs.pop_front();
+			lock.unlock();
+			const bool result = job();
+			lock.lock();
+			ok = ok && result;
+			++done;
+			changed.notify_all();
+		}
+	}
+
+public:
+	morton_io_thread() : thread([this]() { run(); })
+	{
+	}
+
+	morton_io_thread(const morton_io_thread&) = delete;
+	morton_io_thread& operator=(const morton_io_thread&) = delete;
+
+	/* Queues f, and returns the ticket to wait for it */
+	uint64_t start(std::function<bool()> f)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(f));
+		changed.notify_all();
+		return ++queued;
+	}
+
+	/* Waits for the job of ticket and the ones before it */
+	bool wait(const uint64_t ticket)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this, ticket]() { return done >= ticket; });
+		return ok;
+	}
+
+	~morton_io_thread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+			changed.notify_all();
+		}
+		thread.join();
+	}
+};
+
+/* Sequential reader of a run, one block ahead */
+template<class Payload>
+struct morton_run_reader
+{
+	typedef morton_sort_record<Payload> record;
+
+	FILE* file = nullptr;
+	morton_io_thread* io = nullptr;
+	uint64_t ticket = 0;         // Read of next
+	uint64_t left = 0;           // Records in the file not read yet
+	size_t capacity = 0;
+	std::vector<record> current, next;
+	size_t position = 0;
+
+	bool fill(std::vector<record>& block)
+	{
+		const size_t n = static_cast<size_t>(std::min<uint64_t>(capacity, left));
+		block.resize(n);
+		left -= n;
+		return std::fread(block.data(), sizeof(record), n, file) == n;
+	}
+
+	bool open(const std::string& path, const uint64_t count, const size_t blockRecords, morton_io_thread& thread)
+	{
+		file = std::fopen(path.c_str(), "rb");
+		io = &thread;
+		left = count;
+		capacity = blockRecords;
+		if (file == nullptr || !fill(current))
+			return false;
+		ticket = io->start([this]() { return fill(next); });
+		return true;
+	}
+
+	bool empty() const
+	{
+		return position == current.size();
+	}
+
+	/* Moves to the next record, swapping blocks at the end of the current one */
+	bool pop()
+	{
+		if (++position < current.size())
+			return true;
+		if (!io->wait(ticket))
+			return false;
+		std::swap(current, next);
+		position = 0;
+		if (!current.empty())
+			ticket = io->start([this]() { return fill(next); });
+		return true;
+	}
+
+	~morton_run_reader()
+	{
+		if (io != nullptr)
+			io->wait(ticket);
+		if (file != nullptr)
+			std::fclose(file);
+	}
+};
+
+/* Sequential writer, a full block being written by the I/O thread while the next one fills */
+template<class T>
+struct morton_block_writer
+{
+	FILE* file = nullptr;
+	morton_io_thread* io = nullptr;
+	uint64_t ticket = 0;
+	size_t capacity = 0;
+	std::vector<T> current, writing;
+	bool ok = true;
+
+	void open(FILE* f, morton_io_thread& thread, const size_t blockSize)
+	{
+		file = f;
+		io = &thread;
+		capacity = blockSize;
+		current.reserve(capacity);
+		writing.reserve(capacity);
+	}
+
+	void push(const T& v)
+	{
+		current.push_back(v);
+		if (current.size() == capacity)
+			flush();
+	}
+
+	void flush()
+	{
+		ok = io->wait(ticket) && ok;
+		std::swap(current, writing);
+		current.clear();
+		ticket = io->start([this]() { return std::fwrite(writing.data(), sizeof(T), writing.size(), file) == writing.size(); });
+	}
+
+	/* Writes what is left, and returns false if any write failed */
+	bool finish()
+	{
+		flush();
+		return io->wait(ticket) && ok;
+	}
+
+	~morton_block_writer()
+	{
+		if (io != nullptr)
+			io->wait(ticket);
+	}
+};
+
+/*
+Merges the runs [first, last) with a heap, giving each record in order to emit(record).
+The input blocks of the runs share half of memory.
+*/
+template<class Payload, class Emit>
+bool mortonMergeRuns(const std::vector<std::string>& runs, const std::vector<uint64_t>& runSizes, const size_t first, const size_t last,
+	const size_t memory, morton_io_thread& io, const Emit& emit)
+{
+	typedef morton_sort_record<Payload> record;
+	const size_t count = last - first;
+	const size_t inBlock = std::max<size_t>(memory / (4 * count * sizeof(record)), mortonExternalBlock / sizeof(record));
+	std::vector<morton_run_reader<Payload>> readers(count);
+	bool ok = true;
+	for (size_t r = 0; r < count && ok; ++r)
+		ok = readers[r].open(runs[first + r], runSizes[first + r], inBlock, io);
+	if (!ok)
+		return false;
+
+	//Min heap of (key, run) : equal keys come out in the order of the runs
+	typedef std::pair<uint64_t, size_t> entry;
+	std::vector<entry> heap;
+	for (size_t r = 0; r < count; ++r)
+		heap.push_back(entry(readers[r].current[0].key, r));
+	std::make_heap(heap.begin(), heap.end(), std::greater<entry>());
+
+	//The top of the heap is replaced by the next key of its run, and sifted down : one path of the heap per key
+	auto siftDown = [&heap]()
+	{
+		const size_t size = heap.size();
+		const entry top = heap[0];
+		size_t i = 0;
+		for (size_t child = 1; child < size; child = 2 * i + 1)
+		{
+			if (child + 1 < size && heap[child + 1] < heap[child])
+				++child;
+			if (!(heap[child] < top))
+				break;
+			heap[i] = heap[child];
+			i = child;
+		}
+		heap[i] = top;
+	};
+
+	while (!heap.empty() && ok)
+	{
+		morton_run_reader<Payload>& reader = readers[heap[0].second];
+		emit(reader.current[reader.position]);
+		ok = reader.pop();
+		if (reader.empty())
+		{
+			heap[0] = heap.back();
+			heap.pop_back();
+		}
+		else
+			heap[0].first = reader.current[reader.position].key;
+		if (!heap.empty())
+			siftDown();
+	}
+	return ok;
+}
+
+/*
+read(uint64_t* keys, Payload* payload, size_t max) gives the input, see above. memory is the budget in bytes, 0 threads uses all cores.
+Returns false if a file can't be written : the output is then incomplete, run files are removed in all cases.
+*/
+template<class Payload, class Read>
+bool mortonExternalSort(const char* path, const Read& read, const size_t memory, const unsigned int threads = 0)
+{
+	typedef morton_sort_record<Payload> record;
+	const size_t recordBytes = sizeof(uint64_t) + sizeof(Payload);
+	const size_t chunk = std::max<size_t>(memory / (2 * recordBytes + sizeof(record)), 1024); // Keys and payloads, mortonSort scratch, records written
+	morton_io_thread io;
+	std::vector<std::string> files; // Every run file, removed at the end
+
+	//Sorted runs : a chunk is sorted while the previous one is written
+	std::vector<std::string> runs;
+	std::vector<uint64_t> runSizes;
+	std::vector<uint64_t> keys(chunk);
+	std::vector<Payload> payload(chunk);
+	std::vector<record> writing;
+	uint64_t ticket = 0;
+	bool ok = true;
+	uint64_t count = 0;
+	for (;;)
+	{
+		size_t n = 0;
+		while (n < chunk)
+		{
+			const size_t got = read(keys.data() + n, payload.data() + n, chunk - n);
+			if (got == 0)
+				break;
+			n += got;
+		}
+		if (n == 0)
+			break;
+		mortonSort(keys.data(), payload.data(), n, threads);
+
+		ok = io.wait(ticket) && ok;
+		writing.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			writing[i] = { keys[i], payload[i] };
+		runs.push_back(std::string(path) + ".run" + std::to_string(runs.size()));
+		files.push_back(runs.back());
+		runSizes.push_back(n);
+		count += n;
+		const std::string run = runs.back();
+		ticket = io.start([run, &writing]()
+		{
+			FILE* file = std::fopen(run.c_str(), "wb");
+			if (file == nullptr)
+				return false;
+			const bool written = std::fwrite(writing.data(), sizeof(record), writing.size(), file) == writing.size();
+			return std::fclose(file) == 0 && written;
+		});
+		if (n < chunk)
+			break;
+	}
+	ok = io.wait(ticket) && ok;
+	std::vector<uint64_t>().swap(keys);
+	std::vector<Payload>().swap(payload);
+	std::vector<record>().swap(writing);
+
+	//Merge passes while there are more runs than open files and blocks fit in memory : each run holds two blocks in half of it
+	const size_t fanIn = std::max<size_t>(memory / (4 * mortonExternalBlock), 2);
+	const size_t outBlock = std::max<size_t>(memory / (4 * recordBytes), mortonExternalBlock / sizeof(uint64_t));
+	for (size_t pass = 0; ok && runs.size() > fanIn; ++pass)
+	{
+		std::vector<std::string> merged;
+		std::vector<uint64_t> mergedSizes;
+		for (size_t first = 0; first < runs.size() && ok; first += fanIn)
+		{
+			const size_t last = std::min(first + fanIn, runs.size());
+			merged.push_back(std::string(path) + ".pass" + std::to_string(pass) + ".run" + std::to_string(merged.size()));
+			files.push_back(merged.back());
+			mergedSizes.push_back(0);
+			for (size_t r = first; r < last; ++r)
+				mergedSizes.back() += runSizes[r];
+
+			FILE* file = std::fopen(merged.back().c_str(), "wb");
+			ok = file != nullptr;
+			if (ok)
+			{
+				morton_block_writer<record> out;
+				out.open(file, io, std::max<size_t>(outBlock * recordBytes / sizeof(record), 1));
+				ok = mortonMergeRuns<Payload>(runs, runSizes, first, last, memory, io, [&out](const record& r) { out.push(r); });
+				ok = out.finish() && ok;
+				ok = std::fclose(file) == 0 && ok;
+			}
+			for (size_t r = first; r < last; ++r)
+				std::remove(runs[r].c_str());
+		}
+		runs.swap(merged);
+		runSizes.swap(mergedSizes);
+	}
+
+	//Output : header, keys, payloads
+	morton_sorted_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "MORTONKV", 8);
+	header.version = mortonSortedVersion;
+	header.payloadSize = sizeof(Payload);
+	header.count = count;
+	header.keys = mortonFileAlignment;
+	header.payload = (header.keys + count * sizeof(uint64_t) + mortonFileAlignment - 1) & ~(mortonFileAlignment - 1);
+	FILE* keyFile = std::fopen(path, "wb");
+	FILE* payloadFile = keyFile == nullptr ? nullptr : std::fopen(path, "r+b");
+	ok = ok && payloadFile != nullptr;
+	if (ok)
+	{
+		const std::vector<char> padding(static_cast<size_t>(header.keys) - sizeof(header), 0);
+		ok = std::fwrite(&header, sizeof(header), 1, keyFile) == 1 && std::fwrite(padding.data(), 1, padding.size(), keyFile) == padding.size()
+			&& mortonFileSeek(payloadFile, header.payload);
+	}
+
+	//Last merge : output blocks share the other half of the budget
+	if (ok && !runs.empty())
+	{
+		morton_block_writer<uint64_t> outKeys;
+		morton_block_writer<Payload> outPayload;
+		outKeys.open(keyFile, io, outBlock);
+		outPayload.open(payloadFile, io, outBlock);
+		ok = mortonMergeRuns<Payload>(runs, runSizes, 0, runs.size(), memory, io, [&](const record& r)
+		{
+			outKeys.push(r.key);
+			outPayload.push(r.payload);
+		});
+		ok = outKeys.finish() && ok;
+		ok = outPayload.finish() && ok;
+	}
+
+	if (keyFile != nullptr)
+		ok = std::fclose(keyFile) == 0 && ok;
+	if (payloadFile != nullptr)
+		ok = std::fclose(payloadFile) == 0 && ok;
+	for (const std::string& file : files)
+		std::remove(file.c_str());
+	return ok;
+}
+
+/* Output of mortonExternalSort, mapped without copy */
+template<class Payload>
+class morton_sorted_file
+{
+	morton_sorted_header header;
+	morton_file_map file;
+
+public:
+	morton_sorted_file()
+	{
+		std::memset(&header, 0, sizeof(header));
+	}
+
+	/* Returns false if the file can't be read, or doesn't hold payloads of this size */
+	bool open(const char* path)
+	{
+		std::memset(&header, 0, sizeof(header));
+		if (!file.open(path) || file.size() < sizeof(header))
+		{
+			file.close();
+			return false;
+		}
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, "MORTONKV", 8) != 0 || header.version != mortonSortedVersion || header.payloadSize != sizeof(Payload)
+			|| header.keys + header.count * sizeof(uint64_t) > header.payload || file.size() < header.payload + header.count * sizeof(Payload))
+		{
+			std::memset(&header, 0, sizeof(header));
+			file.close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		std::memset(&header, 0, sizeof(header));
+		file.close();
+	}
+
+	size_t size() const { return static_cast<size_t>(header.count); }
+	const morton3* keys() const { return reinterpret_cast<const morton3*>(file.data() + header.keys); }
+	const Payload* payload() const { return reinterpret_cast<const Payload*>(file.data() + header.payload); }
+
+	/* Reads ahead the keys and payloads [first, last) */
+	void willNeed(const size_t first, const size_t last) const
+	{
+		file.willNeed(header.keys + first * sizeof(uint64_t), header.keys + last * sizeof(uint64_t));
+		file.willNeed(header.payload + first * sizeof(Payload), header.payload + last * sizeof(Payload));
+	}
+};
+
+#endif
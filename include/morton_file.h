@@ -0,0 +1,509 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_FILE_H
+#define MORTON_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#if __unix__ || __APPLE__
+#define MORTON_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "morton3d.h"
+
+/*
+Volumes stored in morton order in a file, read through mmap without copy.
+
+The file is a header, then the tiles of 2^tileLevels cells per axis crossing the grid, in morton order of the tiles,
+each tile in morton order : as with a compact grid, the position of a cell is the rank of its tile followed by the low bits of its key.
+Cells of the last tiles which are outside the grid are written as T(). Tiles start at a multiple of 4 KiB, values are little endian.
+
+  mortonFileWrite<float>("volume.morton", nx, ny, nz, [](uint32_t x, uint32_t y, uint32_t z) { return density(x, y, z); });
+
+  morton_file_grid<float> grid;
+  if (grid.open("volume.morton"))
+  {
+    float v = grid.get(x, y, z);
+    v = grid.get(morton3(x, y, z).incX());
+    grid.traverse([](const morton3 m, const float& v) { ... });  //All cells in morton order, reading ahead
+  }
+
+Files larger than memory are paged in by the kernel on demand. traverse() asks for the next bytes (madvise(MADV_WILLNEED))
+while processing the current ones, and willNeed() does the same for any range of keys.
+On systems without mmap, open() reads the whole file.
+*/
+
+enum morton_file_type
+{
+	MORTON_FILE_OTHER,
+	MORTON_FILE_UINT8,
+	MORTON_FILE_INT8,
+	MORTON_FILE_UINT16,
+	MORTON_FILE_INT16,
+	MORTON_FILE_UINT32,
+	MORTON_FILE_INT32,
+	MORTON_FILE_UINT64,
+	MORTON_FILE_INT64,
+	MORTON_FILE_FLOAT,
+	MORTON_FILE_DOUBLE
+};
+
+template<class T> struct morton_file_type_of { static const morton_file_type value = MORTON_FILE_OTHER; };
+template<> struct morton_file_type_of<uint8_t> { static const morton_file_type value = MORTON_FILE_UINT8; };
+template<> struct morton_file_type_of<int8_t> { static const morton_file_type value = MORTON_FILE_INT8; };
+template<> struct morton_file_type_of<uint16_t> { static const morton_file_type value = MORTON_FILE_UINT16; };
+template<> struct morton_file_type_of<int16_t> { static const morton_file_type value = MORTON_FILE_INT16; };
+template<> struct morton_file_type_of<uint32_t> { static const morton_file_type value = MORTON_FILE_UINT32; };
+template<> struct morton_file_type_of<int32_t> { static const morton_file_type value = MORTON_FILE_INT32; };
+template<> struct morton_file_type_of<uint64_t> { static const morton_file_type value = MORTON_FILE_UINT64; };
+template<> struct morton_file_type_of<int64_t> { static const morton_file_type value = MORTON_FILE_INT64; };
+template<> struct morton_file_type_of<float> { static const morton_file_type value = MORTON_FILE_FLOAT; };
+template<> struct morton_file_type_of<double> { static const morton_file_type value = MORTON_FILE_DOUBLE; };
+
+struct morton_file_header
+{
+	char magic[8];         // "MORTON3D"
+	uint32_t version;
+	uint32_t type;         // morton_file_type
+	uint32_t elementSize;  // sizeof(T)
+	uint32_t tileLevels;   // Tiles of 2^tileLevels cells per axis
+	uint32_t extent[3];    // Cells along x, y and z
+	uint32_t reserved;
+	uint64_t tiles;        // Tiles stored
+	uint64_t payload;      // Offset of the first tile
+};
+
+static const uint32_t mortonFileVersion = 1;
+static const uint64_t mortonFileAlignment = 1 << 12;
+
+/* File positions on 64 bits : long, taken by fseek and ftell, is 32 bits on Windows */
+inline bool mortonFileSeek(FILE* file, const uint64_t offset, const int origin = SEEK_SET)
+{
+#if _WIN32
+	return _fseeki64(file, static_cast<__int64>(offset), origin) == 0;
+#else
+	return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+}
+
+/* ~0 on failure */
+inline uint64_t mortonFileTell(FILE* file)
+{
+#if _WIN32
+	const __int64 position = _ftelli64(file);
+#else
+	const off_t position = ftello(file);
+#endif
+	return position < 0 ? ~0ull : static_cast<uint64_t>(position);
+}
+
+static const uint32_t mortonFileMaxExtent = 1u << 21; // Cells per axis held by a 64 bits key
+
+/*
+Tiles crossing the grid, and their rank in the file.
+The key of a tile has bits which are 0 for all the tiles : the levels of an axis above its number of tiles (all of z, for a
+grid of 4096 x 4096 x 1 tiles). Without them, keys make a dense index of the tiles, at most 8 times their number, in the same order :
+rank holds the rank of each index, so that its size follows the tiles stored whatever the shape of the grid.
+Keys and indices are converted one byte at a time with tables, as the LUT encoders do, unless no bit is left out (cubes, among others).
+*/
+struct morton_file_tiles
+{
+	uint64_t count;                 // Tiles crossing the grid
+	uint64_t tiles[3];              // Tiles along each axis
+	unsigned int indexBits;         // Bits of the dense index
+	unsigned int keyBytes, indexBytes;
+	bool dense;                     // The index is the key
+	std::vector<uint64_t> toIndex;  // toIndex[256 * b + v] : bits of the index given by the value v of byte b of a key
+	std::vector<uint64_t> toKey;    // toKey[256 * b + v] : bits of the key given by the value v of byte b of an index
+	std::vector<uint64_t> rank;     // Rank of each index (indices outside the grid get the rank of the next one)
+
+	morton_file_tiles() : count(0), tiles(), indexBits(0), keyBytes(0), indexBytes(0), dense(true)
+	{
+	}
+
+	/* Returns false if the extent can't be encoded, or if the grid has more than maxTiles tiles : the table is then left empty */
+	bool build(const uint32_t (&extent)[3], const uint32_t tileLevels, const uint64_t maxTiles = ~0ull)
+	{
+		*this = morton_file_tiles();
+		if (tileLevels > 10)
+			return false;
+		uint64_t product = 1;
+		unsigned int levels[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			if (extent[a] == 0 || extent[a] > mortonFileMaxExtent)
+				return false;
+			tiles[a] = ((static_cast<uint64_t>(extent[a]) + (1u << tileLevels) - 1) >> tileLevels);
+			product *= tiles[a];
+			levels[a] = 0;
+			while (((tiles[a] - 1) >> levels[a]) != 0)
+				++levels[a];
+		}
+		if (product > maxTiles || levels[0] + levels[1] + levels[2] >= 8 * sizeof(size_t) - 4)
+			return false;
+
+		//Bits of the key used by some tile, in increasing order : the bit j of the index
+		std::vector<unsigned int> used;
+		for (int a = 0; a < 3; ++a)
+			for (unsigned int l = 0; l < levels[a]; ++l)
+			{
+				uint32_t c[3] = { 0, 0, 0 };
+				c[a] = 1u << l;
+				const uint64_t bit = morton3(c[0], c[1], c[2]).key;
+				unsigned int position = 0;
+				while ((bit >> position) != 1)
+					++position;
+				used.push_back(position);
+			}
+		std::sort(used.begin(), used.end());
+		indexBits = static_cast<unsigned int>(used.size());
+		dense = used.empty() || used.back() + 1 == indexBits;
+		keyBytes = used.empty() ? 0 : used.back() / 8 + 1;
+		indexBytes = (indexBits + 7) / 8;
+		toIndex.assign(256 * keyBytes, 0);
+		toKey.assign(256 * indexBytes, 0);
+		for (unsigned int j = 0; j < indexBits; ++j)
+			for (unsigned int v = 0; v < 256; ++v)
+			{
+				if (v >> (used[j] % 8) & 1)
+					toIndex[256 * (used[j] / 8) + v] |= 1ull << j;
+				if (v >> (j % 8) & 1)
+					toKey[256 * (j / 8) + v] |= 1ull << used[j];
+			}
+
+		rank.resize(static_cast<size_t>(1) << indexBits);
+		for (uint64_t i = 0; i < rank.size(); ++i)
+		{
+			uint64_t x, y, z;
+			morton3(key(i)).decode(x, y, z);
+			rank[i] = count;
+			if (x < tiles[0] && y < tiles[1] && z < tiles[2])
+				++count;
+		}
+		return true;
+	}
+
+	/* Dense index of the tile key t, of a tile inside the grid */
+	inline uint64_t index(const uint64_t t) const
+	{
+		if (dense)
+			return t;
+		uint64_t i = 0;
+		for (unsigned int b = 0; b < keyBytes; ++b)
+			i |= toIndex[256 * b + ((t >> (8 * b)) & 0xFF)];
+		return i;
+	}
+
+	/* Tile key of the dense index i */
+	inline uint64_t key(const uint64_t i) const
+	{
+		if (dense)
+			return i;
+		uint64_t t = 0;
+		for (unsigned int b = 0; b < indexBytes; ++b)
+			t |= toKey[256 * b + ((i >> (8 * b)) & 0xFF)];
+		return t;
+	}
+
+	/* Is the dense index i one of the tiles crossing the grid. The last index always is */
+	inline bool stored(const uint64_t i) const
+	{
+		return i + 1 == rank.size() || rank[i + 1] != rank[i];
+	}
+};
+
+/* Writes a grid of nx * ny * nz cells, f(x, y, z) giving the value of each cell. Returns false if the file can't be written */
+template<class T, class F>
+inline bool mortonFileWrite(const char* path, const uint32_t nx, const uint32_t ny, const uint32_t nz, const F& f, const uint32_t tileLevels = 4)
+{
+	morton_file_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "MORTON3D", 8);
+	header.version = mortonFileVersion;
+	header.type = morton_file_type_of<T>::value;
+	header.elementSize = sizeof(T);
+	header.tileLevels = tileLevels;
+	header.extent[0] = nx;
+	header.extent[1] = ny;
+	header.extent[2] = nz;
+	morton_file_tiles tiles;
+	if (!tiles.build(header.extent, tileLevels))
+		return false;
+	header.tiles = tiles.count;
+	header.payload = mortonFileAlignment;
+
+	FILE* file = std::fopen(path, "wb");
+	if (file == nullptr)
+		return false;
+	std::vector<char> padding(mortonFileAlignment - sizeof(header), 0);
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fwrite(padding.data(), 1, padding.size(), file) == padding.size();
+
+	//Tiles crossing the grid, in morton order
+	const uint64_t cells = 1ull << (3 * tileLevels);
+	std::vector<T> tile(cells);
+	for (uint64_t i = 0; ok && i < tiles.rank.size(); ++i)
+	{
+		if (!tiles.stored(i))
+			continue;
+		uint64_t tx, ty, tz;
+		morton3(tiles.key(i)).decode(tx, ty, tz);
+		for (uint64_t c = 0; c < cells; ++c)
+		{
+			uint64_t x, y, z;
+			morton3(c).decode(x, y, z);
+			x |= tx << tileLevels;
+			y |= ty << tileLevels;
+			z |= tz << tileLevels;
+			tile[c] = x < nx && y < ny && z < nz ? f(static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(z)) : T();
+		}
+		ok = std::fwrite(tile.data(), sizeof(T), cells, file) == cells;
+	}
+	return std::fclose(file) == 0 && ok;
+}
+
+/* Read only view of a whole file : mapped, or read in memory on systems without mmap */
+class morton_file_map
+{
+	char* map;
+	size_t bytes;
+	std::vector<char> buffer;
+
+public:
+	morton_file_map() : map(nullptr), bytes(0)
+	{
+	}
+
+	morton_file_map(const morton_file_map&) = delete;
+	morton_file_map& operator=(const morton_file_map&) = delete;
+
+	~morton_file_map()
+	{
+		close();
+	}
+
+	bool open(const char* path)
+	{
+		close();
+		FILE* file = std::fopen(path, "rb");
+		if (file == nullptr)
+			return false;
+		const uint64_t size = mortonFileSeek(file, 0, SEEK_END) ? mortonFileTell(file) : ~0ull;
+		if (size == 0 || size == ~0ull || size > static_cast<uint64_t>(SIZE_MAX))
+		{
+			std::fclose(file);
+			return false;
+		}
+		bytes = static_cast<size_t>(size);
+
+#if MORTON_FILE_MMAP
+		std::fclose(file);
+		const int fd = ::open(path, O_RDONLY);
+		void* p = fd < 0 ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+		if (fd >= 0)
+			::close(fd);
+		if (p == MAP_FAILED)
+		{
+			bytes = 0;
+			return false;
+		}
+		map = static_cast<char*>(p);
+#else
+		buffer.resize(bytes);
+		const bool ok = mortonFileSeek(file, 0) && std::fread(buffer.data(), 1, bytes, file) == bytes;
+		std::fclose(file);
+		if (!ok)
+		{
+			close();
+			return false;
+		}
+		map = buffer.data();
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#if MORTON_FILE_MMAP
+		if (map != nullptr)
+			munmap(map, bytes);
+#endif
+		map = nullptr;
+		bytes = 0;
+		buffer.clear();
+	}
+
+	const char* data() const { return map; }
+	size_t size() const { return bytes; }
+
+	/* Asks the kernel to read the bytes [first, last) */
+	void willNeed(uint64_t first, uint64_t last) const
+	{
+#if MORTON_FILE_MMAP
+		first &= ~(mortonFileAlignment - 1);
+		last = std::min<uint64_t>(last, bytes);
+		if (map != nullptr && first < last)
+			madvise(map + first, static_cast<size_t>(last - first), MADV_WILLNEED);
+#else
+		(void)first;
+		(void)last;
+#endif
+	}
+};
+
+template<class T>
+class morton_file_grid
+{
+	morton_file_header header;
+	morton_file_tiles tiles;      // Rank of each tile
+	unsigned int tileShift;       // Bits of a cell key inside its tile
+	const T* cells;
+	morton_file_map file;
+
+	/* Asks the kernel to read the bytes [first, last) of the cells */
+	void willNeedBytes(const uint64_t first, const uint64_t last) const
+	{
+		file.willNeed(header.payload + first, header.payload + last);
+	}
+
+public:
+	morton_file_grid() : tileShift(0), cells(nullptr)
+	{
+		std::memset(&header, 0, sizeof(header));
+	}
+
+	/* Returns false if the file can't be read, or doesn't hold a grid of T */
+	bool open(const char* path)
+	{
+		close();
+		if (!file.open(path) || file.size() < sizeof(header))
+		{
+			close();
+			return false;
+		}
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, "MORTON3D", 8) != 0 || header.version != mortonFileVersion
+			|| header.type != static_cast<uint32_t>(morton_file_type_of<T>::value) || header.elementSize != sizeof(T) || header.tileLevels > 10
+			|| header.payload > file.size()
+			|| !tiles.build(header.extent, header.tileLevels, (file.size() - header.payload) / (sizeof(T) << (3 * header.tileLevels)))
+			|| tiles.count != header.tiles)
+		{
+			close();
+			return false;
+		}
+		tileShift = 3 * header.tileLevels;
+		cells = reinterpret_cast<const T*>(file.data() + header.payload);
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		std::memset(&header, 0, sizeof(header));
+		tiles = morton_file_tiles();
+		cells = nullptr;
+	}
+
+	bool isOpen() const { return cells != nullptr; }
+	const morton_file_header& info() const { return header; }
+
+	/* Position of a cell of the grid in the file, in cells from the first tile */
+	inline uint64_t index(const morton3 m) const
+	{
+		return (tiles.rank[tiles.index(m.key >> tileShift)] << tileShift) | (m.key & ((1ull << tileShift) - 1));
+	}
+
+	inline const T& get(const morton3 m) const
+	{
+		return cells[index(m)];
+	}
+
+	inline const T& get(const uint32_t x, const uint32_t y, const uint32_t z) const
+	{
+		assert(x < header.extent[0] && y < header.extent[1] && z < header.extent[2]);
+		return cells[index(morton3(x, y, z))];
+	}
+
+	/* Reads ahead the tiles holding the keys first to last, both inside the grid */
+	void willNeed(const morton3 first, const morton3 last) const
+	{
+		const uint64_t tileCells = 1ull << tileShift;
+		willNeedBytes((index(first) & ~(tileCells - 1)) * sizeof(T), ((index(last) | (tileCells - 1)) + 1) * sizeof(T));
+	}
+
+	/* f(m, value) for all cells of the grid in morton order, reading ahead bytes after the current tile (0 : no read ahead) */
+	template<class F>
+	void traverse(const F& f, const uint64_t ahead = 1 << 24) const
+	{
+		const uint64_t tileCells = 1ull << tileShift;
+		const uint64_t tileBytes = tileCells * sizeof(T);
+		const uint64_t end = header.tiles * tileBytes;
+		uint64_t requested = 0;
+		for (uint64_t i = 0; i < tiles.rank.size(); ++i)
+		{
+			if (!tiles.stored(i))
+				continue;
+
+			//Next bytes are asked in steps of half the window, while the kernel reads the other half
+			const uint64_t position = tiles.rank[i] * tileBytes;
+			if (ahead != 0 && position + ahead / 2 >= requested && requested < end)
+			{
+				const uint64_t next = std::min(position + ahead, end);
+				willNeedBytes(std::max(requested, position), next);
+				requested = next;
+			}
+
+			const uint64_t t = tiles.key(i);
+			uint64_t tx, ty, tz;
+			morton3(t).decode(tx, ty, tz);
+			const bool inside = ((tx + 1) << header.tileLevels) <= header.extent[0] && ((ty + 1) << header.tileLevels) <= header.extent[1]
+				&& ((tz + 1) << header.tileLevels) <= header.extent[2];
+			const T* tile = cells + tiles.rank[i] * tileCells;
+			const uint64_t first = t << tileShift;
+			for (uint64_t c = 0; c < tileCells; ++c)
+			{
+				const morton3 m(first | c);
+				if (!inside)
+				{
+					uint64_t x, y, z;
+					m.decode(x, y, z);
+					if (x >= header.extent[0] || y >= header.extent[1] || z >= header.extent[2])
+						continue;
+				}
+				f(m, tile[c]);
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,257 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_HASHGRID_H
+#define MORTON_HASHGRID_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "morton3d.h"
+#include "morton_range.h"
+
+/*
+Sparse voxel grid : only the 8 x 8 x 8 bricks holding at least one voxel are stored.
+A brick is a morton aligned block, so its key is the voxel key shifted by 9 bits, and a voxel is
+a bit of the occupancy mask and a value inside it. Bricks are found with an open addressing hash table (linear probing).
+
+  morton_hashgrid3d<float> grid;
+  grid.set(morton3(x, y, z), 1.f);
+  const float* v = grid.find(morton3(x, y, z));  // nullptr if the voxel is not set
+  v = grid.neighbor(morton3(x, y, z), 0, -1);    // Voxel (x - 1, y, z)
+  grid.erase(morton3(x, y, z));
+
+Neighbor keys wrap around like incX() / decX().
+*/
+template<class T>
+class morton_hashgrid3d
+{
+public:
+	static const unsigned int brickShift = 9;                     // Bits of a voxel key inside its brick
+	static const unsigned int brickVoxels = 1u << brickShift;
+
+	struct brick
+	{
+		uint64_t key;                          // Key of any voxel of the brick >> brickShift
+		uint64_t occupied[brickVoxels / 64];
+		T values[brickVoxels];
+	};
+
+private:
+	static const uint32_t emptySlot = 0xFFFFFFFF;
+
+	struct slot
+	{
+		uint64_t key;
+		uint32_t brick; // Index in bricks, emptySlot if unused
+	};
+
+	std::vector<slot> slots; // Power of 2 size, at most half full
+	std::vector<brick> bricks;
+	unsigned int slotBits;
+	size_t voxels;
+
+	/*
+	Fibonacci hashing : the multiplication carries the low bits, where neighbor bricks differ, up to the highest bits.
+	Ref : https://probablydance.com/2018/06/16/fibonacci-hashing-the-optimization-that-the-world-forgot-or-a-better-alternative-to-integer-modulo/
+	*/
+	inline size_t hash(const uint64_t key) const
+	{
+		return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - slotBits));
+	}
+
+	/* Slot holding key, or the empty slot where it goes */
+	inline size_t probe(const uint64_t key) const
+	{
+		const size_t mask = slots.size() - 1;
+		size_t i = hash(key);
+		while (slots[i].brick != emptySlot && slots[i].key != key)
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	void rehash(const unsigned int bits)
+	{
+		slotBits = bits;
+		slots.assign(static_cast<size_t>(1) << bits, { 0, emptySlot });
+		for (size_t b = 0; b < bricks.size(); ++b)
+			slots[probe(bricks[b].key)] = { bricks[b].key, static_cast<uint32_t>(b) };
+	}
+
+	/* Backward shift deletion : entries after the hole move back, unless the hole is before their hash position */
+	void removeSlot(size_t hole)
+	{
+		const size_t mask = slots.size() - 1;
+		for (size_t j = (hole + 1) & mask; slots[j].brick != emptySlot; j = (j + 1) & mask)
+		{
+			const size_t home = hash(slots[j].key);
+			const bool stays = hole < j ? (home > hole && home <= j) : (home > hole || home <= j);
+			if (!stays)
+			{
+				slots[hole] = slots[j];
+				hole = j;
+			}
+		}
+		slots[hole].brick = emptySlot;
+	}
+
+	inline const brick* findBrick(const uint64_t key) const
+	{
+		const slot& s = slots[probe(key)];
+		return s.brick == emptySlot ? nullptr : &bricks[s.brick];
+	}
+
+public:
+	morton_hashgrid3d() : voxels(0)
+	{
+		rehash(4);
+	}
+
+	/* Number of voxels set */
+	size_t size() const { return voxels; }
+	size_t brickCount() const { return bricks.size(); }
+
+	/* Bytes allocated by the hash table and the bricks */
+	size_t memory() const
+	{
+		return slots.capacity() * sizeof(slot) + bricks.capacity() * sizeof(brick);
+	}
+
+	inline const T* find(const morton3 m) const
+	{
+		const brick* b = findBrick(m.key >> brickShift);
+		const unsigned int v = static_cast<unsigned int>(m.key) & (brickVoxels - 1);
+		return b && ((b->occupied[v >> 6] >> (v & 63)) & 1) ? &b->values[v] : nullptr;
+	}
+
+	inline T* find(const morton3 m)
+	{
+		return const_cast<T*>(static_cast<const morton_hashgrid3d*>(this)->find(m));
+	}
+
+	inline bool contains(const morton3 m) const
+	{
+		return find(m) != nullptr;
+	}
+
+	/* Value of the voxel, or fallback if it is not set */
+	inline T get(const morton3 m, const T& fallback = T()) const
+	{
+		const T* v = find(m);
+		return v ? *v : fallback;
+	}
+
+	void set(const morton3 m, const T& value)
+	{
+		const uint64_t key = m.key >> brickShift;
+		size_t i = probe(key);
+		if (slots[i].brick == emptySlot)
+		{
+			if (2 * (bricks.size() + 1) > slots.size())
+			{
+				rehash(slotBits + 1);
+				i = probe(key);
+			}
+			slots[i] = { key, static_cast<uint32_t>(bricks.size()) };
+			bricks.emplace_back();
+			bricks.back().key = key;
+			std::fill(bricks.back().occupied, bricks.back().occupied + brickVoxels / 64, 0);
+		}
+
+		brick& b = bricks[slots[i].brick];
+		const unsigned int v = static_cast<unsigned int>(m.key) & (brickVoxels - 1);
+		const uint64_t bit = static_cast<uint64_t>(1) << (v & 63);
+		voxels += (b.occupied[v >> 6] & bit) ? 0 : 1;
+		b.occupied[v >> 6] |= bit;
+		b.values[v] = value;
+	}
+
+	/* Returns false if the voxel was not set. Empty bricks are freed. */
+	bool erase(const morton3 m)
+	{
+		const uint64_t key = m.key >> brickShift;
+		const size_t i = probe(key);
+		if (slots[i].brick == emptySlot)
+			return false;
+
+		const uint32_t index = slots[i].brick;
+		brick& b = bricks[index];
+		const unsigned int v = static_cast<unsigned int>(m.key) & (brickVoxels - 1);
+		const uint64_t bit = static_cast<uint64_t>(1) << (v & 63);
+		if (!(b.occupied[v >> 6] & bit))
+			return false;
+		b.occupied[v >> 6] &= ~bit;
+		--voxels;
+
+		for (const uint64_t word : b.occupied)
+		{
+			if (word != 0)
+				return true;
+		}
+
+		//Last brick takes the place of the empty one
+		removeSlot(i);
+		if (index + 1 != bricks.size())
+		{
+			bricks[index] = bricks.back();
+			slots[probe(bricks[index].key)].brick = index;
+		}
+		bricks.pop_back();
+		return true;
+	}
+
+	/* Voxel next to m along axis (0 : x, 1 : y, 2 : z), in the positive (direction > 0) or negative direction */
+	inline const T* neighbor(const morton3 m, const unsigned int axis, const int direction) const
+	{
+		switch (axis)
+		{
+		case 0: return find(direction > 0 ? m.incX() : m.decX());
+		case 1: return find(direction > 0 ? m.incY() : m.decY());
+		default: return find(direction > 0 ? m.incZ() : m.decZ());
+		}
+	}
+
+	/* Calls f(key, value) for each voxel set, brick by brick */
+	template<class F>
+	void forEach(const F& f) const
+	{
+		for (const brick& b : bricks)
+		{
+			for (unsigned int w = 0; w < brickVoxels / 64; ++w)
+			{
+				for (uint64_t bits = b.occupied[w]; bits != 0; bits &= bits - 1)
+				{
+					const unsigned int v = 64 * w + static_cast<unsigned int>(mortonHighestBit<uint64_t>(bits & (~bits + 1)));
+					f(morton3(b.key << brickShift | v), b.values[v]);
+				}
+			}
+		}
+	}
+};
+
+template<class T> const unsigned int morton_hashgrid3d<T>::brickShift;
+template<class T> const unsigned int morton_hashgrid3d<T>::brickVoxels;
+template<class T> const uint32_t morton_hashgrid3d<T>::emptySlot;
+
+#endif
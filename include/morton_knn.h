@@ -0,0 +1,323 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_KNN_H
+#define MORTON_KNN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "morton_range.h"
+#include "morton_sort.h"
+
+/*
+Nearest neighbors in an array of points sorted by morton key (morton2d, morton3d or mortonNd) :
+
+  mortonKnn(points, n, query, k, indices, dist2);          // k nearest points, closest first
+  mortonRadiusSearch(points, n, query, radius, f);          // f(i, dist2) for each point closer than radius
+  mortonKnnBatch(points, n, queries, m, k, indices, dist2); // m queries, multithreaded
+
+A kNN query starts with the 2k points around the lower_bound of the query key, which bound the distance
+of the kth nearest point, and then walks the octree cells of the array closer than this bound, see morton_knn_search.
+A radius search reads the box of the radius, with its corners saturated on each axis, with mortonBoxQuery.
+Distances are squared euclidean distances between integer coordinates.
+Ref : M. Connor, P. Kumar, "Fast construction of k-nearest neighbor graphs for point clouds", 2010
+*/
+template<class Key>
+struct morton_knn_traits
+{
+	typedef morton_range_traits<Key> range_traits;
+	typedef typename range_traits::key_type key_type;
+	static const unsigned int dims = range_traits::dims;
+	typedef mortonNd_traits<dims, key_type> nd_traits;
+	typedef mortonNd_encoder<dims, key_type, morton_dispatch> encoder;
+};
+
+template<class Key>
+inline double mortonDistance2(const uint64_t (&a)[morton_knn_traits<Key>::dims], const Key b)
+{
+	typedef morton_knn_traits<Key> traits;
+	uint64_t c[traits::dims];
+	traits::encoder::decode(b.key, c);
+	double d2 = 0;
+	for (unsigned int i = 0; i < traits::dims; ++i)
+	{
+		const double d = static_cast<double>(a[i]) - static_cast<double>(c[i]);
+		d2 += d * d;
+	}
+	return d2;
+}
+
+/* Corners of the box [q - r, q + r] on each axis, saturated at 0 and at the largest coordinate of the axis */
+template<class Key>
+inline void mortonKnnBox(const Key q, const uint64_t r, Key& lo, Key& hi)
+{
+	typedef morton_knn_traits<Key> traits;
+	typedef typename traits::key_type T;
+	typedef mortonNd_codec<traits::dims, T, morton_magicbits> codec;
+
+	//Radius on each axis, at most the largest coordinate
+	uint64_t axisMax[traits::dims];
+	codec::decode(~static_cast<T>(0), axisMax);
+	typename traits::nd_traits::coord_type radius[traits::dims];
+	for (unsigned int i = 0; i < traits::dims; ++i)
+		radius[i] = static_cast<typename traits::nd_traits::coord_type>(std::min(r, axisMax[i]));
+	const T rKey = codec::encode(radius);
+
+	T l = 0, h = 0;
+	for (unsigned int i = 0; i < traits::dims; ++i)
+	{
+		const T m = traits::nd_traits::masks.axis[i];
+		const T qa = q.key & m, ra = rKey & m;
+		l |= ra > qa ? 0 : (qa - ra) & m;
+		const T sum = ((qa | ~m) + ra) & m;
+		h |= sum < qa ? m : sum;
+	}
+	lo = Key(l);
+	hi = Key(h);
+}
+
+/*
+kNN search with reusable buffers. Candidates first come from the points around the query on the curve
+(or from a hint), then the implicit octree of the sorted array is walked down from the root : the points of a cell
+are a slice of the array, found with a binary search on the keys of its first and last cells.
+Children are visited closest first, and cells farther than the kth candidate are skipped.
+*/
+template<class Key>
+class morton_knn_search
+{
+	typedef morton_knn_traits<Key> traits;
+	typedef typename traits::key_type T;
+	typedef std::pair<double, size_t> candidate; // Squared distance, index
+
+	static const size_t leafPoints = 16; // Cells with fewer points are read without splitting them
+
+	std::vector<candidate> heap; // Max heap of the k best candidates
+	std::vector<size_t> seeds;   // Indices of the first candidates, sorted : they are skipped when their cell is read
+	uint64_t q[traits::dims];
+	size_t k;
+
+	inline void push(const Key* points, const size_t i)
+	{
+		const double d2 = mortonDistance2(q, points[i]);
+		if (heap.size() == k && !(d2 < heap.front().first))
+			return;
+		if (heap.size() == k)
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			heap.pop_back();
+		}
+		heap.push_back({ d2, i });
+		std::push_heap(heap.begin(), heap.end());
+	}
+
+	/* Squared distance from the query to the cell of the given key, 2^levels cells wide on each axis */
+	inline double cellDistance2(const T key, const unsigned int levels) const
+	{
+		uint64_t c[traits::dims];
+		traits::encoder::decode(key, c);
+		double d2 = 0;
+		for (unsigned int i = 0; i < traits::dims; ++i)
+		{
+			const uint64_t last = c[i] + ((static_cast<uint64_t>(1) << levels) - 1);
+			const double d = q[i] < c[i] ? static_cast<double>(c[i] - q[i]) : q[i] > last ? static_cast<double>(q[i] - last) : 0.;
+			d2 += d * d;
+		}
+		return d2;
+	}
+
+	/* Points [first, last) are the cell of keys [cell, cell + 2^shift - 1] */
+	void descend(const Key* points, const size_t first, const size_t last, const T cell, const unsigned int shift)
+	{
+		const unsigned int D = traits::dims, width = 8 * sizeof(T);
+		if (last - first <= leafPoints || shift == 0)
+		{
+			std::vector<size_t>::const_iterator seed = std::lower_bound(seeds.cbegin(), seeds.cend(), first);
+			for (size_t i = first; i < last; ++i)
+			{
+				if (seed != seeds.cend() && *seed == i)
+					++seed;
+				else
+					push(points, i);
+			}
+			return;
+		}
+
+		//Children closest first. Their points are only searched for when they are visited
+		struct child
+		{
+			double d2;
+			T key;
+		};
+		child children[1 << D];
+		unsigned int count = 0;
+		const unsigned int childShift = shift - D;
+		for (unsigned int c = 0; c < (1u << D); ++c)
+		{
+			//Highest cells of keys whose width isn't a multiple of D : some axes have no bit there
+			if (childShift + D > width && (c >> (width - childShift)) != 0)
+				break;
+			const T key = cell | static_cast<T>(c) << childShift;
+			children[count] = { cellDistance2(key, childShift / D), key };
+			for (child* it = children + count; it != children && it->d2 < (it - 1)->d2; --it)
+				std::swap(*it, *(it - 1));
+			++count;
+		}
+
+		for (unsigned int c = 0; c < count; ++c)
+		{
+			if (heap.size() == k && !(children[c].d2 < heap.front().first))
+				break;
+			const T key = children[c].key, keyLast = key | mortonLowMask<T>(childShift);
+			const Key* begin = std::lower_bound(points + first, points + last, key, [](const Key& p, const T v) { return p.key < v; });
+			const Key* end = std::upper_bound(begin, points + last, keyLast, [](const T v, const Key& p) { return v < p.key; });
+			if (end > begin)
+				descend(points, static_cast<size_t>(begin - points), static_cast<size_t>(end - points), key, childShift);
+		}
+	}
+
+public:
+	/*
+	k nearest points of query, closest first : indices[i] and dist2[i] (optional).
+	hint, if not null, holds the indices of min(k, n) points, for instance the result of a nearby query :
+	they replace the points around the query as first candidates.
+	Returns min(k, n).
+	*/
+	size_t query(const Key* points, const size_t n, const Key query, const size_t count, size_t* indices, double* dist2 = nullptr,
+		const size_t* hint = nullptr)
+	{
+		k = std::min(count, n);
+		if (k == 0)
+			return 0;
+		traits::encoder::decode(query.key, q);
+		heap.clear();
+		seeds.clear();
+
+		if (hint)
+		{
+			seeds.assign(hint, hint + k);
+			std::sort(seeds.begin(), seeds.end());
+			seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+		}
+		else
+		{
+			//Window of 2k points around the query on the curve
+			const size_t pos = std::lower_bound(points, points + n, query, [](const Key& a, const Key& b) { return a.key < b.key; }) - points;
+			const size_t last = std::min(n, std::max(pos, k) + k);
+			for (size_t i = last > 2 * k ? last - 2 * k : 0; i < last; ++i)
+				seeds.push_back(i);
+		}
+		for (const size_t i : seeds)
+			push(points, i);
+
+		descend(points, 0, n, 0, traits::dims * traits::nd_traits::levels);
+
+		std::sort_heap(heap.begin(), heap.end());
+		for (size_t i = 0; i < heap.size(); ++i)
+		{
+			indices[i] = heap[i].second;
+			if (dist2)
+				dist2[i] = heap[i].first;
+		}
+		return heap.size();
+	}
+};
+
+template<class Key> const size_t morton_knn_search<Key>::leafPoints;
+
+template<class Key>
+inline size_t mortonKnn(const Key* points, const size_t n, const Key query, const size_t k, size_t* indices, double* dist2 = nullptr)
+{
+	morton_knn_search<Key> search;
+	return search.query(points, n, query, k, indices, dist2);
+}
+
+/* Calls f(i, dist2) for each point closer than radius (included), in the order of the curve. Returns their number. */
+template<class Key, class F>
+size_t mortonRadiusSearch(const Key* points, const size_t n, const Key query, const double radius, const F& f)
+{
+	typedef morton_knn_traits<Key> traits;
+	uint64_t q[traits::dims];
+	traits::encoder::decode(query.key, q);
+
+	//Radius clamped to the largest coordinate in double, before the cast : a NaN radius finds no point
+	if (!(radius >= 0))
+		return 0;
+	uint64_t axisMax[traits::dims];
+	mortonNd_codec<traits::dims, typename traits::key_type, morton_magicbits>::decode(~static_cast<typename traits::key_type>(0), axisMax);
+	const uint64_t largest = *std::max_element(axisMax, axisMax + traits::dims);
+	const uint64_t r = std::floor(radius) >= static_cast<double>(largest) ? largest : static_cast<uint64_t>(std::floor(radius));
+
+	Key lo, hi;
+	mortonKnnBox(query, r, lo, hi);
+	size_t count = 0;
+	mortonBoxQuery(points, n, lo, hi, [&](const size_t i)
+	{
+		const double d2 = mortonDistance2(q, points[i]);
+		if (d2 <= radius * radius)
+		{
+			f(i, d2);
+			++count;
+		}
+	});
+	return count;
+}
+
+/*
+k nearest points of m queries : indices[j * k + i] and dist2[j * k + i] for query j.
+Queries are sorted along the curve, and the result of each query bounds the search of the next one.
+Returns min(k, n) : the number of results of each query, the others are left untouched.
+*/
+template<class Key>
+size_t mortonKnnBatch(const Key* points, const size_t n, const Key* queries, const size_t m, const size_t k,
+	size_t* indices, double* dist2 = nullptr, unsigned int threads = 0)
+{
+	const size_t results = std::min(k, n);
+	if (results == 0 || m == 0)
+		return results;
+
+	std::vector<size_t> order(m);
+	mortonSortPermutation(queries, order.data(), m, threads);
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threads, m / 64)));
+	mortonParallelFor(threads, [&](const unsigned int t)
+	{
+		morton_knn_search<Key> search;
+		const size_t* hint = nullptr;
+		for (size_t j = m * t / threads; j < m * (t + 1) / threads; ++j)
+		{
+			const size_t q = order[j];
+			search.query(points, n, queries[q], k, indices + q * k, dist2 ? dist2 + q * k : nullptr, hint);
+			hint = indices + q * k;
+		}
+	});
+	return results;
+}
+
+#endif
@@ -0,0 +1,249 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_LBVH_H
+#define MORTON_LBVH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <vector>
+
+#include "morton_quantizer.h"
+#include "morton_range.h"
+#include "morton_sort.h"
+
+/*
+Linear BVH, built in parallel from the morton keys of the centroids of the primitives :
+
+  morton_lbvh bvh;
+  bvh.build(boxes, n);    // Each frame : the buffers of the previous build are reused
+  bvh.nodes[0]            // Root
+  bvh.overlap(box, [](uint32_t primitive) {});
+
+Centroids are quantized on 21 bits per axis inside their bounding box, and sorted with mortonSort.
+Node i < n - 1 is the internal node of Karras, split where the highest differing bit of the sorted keys changes :
+all internal nodes are built independently. Node n - 1 + i is the leaf of the ith primitive along the curve.
+Bounds are then merged from the leaves up, the second child to reach a node merging it.
+Ref : T. Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees", 2012
+*/
+struct morton_aabb
+{
+	float lo[3];
+	float hi[3];
+};
+
+struct morton_bvh_node
+{
+	morton_aabb bounds;
+	uint32_t left;  // Left child, or primitive index of a leaf
+	uint32_t right; // Right child, or mortonBvhLeaf
+};
+
+static const uint32_t mortonBvhLeaf = 0xFFFFFFFF;
+
+inline morton_aabb mortonMerge(const morton_aabb& a, const morton_aabb& b)
+{
+	morton_aabb m;
+	for (int i = 0; i < 3; ++i)
+	{
+		m.lo[i] = std::min(a.lo[i], b.lo[i]);
+		m.hi[i] = std::max(a.hi[i], b.hi[i]);
+	}
+	return m;
+}
+
+inline bool mortonOverlap(const morton_aabb& a, const morton_aabb& b)
+{
+	return a.lo[0] <= b.hi[0] && b.lo[0] <= a.hi[0] && a.lo[1] <= b.hi[1] && b.lo[1] <= a.hi[1] && a.lo[2] <= b.hi[2] && b.lo[2] <= a.hi[2];
+}
+
+class morton_lbvh
+{
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;        // Primitive of each leaf
+	std::vector<uint32_t> parents;      // Of each node
+	std::vector<std::atomic<uint32_t>> visits;
+	std::vector<float> centroids;
+
+	/* Length of the common prefix of sorted keys i and j, -1 outside of the array. Equal keys are told apart by their index. */
+	inline int delta(const int64_t i, const int64_t j) const
+	{
+		if (j < 0 || j >= static_cast<int64_t>(keys.size()))
+			return -1;
+		const uint64_t diff = keys[i] ^ keys[j];
+		if (diff != 0)
+			return 63 - mortonHighestBit<uint64_t>(diff);
+		return 64 + 63 - mortonHighestBit<uint64_t>(static_cast<uint64_t>(i ^ j));
+	}
+
+	/* Range of leaves covered by internal node i, and its split */
+	void buildInternal(const int64_t i)
+	{
+		const int64_t n = static_cast<int64_t>(keys.size());
+		const int64_t d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+
+		//Other end of the range : exponential, then binary search
+		const int deltaMin = delta(i, i - d);
+		int64_t lmax = 2;
+		while (delta(i, i + lmax * d) > deltaMin)
+			lmax *= 2;
+		int64_t l = 0;
+		for (int64_t t = lmax / 2; t >= 1; t /= 2)
+		{
+			if (delta(i, i + (l + t) * d) > deltaMin)
+				l += t;
+		}
+		const int64_t j = i + l * d;
+
+		//Split : last leaf sharing more than deltaNode bits with i
+		const int deltaNode = delta(i, j);
+		int64_t s = 0;
+		for (int64_t t = (l + 1) / 2; ; t = (t + 1) / 2)
+		{
+			if (delta(i, i + (s + t) * d) > deltaNode)
+				s += t;
+			if (t == 1)
+				break;
+		}
+		const int64_t split = i + s * d + std::min<int64_t>(d, 0);
+
+		morton_bvh_node& node = nodes[i];
+		node.left = static_cast<uint32_t>(std::min(i, j) == split ? n - 1 + split : split);
+		node.right = static_cast<uint32_t>(std::max(i, j) == split + 1 ? n + split : split + 1);
+		parents[node.left] = static_cast<uint32_t>(i);
+		parents[node.right] = static_cast<uint32_t>(i);
+	}
+
+public:
+	std::vector<morton_bvh_node> nodes; // 2n - 1 nodes, the root first
+
+	void build(const morton_aabb* boxes, const size_t n, unsigned int threads = 0)
+	{
+		assert(n < mortonBvhLeaf);
+		nodes.resize(n == 0 ? 0 : 2 * n - 1);
+		if (n == 0)
+			return;
+		threads = mortonSortThreads(threads, n);
+		keys.resize(n);
+		order.resize(n);
+		parents.resize(2 * n - 1);
+		centroids.resize(3 * n);
+
+		//Centroids, and their bounds
+		std::vector<morton_aabb> threadBounds(threads);
+		mortonParallelFor(threads, [&](const unsigned int t)
+		{
+			morton_aabb b = { { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() },
+				{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() } };
+			for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+			{
+				for (int a = 0; a < 3; ++a)
+				{
+					const float c = 0.5f * (boxes[i].lo[a] + boxes[i].hi[a]);
+					centroids[a * n + i] = c;
+					b.lo[a] = std::min(b.lo[a], c);
+					b.hi[a] = std::max(b.hi[a], c);
+				}
+			}
+			threadBounds[t] = b;
+		});
+		morton_aabb bounds = threadBounds[0];
+		for (const morton_aabb& b : threadBounds)
+			bounds = mortonMerge(bounds, b);
+
+		//Keys, sorted along with the primitives
+		const morton3d_quantizer<float> quantizer(bounds.lo, bounds.hi, 21);
+		mortonParallelFor(threads, [&](const unsigned int t)
+		{
+			const size_t first = n * t / threads, last = n * (t + 1) / threads;
+			quantizer.encode(&centroids[first], &centroids[n + first], &centroids[2 * n + first], &keys[first], last - first);
+			for (size_t i = first; i < last; ++i)
+				order[i] = static_cast<uint32_t>(i);
+		});
+		mortonSort(keys.data(), order.data(), n, threads);
+
+		//Leaves and internal nodes
+		mortonParallelFor(threads, [&](const unsigned int t)
+		{
+			for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+			{
+				morton_bvh_node& leaf = nodes[n - 1 + i];
+				leaf.bounds = boxes[order[i]];
+				leaf.left = order[i];
+				leaf.right = mortonBvhLeaf;
+				if (i + 1 < n)
+					buildInternal(static_cast<int64_t>(i));
+			}
+		});
+
+		//Bounds, from the leaves up
+		if (visits.size() < n)
+			std::vector<std::atomic<uint32_t>>(n).swap(visits);
+		for (size_t i = 0; i + 1 < n; ++i)
+			visits[i].store(0, std::memory_order_relaxed);
+		mortonParallelFor(threads, [&](const unsigned int t)
+		{
+			for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+			{
+				size_t node = n - 1 + i;
+				while (node != 0)
+				{
+					node = parents[node];
+					//The first child to arrive leaves, the second one merges the bounds of both
+					if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0)
+						break;
+					nodes[node].bounds = mortonMerge(nodes[nodes[node].left].bounds, nodes[nodes[node].right].bounds);
+				}
+			}
+		});
+	}
+
+	/* Calls f(primitive) for each primitive whose box overlaps box */
+	template<class F>
+	void overlap(const morton_aabb& box, const F& f) const
+	{
+		if (nodes.empty())
+			return;
+		uint32_t stack[128];
+		int size = 0;
+		stack[size++] = 0;
+		while (size > 0)
+		{
+			const morton_bvh_node& node = nodes[stack[--size]];
+			if (!mortonOverlap(node.bounds, box))
+				continue;
+			if (node.right == mortonBvhLeaf)
+			{
+				f(node.left);
+				continue;
+			}
+			stack[size++] = node.right;
+			stack[size++] = node.left;
+		}
+	}
+};
+
+#endif
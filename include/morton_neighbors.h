@@ -0,0 +1,427 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_NEIGHBORS_H
+#define MORTON_NEIGHBORS_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "morton_batch.h"
+#include "morton_range.h"
+
+/*
+Keys of the neighbors of a cell, without decoding it. N is the size of the neighborhood :
+- 2d : 4 (sharing an edge) or 8 (sharing at least a corner)
+- 3d : 6 (sharing a face), 18 (a face or an edge) or 26 (at least a vertex)
+
+  morton3 out[26];
+  unsigned int n = mortonNeighbors<26>(morton3(x, y, z), morton3(63, 63, 63), out, MORTON_BOUNDARY_SKIP);
+  mortonForEachNeighbor<6>(morton3(x, y, z), morton3(63, 63, 63), MORTON_BOUNDARY_CLAMP, [&](morton3 n) { sum += grid[n.key]; });
+  neighbors3d<6>(keys, morton3(63, 63, 63), MORTON_BOUNDARY_PERIODIC, out, n); // out[j * n + i] : neighbor j of keys[i]
+
+The grid holds the cells from 0 to max (included) on each axis, and the keys given must be inside it.
+Each axis of the key is computed once below, at and above the cell, with tesseral increments : a neighbor
+is then only the "or" of one part per axis. Neighbors are in the order of mortonNeighborhood<D, N>.offset :
+the last axis changes first, like x, y, z loops from -1 to 1.
+Ref : http://bitmath.blogspot.fr/2012/11/tesseral-arithmetic-useful-snippets.html
+*/
+enum morton_boundary
+{
+	MORTON_BOUNDARY_CLAMP,   // Coordinates are clamped to the grid : every neighbor is written, some of them more than once
+	MORTON_BOUNDARY_SKIP,    // Neighbors outside the grid are left out
+	MORTON_BOUNDARY_PERIODIC // Coordinates wrap around : -1 is max, max + 1 is 0
+};
+
+/* Offsets of the N neighbors of a cell in D dimensions, built at compile time */
+template<unsigned int D, unsigned int N>
+struct morton_neighborhood
+{
+	static_assert((D == 2 && (N == 4 || N == 8)) || (D == 3 && (N == 6 || N == 18 || N == 26)), "Neighborhoods are 4 or 8 cells in 2d, 6, 18 or 26 cells in 3d");
+
+	int offset[N][D];         // -1, 0 or 1 on each axis
+	uint32_t low[D], high[D]; // Neighbors below (above) the cell on each axis, one bit per neighbor
+
+	constexpr morton_neighborhood() : offset(), low(), high()
+	{
+		//Number of axes on which a neighbor may differ from the cell
+		const unsigned int axes = N == 2 * D ? 1 : (N == 18 ? 2 : D);
+		unsigned int cells = 1;
+		for (unsigned int a = 0; a < D; ++a)
+			cells *= 3;
+
+		unsigned int j = 0;
+		for (unsigned int c = 0; c < cells; ++c)
+		{
+			int o[D] = {};
+			unsigned int moved = 0;
+			for (unsigned int a = D, v = c; a-- > 0; v /= 3)
+			{
+				o[a] = static_cast<int>(v % 3) - 1;
+				moved += o[a] != 0;
+			}
+			if (moved == 0 || moved > axes)
+				continue;
+
+			for (unsigned int a = 0; a < D; ++a)
+			{
+				offset[j][a] = o[a];
+				low[a] |= o[a] < 0 ? 1u << j : 0;
+				high[a] |= o[a] > 0 ? 1u << j : 0;
+			}
+			++j;
+		}
+	}
+};
+
+template<unsigned int D, unsigned int N>
+constexpr morton_neighborhood<D, N> mortonNeighborhood = morton_neighborhood<D, N>();
+
+/*
+Axes A to D - 1 of key below, at and above the cell (part[a][0], part[a][1] and part[a][2]), after the boundary rule.
+Returns the neighbors to leave out with MORTON_BOUNDARY_SKIP, one bit per neighbor.
+Templates unroll the axes, so that part stays in registers.
+*/
+template<unsigned int D, unsigned int N, unsigned int A>
+struct morton_neighbor_parts
+{
+	template<class T>
+	static MORTON_INLINE uint32_t get(const T key, const T max, const morton_boundary boundary, T (&part)[D][3])
+	{
+		const T mask = mortonNd_traits<D, T>::masks.axis[A];
+		const T one = static_cast<T>(1) << (D - 1 - A);
+		const T p = key & mask, top = max & mask;
+		const bool low = p == 0, high = p >= top;
+
+		uint32_t skip = 0;
+		part[A][0] = (p - one) & mask;
+		part[A][1] = p;
+		part[A][2] = ((p | ~mask) + one) & mask;
+		switch (boundary)
+		{
+		case MORTON_BOUNDARY_CLAMP:
+			part[A][0] = low ? p : part[A][0];
+			part[A][2] = high ? p : part[A][2];
+			break;
+		case MORTON_BOUNDARY_PERIODIC:
+			part[A][0] = low ? top : part[A][0];
+			part[A][2] = high ? 0 : part[A][2];
+			break;
+		default:
+			skip = (low ? mortonNeighborhood<D, N>.low[A] : 0) | (high ? mortonNeighborhood<D, N>.high[A] : 0);
+		}
+		return skip | morton_neighbor_parts<D, N, A + 1>::get(key, max, boundary, part);
+	}
+
+	/* Neighbor J : the "or" of its part on the axes A to D - 1 */
+	template<unsigned int J, class T>
+	static MORTON_INLINE T key(const T (&part)[D][3])
+	{
+		return part[A][mortonNeighborhood<D, N>.offset[J][A] + 1] | morton_neighbor_parts<D, N, A + 1>::template key<J>(part);
+	}
+};
+
+template<unsigned int D, unsigned int N>
+struct morton_neighbor_parts<D, N, D>
+{
+	template<class T>
+	static MORTON_INLINE uint32_t get(const T, const T, const morton_boundary, T (&)[D][3])
+	{
+		return 0;
+	}
+
+	template<unsigned int J, class T>
+	static MORTON_INLINE T key(const T (&)[D][3])
+	{
+		return 0;
+	}
+};
+
+template<unsigned int D, unsigned int N, class T>
+MORTON_INLINE uint32_t mortonNeighborParts(const T key, const T max, const morton_boundary boundary, T (&part)[D][3])
+{
+	return morton_neighbor_parts<D, N, 0>::get(key, max, boundary, part);
+}
+
+/*
+Writes the neighbors J to N - 1 from the parts of each axis, leaving out the ones of skip.
+Each neighbor is written, and the next one overwrites it if it is skipped : no branch.
+Templates unroll the neighbors, so that their offsets are constants : a loop reading them from the table is about 1.5 times slower.
+*/
+template<unsigned int D, unsigned int N, unsigned int J>
+struct morton_neighbor_keys
+{
+	template<class T, class Key>
+	static MORTON_INLINE unsigned int write(const T (&part)[D][3], const uint32_t skip, Key* out, unsigned int count)
+	{
+		out[count] = Key(morton_neighbor_parts<D, N, 0>::template key<J>(part));
+		count += (skip >> J & 1) ^ 1;
+		return morton_neighbor_keys<D, N, J + 1>::write(part, skip, out, count);
+	}
+};
+
+template<unsigned int D, unsigned int N>
+struct morton_neighbor_keys<D, N, N>
+{
+	template<class T, class Key>
+	static MORTON_INLINE unsigned int write(const T (&)[D][3], const uint32_t, Key*, const unsigned int count)
+	{
+		return count;
+	}
+};
+
+/* Writes the neighbors of m in out (N keys at most), and returns their number */
+template<unsigned int N, class Key>
+MORTON_INLINE unsigned int mortonNeighbors(const Key m, const Key max, Key* out, const morton_boundary boundary)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	const unsigned int D = traits::dims;
+
+	T part[D][3];
+	const uint32_t skip = mortonNeighborParts<D, N>(m.key, max.key, boundary, part);
+	return morton_neighbor_keys<D, N, 0>::write(part, skip, out, 0);
+}
+
+/*
+Calls f with the neighbors J to N - 1, leaving out the ones of skip.
+The call is inlined at each neighbor, with a branch on its skip bit : the keys are never stored, like the hand written
+loops of the benchmarks, which it matches. mortonNeighbors followed by a loop on out is about 1.4 times slower.
+*/
+template<unsigned int D, unsigned int N, unsigned int J>
+struct morton_neighbor_visit
+{
+	template<class Key, class T, class F>
+	static MORTON_INLINE void call(const T (&part)[D][3], const uint32_t skip, F& f)
+	{
+		if (!(skip >> J & 1))
+			f(Key(morton_neighbor_parts<D, N, 0>::template key<J>(part)));
+		morton_neighbor_visit<D, N, J + 1>::template call<Key>(part, skip, f);
+	}
+};
+
+template<unsigned int D, unsigned int N>
+struct morton_neighbor_visit<D, N, N>
+{
+	template<class Key, class T, class F>
+	static MORTON_INLINE void call(const T (&)[D][3], const uint32_t, F&)
+	{
+	}
+};
+
+/* Calls f(key) for each neighbor of m, in the same order as mortonNeighbors */
+template<unsigned int N, class Key, class F>
+MORTON_INLINE void mortonForEachNeighbor(const Key m, const Key max, const morton_boundary boundary, F f)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	const unsigned int D = traits::dims;
+
+	T part[D][3];
+	const uint32_t skip = mortonNeighborParts<D, N>(m.key, max.key, boundary, part);
+	morton_neighbor_visit<D, N, 0>::template call<Key>(part, skip, f);
+}
+
+/*
+Neighbors of arrays of keys : out[j * stride + i] is neighbor j of keys[i].
+With MORTON_BOUNDARY_SKIP, neighbors outside the grid are replaced by the key itself.
+valid (may be nullptr) receives one bit per neighbor written from the grid for each key.
+*/
+template<unsigned int D, unsigned int N>
+inline void neighborKeys_scalar(const uint64_t* keys, const uint64_t max, const morton_boundary boundary, uint64_t* out, const size_t stride, const size_t n, uint32_t* valid)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint64_t part[D][3], key[N];
+		const uint32_t skip = mortonNeighborParts<D, N>(keys[i], max, boundary, part);
+		morton_neighbor_keys<D, N, 0>::write(part, 0, key, 0);
+		for (unsigned int j = 0; j < N; ++j)
+			out[j * stride + i] = (skip & (1u << j)) ? keys[i] : key[j];
+		if (valid)
+			valid[i] = ~skip & ((1u << N) - 1);
+	}
+}
+
+template<unsigned int D, unsigned int N>
+MORTON_TARGET("avx2") inline void neighborKeys_avx2(const uint64_t* keys, const uint64_t max, const morton_boundary boundary, uint64_t* out, const size_t stride, const size_t n, uint32_t* valid)
+{
+	const morton_neighborhood<D, N>& table = mortonNeighborhood<D, N>;
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i mask[D], others[D], one[D], top[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		const uint64_t axis = mortonNd_traits<D, uint64_t>::masks.axis[a];
+		mask[a] = _mm256_set1_epi64x(static_cast<int64_t>(axis));
+		others[a] = _mm256_set1_epi64x(static_cast<int64_t>(~axis));
+		one[a] = _mm256_set1_epi64x(static_cast<int64_t>(1) << (D - 1 - a));
+		top[a] = _mm256_set1_epi64x(static_cast<int64_t>(max & axis));
+	}
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		const __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+		__m256i part[D][3], low[D], high[D];
+		for (unsigned int a = 0; a < D; ++a)
+		{
+			const __m256i p = _mm256_and_si256(k, mask[a]);
+			low[a] = _mm256_cmpeq_epi64(p, zero);
+			high[a] = _mm256_cmpeq_epi64(p, top[a]);
+			part[a][0] = _mm256_and_si256(_mm256_sub_epi64(p, one[a]), mask[a]);
+			part[a][1] = p;
+			part[a][2] = _mm256_and_si256(_mm256_add_epi64(_mm256_or_si256(p, others[a]), one[a]), mask[a]);
+			if (boundary == MORTON_BOUNDARY_CLAMP)
+			{
+				part[a][0] = _mm256_blendv_epi8(part[a][0], p, low[a]);
+				part[a][2] = _mm256_blendv_epi8(part[a][2], p, high[a]);
+			}
+			else if (boundary == MORTON_BOUNDARY_PERIODIC)
+			{
+				part[a][0] = _mm256_blendv_epi8(part[a][0], top[a], low[a]);
+				part[a][2] = _mm256_andnot_si256(high[a], part[a][2]);
+			}
+		}
+
+		uint32_t lanes[4] = { (1u << N) - 1, (1u << N) - 1, (1u << N) - 1, (1u << N) - 1 };
+		for (unsigned int j = 0; j < N; ++j)
+		{
+			__m256i key = zero, outside = zero;
+			for (unsigned int a = 0; a < D; ++a)
+			{
+				const int o = table.offset[j][a];
+				key = _mm256_or_si256(key, part[a][o + 1]);
+				if (o != 0)
+					outside = _mm256_or_si256(outside, o < 0 ? low[a] : high[a]);
+			}
+			if (boundary == MORTON_BOUNDARY_SKIP)
+			{
+				key = _mm256_blendv_epi8(key, k, outside);
+				const int bits = _mm256_movemask_pd(_mm256_castsi256_pd(outside));
+				for (unsigned int l = 0; l < 4; ++l)
+					lanes[l] &= ~(static_cast<uint32_t>((bits >> l) & 1) << j);
+			}
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j * stride + i), key);
+		}
+		if (valid)
+			for (unsigned int l = 0; l < 4; ++l)
+				valid[i + l] = lanes[l];
+	}
+	neighborKeys_scalar<D, N>(keys + i, max, boundary, out + i, stride, n - i, valid ? valid + i : nullptr);
+}
+
+template<unsigned int D, unsigned int N>
+MORTON_TARGET("avx512f") inline void neighborKeys_avx512(const uint64_t* keys, const uint64_t max, const morton_boundary boundary, uint64_t* out, const size_t stride, const size_t n, uint32_t* valid)
+{
+	const morton_neighborhood<D, N>& table = mortonNeighborhood<D, N>;
+	const __m512i zero = _mm512_setzero_si512();
+	__m512i mask[D], others[D], one[D], top[D];
+	for (unsigned int a = 0; a < D; ++a)
+	{
+		const uint64_t axis = mortonNd_traits<D, uint64_t>::masks.axis[a];
+		mask[a] = _mm512_set1_epi64(static_cast<int64_t>(axis));
+		others[a] = _mm512_set1_epi64(static_cast<int64_t>(~axis));
+		one[a] = _mm512_set1_epi64(static_cast<int64_t>(1) << (D - 1 - a));
+		top[a] = _mm512_set1_epi64(static_cast<int64_t>(max & axis));
+	}
+
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m512i k = _mm512_loadu_si512(keys + i);
+		__m512i part[D][3];
+		__mmask8 low[D], high[D];
+		for (unsigned int a = 0; a < D; ++a)
+		{
+			const __m512i p = _mm512_and_si512(k, mask[a]);
+			low[a] = _mm512_cmpeq_epu64_mask(p, zero);
+			high[a] = _mm512_cmpeq_epu64_mask(p, top[a]);
+			part[a][0] = _mm512_and_si512(_mm512_sub_epi64(p, one[a]), mask[a]);
+			part[a][1] = p;
+			part[a][2] = _mm512_and_si512(_mm512_add_epi64(_mm512_or_si512(p, others[a]), one[a]), mask[a]);
+			if (boundary == MORTON_BOUNDARY_CLAMP)
+			{
+				part[a][0] = _mm512_mask_blend_epi64(low[a], part[a][0], p);
+				part[a][2] = _mm512_mask_blend_epi64(high[a], part[a][2], p);
+			}
+			else if (boundary == MORTON_BOUNDARY_PERIODIC)
+			{
+				part[a][0] = _mm512_mask_blend_epi64(low[a], part[a][0], top[a]);
+				part[a][2] = _mm512_mask_blend_epi64(high[a], part[a][2], zero);
+			}
+		}
+
+		uint32_t lanes[8];
+		for (unsigned int l = 0; l < 8; ++l)
+			lanes[l] = (1u << N) - 1;
+		for (unsigned int j = 0; j < N; ++j)
+		{
+			__m512i key = zero;
+			__mmask8 outside = 0;
+			for (unsigned int a = 0; a < D; ++a)
+			{
+				const int o = table.offset[j][a];
+				key = _mm512_or_si512(key, part[a][o + 1]);
+				if (o != 0)
+					outside |= o < 0 ? low[a] : high[a];
+			}
+			if (boundary == MORTON_BOUNDARY_SKIP)
+			{
+				key = _mm512_mask_blend_epi64(outside, key, k);
+				for (unsigned int l = 0; l < 8; ++l)
+					lanes[l] &= ~(static_cast<uint32_t>((outside >> l) & 1) << j);
+			}
+			_mm512_storeu_si512(out + j * stride + i, key);
+		}
+		if (valid)
+			for (unsigned int l = 0; l < 8; ++l)
+				valid[i + l] = lanes[l];
+	}
+	neighborKeys_scalar<D, N>(keys + i, max, boundary, out + i, stride, n - i, valid ? valid + i : nullptr);
+}
+
+//Widest kernel available on the host
+template<unsigned int D, unsigned int N>
+inline void neighborKeys(const uint64_t* keys, const uint64_t max, const morton_boundary boundary, uint64_t* out, const size_t stride, const size_t n, uint32_t* valid)
+{
+	if (mortonCpu().avx512f)
+		neighborKeys_avx512<D, N>(keys, max, boundary, out, stride, n, valid);
+	else if (mortonCpu().avx2)
+		neighborKeys_avx2<D, N>(keys, max, boundary, out, stride, n, valid);
+	else
+		neighborKeys_scalar<D, N>(keys, max, boundary, out, stride, n, valid);
+}
+
+/* out holds N * n keys : out[j * n + i] is neighbor j of keys[i] */
+template<unsigned int N>
+inline void neighbors2d(const uint64_t* keys, const morton2 max, const morton_boundary boundary, uint64_t* out, const size_t n, uint32_t* valid = nullptr)
+{
+	neighborKeys<2, N>(keys, max.key, boundary, out, n, n, valid);
+}
+
+template<unsigned int N>
+inline void neighbors3d(const uint64_t* keys, const morton3 max, const morton_boundary boundary, uint64_t* out, const size_t n, uint32_t* valid = nullptr)
+{
+	neighborKeys<3, N>(keys, max.key, boundary, out, n, n, valid);
+}
+
+#endif
@@ -0,0 +1,323 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_OCTREE_H
+#define MORTON_OCTREE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "morton_range.h"
+
+/*
+Linear (pointerless) octrees and quadtrees : the leaves are kept in a sorted array, without any pointer.
+A node is the key of its first cell at the finest level, tagged with its level (0 for the root).
+Its whole subtree then holds the interval of keys [key, key + 8^(levels - level) - 1], and sorting nodes
+by key then by level gives the depth first order of the tree.
+
+  morton_node<morton3> n = mortonNode(morton3(x, y, z), 5); // Level 5 node holding the cell (x, y, z)
+  mortonParent(n), mortonChild(n, 7), mortonSibling(n, 2);
+  mortonCommonAncestor(n, m);                              // Deepest common ancestor : clz of key ^ key
+
+morton3d keys hold 21 levels (x, y, z < 2^21), morton2d keys 32 levels.
+Ref : I. Gargantini, "An effective way to represent quadtrees", 1982
+Ref : H. Sundar, R. Sampath, G. Biros, "Bottom-up construction and 2:1 balance refinement of linear octrees in parallel", 2008
+*/
+template<class Key>
+struct morton_node
+{
+	Key key;            // First cell of the node at the finest level
+	unsigned int level; // 0 for the root, mortonNodeLevels<Key>() for a single cell
+};
+
+/* Depth of the finest level */
+template<class Key>
+inline constexpr unsigned int mortonNodeLevels()
+{
+	return 8 * sizeof(typename morton_range_traits<Key>::key_type) / morton_range_traits<Key>::dims;
+}
+
+/* Cells of the finest level below a node of this level, minus one */
+template<class Key>
+inline typename morton_range_traits<Key>::key_type mortonNodeSpan(const unsigned int level)
+{
+	typedef morton_range_traits<Key> traits;
+	return mortonLowMask<typename traits::key_type>(traits::dims * (mortonNodeLevels<Key>() - level));
+}
+
+/* Node of the given level holding a cell of the finest level */
+template<class Key>
+inline morton_node<Key> mortonNode(const Key cell, const unsigned int level)
+{
+	assert(level <= mortonNodeLevels<Key>());
+	return { Key(cell.key & ~mortonNodeSpan<Key>(level)), level };
+}
+
+/* Cells of the finest level below the node */
+template<class Key>
+inline morton_range<Key> mortonNodeRange(const morton_node<Key> n)
+{
+	return { n.key, Key(n.key.key | mortonNodeSpan<Key>(n.level)) };
+}
+
+template<class Key>
+inline morton_node<Key> mortonParent(const morton_node<Key> n)
+{
+	assert(n.level > 0);
+	return mortonNode(n.key, n.level - 1);
+}
+
+/* Child i, 0 <= i < 2^D, in the order of the curve */
+template<class Key>
+inline morton_node<Key> mortonChild(const morton_node<Key> n, const unsigned int i)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	assert(n.level < mortonNodeLevels<Key>() && i < (1u << traits::dims));
+	const unsigned int shift = traits::dims * (mortonNodeLevels<Key>() - n.level - 1);
+	return { Key(n.key.key | static_cast<T>(i) << shift), n.level + 1 };
+}
+
+/* Position of the node among the children of its parent */
+template<class Key>
+inline unsigned int mortonChildIndex(const morton_node<Key> n)
+{
+	typedef morton_range_traits<Key> traits;
+	assert(n.level > 0);
+	const unsigned int shift = traits::dims * (mortonNodeLevels<Key>() - n.level);
+	return static_cast<unsigned int>(n.key.key >> shift) & ((1u << traits::dims) - 1);
+}
+
+/* Child i of the parent of the node : the node itself for i == mortonChildIndex(n) */
+template<class Key>
+inline morton_node<Key> mortonSibling(const morton_node<Key> n, const unsigned int i)
+{
+	return mortonChild(mortonParent(n), i);
+}
+
+/* Is a a strict ancestor of b ? */
+template<class Key>
+inline bool mortonIsAncestor(const morton_node<Key> a, const morton_node<Key> b)
+{
+	return a.level < b.level && (b.key.key & ~mortonNodeSpan<Key>(a.level)) == a.key.key;
+}
+
+/* Deepest node holding both a and b, given by the highest bit where their keys differ */
+template<class Key>
+inline morton_node<Key> mortonCommonAncestor(const morton_node<Key> a, const morton_node<Key> b)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	const unsigned int diff = static_cast<unsigned int>(mortonHighestBit<T>(a.key.key ^ b.key.key) + traits::dims) / traits::dims;
+	const unsigned int level = std::min(std::min(a.level, b.level), mortonNodeLevels<Key>() - diff);
+	return mortonNode(a.key, level);
+}
+
+template<class Key>
+inline bool operator==(const morton_node<Key> a, const morton_node<Key> b)
+{
+	return a.key.key == b.key.key && a.level == b.level;
+}
+
+template<class Key>
+inline bool operator!=(const morton_node<Key> a, const morton_node<Key> b)
+{
+	return !(a == b);
+}
+
+/* Depth first order : a parent comes right before its first child */
+template<class Key>
+inline bool operator<(const morton_node<Key> a, const morton_node<Key> b)
+{
+	return a.key.key < b.key.key || (a.key.key == b.key.key && a.level < b.level);
+}
+
+/*
+Linear octree (or quadtree with morton2d keys) : leaves sorted in depth first order, which never overlap.
+Internal nodes are implicit : the leaves below a node are a contiguous slice of the array.
+Keys and levels are kept in two arrays, and a table of the first leaf for each value of the highest bits of the keys
+narrows the binary searches to a few cache lines.
+keys() is a sorted array of morton keys, usable with mortonBoxQuery.
+*/
+template<class Key>
+class morton_octree
+{
+public:
+	typedef morton_node<Key> node;
+	typedef typename morton_range_traits<Key>::key_type key_type;
+
+	static const size_t npos = static_cast<size_t>(-1);
+
+private:
+	std::vector<Key> leafKeys;
+	std::vector<uint8_t> leafLevels;
+	std::vector<size_t> index; // index[p] : first leaf with (key >> indexShift) >= p
+	unsigned int indexShift;
+
+	void push(const node n)
+	{
+		leafKeys.push_back(n.key);
+		leafLevels.push_back(static_cast<uint8_t>(n.level));
+	}
+
+	node back() const
+	{
+		return { leafKeys.back(), leafLevels.back() };
+	}
+
+	void split(const node n, const Key* cells, const size_t first, const size_t last, const size_t maxKeys)
+	{
+		if (last - first <= maxKeys || n.level == mortonNodeLevels<Key>())
+		{
+			push(n);
+			return;
+		}
+
+		size_t begin = first;
+		for (unsigned int i = 0; i < (1u << morton_range_traits<Key>::dims) && begin < last; ++i)
+		{
+			const key_type childLast = mortonNodeRange(mortonChild(n, i)).last.key;
+			const size_t end = std::upper_bound(cells + begin, cells + last, childLast, [](const key_type k, const Key& m) { return k < m.key; }) - cells;
+			if (end > begin)
+				split(mortonChild(n, i), cells, begin, end, maxKeys);
+			begin = end;
+		}
+	}
+
+	/* Is the key in the cells of the tree : z above 2^21 has a bit of a morton3 key, but no level of the tree */
+	static bool inTree(const key_type k)
+	{
+		const unsigned int treeBits = morton_range_traits<Key>::dims * mortonNodeLevels<Key>();
+		return ((k >> (treeBits - 1)) >> 1) == 0;
+	}
+
+	/* Up to 2^16 entries, about one per leaf. The index covers the whole key type, so that any key can be looked up */
+	void buildIndex()
+	{
+		const unsigned int keyBits = 8 * sizeof(key_type);
+		const unsigned int indexBits = std::min(std::min(16u, keyBits), static_cast<unsigned int>(mortonHighestBit<uint64_t>(leafKeys.size() | 1) + 1));
+		indexShift = keyBits - indexBits;
+		index.assign((static_cast<size_t>(1) << indexBits) + 1, leafKeys.size());
+		for (size_t i = leafKeys.size(); i-- > 0;)
+			index[static_cast<size_t>(leafKeys[i].key >> indexShift)] = i;
+		for (size_t p = index.size() - 1; p-- > 0;)
+			index[p] = std::min(index[p], index[p + 1]);
+	}
+
+	/* First leaf with a key greater than k */
+	size_t upperBound(const key_type k) const
+	{
+		const size_t p = static_cast<size_t>(k >> indexShift);
+		return std::upper_bound(leafKeys.begin() + index[p], leafKeys.begin() + index[p + 1], k, [](const key_type v, const Key& m) { return v < m.key; }) - leafKeys.begin();
+	}
+
+public:
+	morton_octree()
+	{
+		buildIndex();
+	}
+
+	/* Leaves of the given level holding sorted cells of the finest level, duplicates allowed. O(n) */
+	morton_octree(const Key* cells, const size_t n, const unsigned int level = mortonNodeLevels<Key>())
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			assert(i == 0 || cells[i - 1].key <= cells[i].key);
+			assert(inTree(cells[i].key));
+			const node leaf = mortonNode(cells[i], level);
+			if (leafKeys.empty() || back() != leaf)
+				push(leaf);
+		}
+		buildIndex();
+	}
+
+	/* Sorted nodes. Nodes below a previous one are dropped, so that leaves never overlap. O(n) */
+	morton_octree(const node* nodes, const size_t n)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			assert(i == 0 || !(nodes[i] < nodes[i - 1]));
+			assert(inTree(nodes[i].key.key));
+			if (leafKeys.empty() || (back() != nodes[i] && !mortonIsAncestor(back(), nodes[i])))
+				push(nodes[i]);
+		}
+		buildIndex();
+	}
+
+	/* Largest nodes holding at most maxKeys of the sorted cells, and at least one. Empty nodes have no leaf. */
+	static morton_octree adaptive(const Key* cells, const size_t n, const size_t maxKeys)
+	{
+		assert(maxKeys > 0 && (n == 0 || inTree(cells[n - 1].key)));
+		morton_octree tree;
+		if (n > 0)
+			tree.split({ Key(0), 0 }, cells, 0, n, maxKeys);
+		tree.buildIndex();
+		return tree;
+	}
+
+	size_t size() const { return leafKeys.size(); }
+	bool empty() const { return leafKeys.empty(); }
+	node operator[](const size_t i) const { return { leafKeys[i], leafLevels[i] }; }
+	const Key* keys() const { return leafKeys.data(); }
+	const uint8_t* levels() const { return leafLevels.data(); }
+
+	/* Index of the leaf holding a cell of the finest level, npos if none */
+	size_t find(const Key cell) const
+	{
+		const size_t i = upperBound(cell.key);
+		if (i == 0)
+			return npos;
+		return (cell.key & ~mortonNodeSpan<Key>(leafLevels[i - 1])) == leafKeys[i - 1].key ? i - 1 : npos;
+	}
+
+	/*
+	Leaves [first, last) overlapping a node : the leaves of its subtree, or the single leaf holding it.
+	Children of a node are found with a binary search in this slice only.
+	*/
+	std::pair<size_t, size_t> overlap(const node n) const
+	{
+		const morton_range<Key> r = mortonNodeRange(n);
+		size_t first = upperBound(r.first.key);
+		if (first > 0 && mortonIsAncestor((*this)[first - 1], n))
+			return { first - 1, first };
+		if (first > 0 && leafKeys[first - 1].key == r.first.key)
+			--first;
+		return { first, upperBound(r.last.key) };
+	}
+
+	bool isLeaf(const node n) const
+	{
+		const std::pair<size_t, size_t> r = overlap(n);
+		return r.second == r.first + 1 && (*this)[r.first] == n;
+	}
+};
+
+template<class Key> const size_t morton_octree<Key>::npos;
+
+typedef morton_octree<morton3> morton_octree3;
+typedef morton_octree<morton2> morton_quadtree2;
+
+#endif
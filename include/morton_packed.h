@@ -0,0 +1,314 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_PACKED_H
+#define MORTON_PACKED_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <immintrin.h>
+
+#include "morton_cpu.h"
+#include "morton_sort.h"
+
+/*
+Compressed array of sorted keys : morton2d, morton3d or uint64_t keys, see mortonSortKey.
+
+  morton_packed_keys packed(keys, n);      // keys sorted
+  packed.decode(out);                      // All keys
+  packed.decodeBlock(b, out);              // Keys [128 * b, 128 * b + 128)
+  uint64_t k = packed[i];
+  size_t i = packed.lowerBound(morton3(x, y, z).key);
+
+Keys are split in blocks of 128. The first key of each block is kept aside, and is the skip index searched by lowerBound().
+Inside a block, each key is stored as its difference with the key 4 places before (the first 4 keys with the first key), so that
+4 lanes decode independently : the differences after the first row are made relative to their minimum (frame of reference),
+the first row being kept as offsets from the first key, and all are packed with the bit width giving the smallest block. Values which don't fit in that width are patched from a list of exceptions (PFOR).
+Each lane has its own stream of 64 bits words, the words of the 4 lanes being interleaved : an AVX2 register unpacks one
+value of each lane with a single shift, and adds it to the previous 4 keys.
+
+Ref : Daniel Lemire, Leonid Boytsov, "Decoding billions of integers per second through vectorization", 2012
+Ref : Marcin Zukowski et al., "Super-Scalar RAM-CPU Cache Compression", 2006
+*/
+class morton_packed_keys
+{
+public:
+	static const size_t blockSize = 128;
+	static const size_t lanes = 4;
+	static const size_t rows = blockSize / lanes;
+
+	struct block
+	{
+		uint64_t base;       // Smallest difference of the block, after the first row
+		uint64_t offset;     // First word of the block in data
+		uint32_t bits;       // Bits per difference
+		uint32_t exceptions; // Differences wider than bits
+	};
+
+private:
+	size_t count;
+	std::vector<uint64_t> firsts;   // First key of each block
+	std::vector<block> blocks;
+	std::vector<uint64_t> data;     // Per block : packed differences, exceptions positions (8 per word), exceptions high bits
+
+	static inline uint64_t lowMask(const uint32_t bits)
+	{
+		return bits >= 64 ? ~0ull : (1ull << bits) - 1;
+	}
+
+	static inline uint32_t width(const uint64_t v)
+	{
+		uint32_t bits = 0;
+		while (bits < 64 && (v >> bits) != 0)
+			++bits;
+		return bits;
+	}
+
+	static inline size_t wordsPerLane(const uint32_t bits)
+	{
+		return (rows * bits + 63) / 64;
+	}
+
+	void encodeBlock(const uint64_t* keys)
+	{
+		uint64_t delta[blockSize];
+		for (size_t i = 0; i < blockSize; ++i)
+			delta[i] = keys[i] - keys[i < lanes ? 0 : i - lanes];
+		//The first row is 0 for the first key : the base only applies to the next rows
+		const uint64_t base = *std::min_element(delta + lanes, delta + blockSize);
+		for (size_t i = lanes; i < blockSize; ++i)
+			delta[i] -= base;
+
+		//Width with the smallest size, exceptions costing a byte of position and a word
+		size_t histogram[65] = {};
+		for (size_t i = 0; i < blockSize; ++i)
+			++histogram[width(delta[i])];
+		uint32_t bits = 64;
+		size_t best = ~size_t(0), wider = 0;
+		for (int b = 64; b >= 0; --b)
+		{
+			const size_t size = lanes * wordsPerLane(b) * 64 + wider * 72;
+			if (size < best)
+			{
+				best = size;
+				bits = b;
+			}
+			wider += histogram[b];
+		}
+
+		block header = { base, data.size(), bits, 0 };
+		const size_t words = wordsPerLane(bits);
+		data.resize(data.size() + lanes * words, 0);
+		uint64_t* packed = data.data() + header.offset;
+		std::vector<uint8_t> positions;
+		std::vector<uint64_t> high;
+		for (size_t i = 0; i < blockSize; ++i)
+		{
+			const uint64_t v = delta[i];
+			if (bits < 64 && (v >> bits) != 0)
+			{
+				positions.push_back(static_cast<uint8_t>(i));
+				high.push_back(v >> bits);
+			}
+			if (bits == 0)
+				continue;
+			const size_t row = i / lanes, lane = i % lanes;
+			const size_t p = row * bits, w = p / 64, s = p % 64;
+			packed[w * lanes + lane] |= (v & lowMask(bits)) << s;
+			if (s + bits > 64)
+				packed[(w + 1) * lanes + lane] |= (v & lowMask(bits)) >> (64 - s);
+		}
+
+		header.exceptions = static_cast<uint32_t>(positions.size());
+		const size_t start = data.size();
+		data.resize(start + (positions.size() + 7) / 8, 0);
+		for (size_t e = 0; e < positions.size(); ++e)
+			data[start + e / 8] |= static_cast<uint64_t>(positions[e]) << (8 * (e % 8));
+		data.insert(data.end(), high.begin(), high.end());
+		blocks.push_back(header);
+	}
+
+	/* Adds the exceptions of block b to the unpacked differences */
+	inline void patch(const block& h, uint64_t* delta) const
+	{
+		const uint64_t* positions = data.data() + h.offset + lanes * wordsPerLane(h.bits);
+		const uint64_t* high = positions + (h.exceptions + 7) / 8;
+		for (uint32_t e = 0; e < h.exceptions; ++e)
+			delta[(positions[e / 8] >> (8 * (e % 8))) & 0xFF] |= high[e] << (h.bits & 63);
+	}
+
+public:
+	morton_packed_keys() : count(0)
+	{
+	}
+
+	/* keys must be sorted */
+	template<class Key>
+	morton_packed_keys(const Key* keys, const size_t n) : count(n)
+	{
+		const size_t blockCount = (n + blockSize - 1) / blockSize;
+		firsts.reserve(blockCount);
+		blocks.reserve(blockCount);
+		uint64_t block[blockSize];
+		for (size_t b = 0; b < blockCount; ++b)
+		{
+			//The last block is padded with its last key
+			const size_t first = b * blockSize, end = std::min(n, first + blockSize);
+			for (size_t i = first; i < first + blockSize; ++i)
+				block[i - first] = static_cast<uint64_t>(mortonSortKey(keys[std::min(i, end - 1)]));
+			assert(std::is_sorted(block, block + blockSize));
+			firsts.push_back(block[0]);
+			encodeBlock(block);
+		}
+		data.shrink_to_fit();
+	}
+
+	size_t size() const { return count; }
+	size_t blockCount() const { return blocks.size(); }
+	const std::vector<uint64_t>& skipIndex() const { return firsts; }
+	const block& header(const size_t b) const { return blocks[b]; }
+
+	/* Bytes used by the keys, the skip index and the block headers */
+	size_t memory() const
+	{
+		return data.size() * sizeof(uint64_t) + firsts.size() * sizeof(uint64_t) + blocks.size() * sizeof(block);
+	}
+
+	void decodeBlock_scalar(const size_t b, uint64_t* out) const
+	{
+		const block& h = blocks[b];
+		const uint64_t* packed = data.data() + h.offset;
+		const uint64_t mask = lowMask(h.bits);
+		uint64_t delta[blockSize];
+		for (size_t row = 0; row < rows; ++row)
+		{
+			const size_t p = row * h.bits, w = p / 64, s = p % 64;
+			for (size_t lane = 0; lane < lanes; ++lane)
+			{
+				uint64_t v = h.bits == 0 ? 0 : packed[w * lanes + lane] >> s;
+				if (s + h.bits > 64)
+					v |= packed[(w + 1) * lanes + lane] << (64 - s);
+				delta[row * lanes + lane] = v & mask;
+			}
+		}
+		patch(h, delta);
+
+		const uint64_t first = firsts[b];
+		for (size_t i = 0; i < lanes; ++i)
+			out[i] = first + delta[i];
+		for (size_t i = lanes; i < blockSize; ++i)
+			out[i] = out[i - lanes] + delta[i] + h.base;
+	}
+
+	MORTON_TARGET("avx2") void decodeBlock_avx2(const size_t b, uint64_t* out) const
+	{
+		const block& h = blocks[b];
+		const __m256i* packed = reinterpret_cast<const __m256i*>(data.data() + h.offset);
+		const __m256i mask = _mm256_set1_epi64x(static_cast<int64_t>(lowMask(h.bits)));
+		const __m256i base = _mm256_set1_epi64x(static_cast<int64_t>(h.base));
+		__m256i previous = _mm256_set1_epi64x(static_cast<int64_t>(firsts[b]));
+
+		//Without exceptions, the keys are made as the differences are unpacked
+		uint64_t delta[blockSize];
+		__m256i* target = reinterpret_cast<__m256i*>(h.exceptions == 0 ? out : delta);
+		for (size_t row = 0; row < rows; ++row)
+		{
+			const size_t p = row * h.bits, w = p / 64, s = p % 64;
+			__m256i v = _mm256_setzero_si256();
+			if (h.bits != 0)
+			{
+				v = _mm256_srl_epi64(_mm256_loadu_si256(packed + w), _mm_cvtsi32_si128(static_cast<int>(s)));
+				if (s + h.bits > 64)
+					v = _mm256_or_si256(v, _mm256_sll_epi64(_mm256_loadu_si256(packed + w + 1), _mm_cvtsi32_si128(static_cast<int>(64 - s))));
+				v = _mm256_and_si256(v, mask);
+			}
+			if (h.exceptions == 0)
+			{
+				previous = _mm256_add_epi64(previous, row == 0 ? v : _mm256_add_epi64(v, base));
+				v = previous;
+			}
+			_mm256_storeu_si256(target + row, v);
+		}
+		if (h.exceptions == 0)
+			return;
+
+		patch(h, delta);
+		for (size_t row = 0; row < rows; ++row)
+		{
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(delta + row * lanes));
+			previous = _mm256_add_epi64(previous, row == 0 ? v : _mm256_add_epi64(v, base));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + row * lanes), previous);
+		}
+	}
+
+	/* The 128 keys of block b, the last block being padded with its last key */
+	void decodeBlock(const size_t b, uint64_t* out) const
+	{
+		assert(b < blocks.size());
+		if (mortonCpu().avx2)
+			decodeBlock_avx2(b, out);
+		else
+			decodeBlock_scalar(b, out);
+	}
+
+	/* All keys, out holding size() keys */
+	void decode(uint64_t* out) const
+	{
+		const size_t full = count / blockSize;
+		for (size_t b = 0; b < full; ++b)
+			decodeBlock(b, out + b * blockSize);
+		if (full < blocks.size())
+		{
+			uint64_t last[blockSize];
+			decodeBlock(full, last);
+			std::copy(last, last + (count - full * blockSize), out + full * blockSize);
+		}
+	}
+
+	/* Decodes the block of key i */
+	uint64_t operator[](const size_t i) const
+	{
+		assert(i < count);
+		uint64_t keys[blockSize];
+		decodeBlock(i / blockSize, keys);
+		return keys[i % blockSize];
+	}
+
+	/* Index of the first key not less than key, size() if there is none : the skip index gives the block to decode */
+	size_t lowerBound(const uint64_t key) const
+	{
+		//Blocks before next start below key, the first key not less than key is in the last of them or starts block next
+		const size_t next = static_cast<size_t>(std::lower_bound(firsts.begin(), firsts.end(), key) - firsts.begin());
+		if (next == 0)
+			return 0;
+		uint64_t keys[blockSize];
+		decodeBlock(next - 1, keys);
+		const size_t i = (next - 1) * blockSize + static_cast<size_t>(std::lower_bound(keys, keys + blockSize, key) - keys);
+		return std::min(i, count);
+	}
+};
+
+#endif
@@ -0,0 +1,301 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_QUANTIZER_H
+#define MORTON_QUANTIZER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <assert.h>
+#include <immintrin.h>
+
+#include "morton2d.h"
+#include "morton3d.h"
+#include "morton_batch.h"
+#include "morton_cpu.h"
+
+/*
+Encode float or double positions straight to morton keys, inside a bounding box :
+
+  morton3d_quantizer<float> q({ 0.f, 0.f, 0.f }, { 10.f, 10.f, 10.f }, 16);
+  morton3 m = q.encode(x, y, z);
+  q.encode(xs, ys, zs, keys, n);    // Arrays, in a single AVX-512 / AVX2 pass
+  q.decode(keys, xs, ys, zs, n);    // Centers of the cells
+
+Each axis of the box is split in 2^bits cells of size (hi - lo) / 2^bits.
+Cell i holds the positions in [lo + i * size, lo + (i + 1) * size), except the last one which also holds hi :
+the box is closed. Positions outside the box are clamped to the first / last cell, and NaN goes to cell 0.
+Quantization is computed in double precision for both float and double positions, so that scalar and SIMD
+encodings always give the same keys. Positions closer to a cell boundary than the rounding error of
+(p - lo) * 2^bits / (hi - lo) may go to either neighbor cell.
+Decoding gives the center of the cell : the round trip error of a position inside the box is at most size / 2.
+*/
+struct morton_quantizer_axis
+{
+	double lo;
+	double scale;    // Cells per unit
+	double cellSize;
+	double maxCell;
+
+	morton_quantizer_axis() : lo(0), scale(0), cellSize(0), maxCell(0) {}
+
+	morton_quantizer_axis(const double _lo, const double _hi, const unsigned int bits)
+		: lo(_lo), scale(0), cellSize((_hi - _lo) / static_cast<double>(1ull << bits)), maxCell(static_cast<double>((1ull << bits) - 1))
+	{
+		assert(_hi >= _lo);
+		//A flat box puts everything in cell 0
+		if (_hi > _lo)
+			scale = static_cast<double>(1ull << bits) / (_hi - _lo);
+	}
+
+	inline uint32_t quantize(const double v) const
+	{
+		double t = (v - lo) * scale;
+		t = t > 0 ? t : 0; // Also NaN
+		t = t < maxCell ? t : maxCell;
+		return static_cast<uint32_t>(t);
+	}
+
+	inline double center(const uint64_t cell) const
+	{
+		return lo + (static_cast<double>(cell) + 0.5) * cellSize;
+	}
+};
+
+//Loads 4 / 8 positions as doubles
+MORTON_TARGET("avx2") static inline __m256d loadpd_avx2(const double* in)
+{
+	return _mm256_loadu_pd(in);
+}
+
+MORTON_TARGET("avx2") static inline __m256d loadpd_avx2(const float* in)
+{
+	return _mm256_cvtps_pd(_mm_loadu_ps(in));
+}
+
+MORTON_TARGET("avx512f") static inline __m512d loadpd_avx512(const double* in)
+{
+	return _mm512_loadu_pd(in);
+}
+
+MORTON_TARGET("avx512f") static inline __m512d loadpd_avx512(const float* in)
+{
+	return _mm512_cvtps_pd(_mm256_loadu_ps(in));
+}
+
+/* Same as morton_quantizer_axis::quantize, cells in 64 bits lanes.
+max_pd returns its second operand when the first one is NaN, which sends NaN to cell 0. */
+MORTON_TARGET("avx2") static inline __m256i quantize_avx2(const __m256d v, const morton_quantizer_axis& axis)
+{
+	__m256d t = _mm256_mul_pd(_mm256_sub_pd(v, _mm256_set1_pd(axis.lo)), _mm256_set1_pd(axis.scale));
+	t = _mm256_min_pd(_mm256_max_pd(t, _mm256_setzero_pd()), _mm256_set1_pd(axis.maxCell));
+	//There is no unsigned conversion before AVX-512 : cells are shifted to the signed range and back.
+	//Truncation rounds negative values up, hence the floor first
+	const __m256d shifted = _mm256_sub_pd(_mm256_floor_pd(t), _mm256_set1_pd(2147483648.0));
+	const __m128i cell = _mm_xor_si128(_mm256_cvttpd_epi32(shifted),
+		_mm_set1_epi32(static_cast<int>(0x80000000)));
+	return _mm256_cvtepu32_epi64(cell);
+}
+
+MORTON_TARGET("avx512f") static inline __m512i quantize_avx512(const __m512d v, const morton_quantizer_axis& axis)
+{
+	__m512d t = _mm512_mul_pd(_mm512_sub_pd(v, _mm512_set1_pd(axis.lo)), _mm512_set1_pd(axis.scale));
+	t = _mm512_min_pd(_mm512_max_pd(t, _mm512_setzero_pd()), _mm512_set1_pd(axis.maxCell));
+	return _mm512_cvtepu32_epi64(_mm512_cvttpd_epu32(t));
+}
+
+/* Keys decoded by chunks, so that the cells stay in L1 cache */
+static const size_t mortonQuantizerChunk = 256;
+
+template<class Real = float>
+struct morton2d_quantizer
+{
+	morton_quantizer_axis axes[2];
+
+	/* bits : cells per axis, up to 32 */
+	morton2d_quantizer(const Real (&lo)[2], const Real (&hi)[2], const unsigned int bits)
+	{
+		assert(bits >= 1 && bits <= 32);
+		for (int a = 0; a < 2; ++a)
+			axes[a] = morton_quantizer_axis(lo[a], hi[a], bits);
+	}
+
+	inline morton2 encode(const Real x, const Real y) const
+	{
+		return morton2(axes[0].quantize(x), axes[1].quantize(y));
+	}
+
+	inline void decode(const morton2 m, Real& x, Real& y) const
+	{
+		uint64_t cx, cy;
+		m.decode(cx, cy);
+		x = static_cast<Real>(axes[0].center(cx));
+		y = static_cast<Real>(axes[1].center(cy));
+	}
+
+	void encode_scalar(const Real* x, const Real* y, uint64_t* out, const size_t n) const
+	{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = encode(x[i], y[i]).key;
+	}
+
+	MORTON_TARGET("avx2") void encode_avx2(const Real* x, const Real* y, uint64_t* out, const size_t n) const
+	{
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m256i xx = spreadBits2_avx2(quantize_avx2(loadpd_avx2(x + i), axes[0]));
+			const __m256i yy = spreadBits2_avx2(quantize_avx2(loadpd_avx2(y + i), axes[1]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(_mm256_slli_epi64(xx, 1), yy));
+		}
+		encode_scalar(x + i, y + i, out + i, n - i);
+	}
+
+	MORTON_TARGET("avx512f") void encode_avx512(const Real* x, const Real* y, uint64_t* out, const size_t n) const
+	{
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m512i xx = spreadBits2_avx512(quantize_avx512(loadpd_avx512(x + i), axes[0]));
+			const __m512i yy = spreadBits2_avx512(quantize_avx512(loadpd_avx512(y + i), axes[1]));
+			_mm512_storeu_si512(out + i, _mm512_or_si512(_mm512_slli_epi64(xx, 1), yy));
+		}
+		encode_scalar(x + i, y + i, out + i, n - i);
+	}
+
+	void encode(const Real* x, const Real* y, uint64_t* out, const size_t n) const
+	{
+		if (mortonCpu().avx512f)
+			encode_avx512(x, y, out, n);
+		else if (mortonCpu().avx2)
+			encode_avx2(x, y, out, n);
+		else
+			encode_scalar(x, y, out, n);
+	}
+
+	void decode(const uint64_t* keys, Real* x, Real* y, const size_t n) const
+	{
+		uint32_t cx[mortonQuantizerChunk], cy[mortonQuantizerChunk];
+		for (size_t i = 0; i < n; i += mortonQuantizerChunk)
+		{
+			const size_t count = std::min(mortonQuantizerChunk, n - i);
+			decode2d(keys + i, cx, cy, count);
+			for (size_t j = 0; j < count; ++j)
+			{
+				x[i + j] = static_cast<Real>(axes[0].center(cx[j]));
+				y[i + j] = static_cast<Real>(axes[1].center(cy[j]));
+			}
+		}
+	}
+};
+
+template<class Real = float>
+struct morton3d_quantizer
+{
+	morton_quantizer_axis axes[3];
+
+	/* bits : cells per axis, up to 21 */
+	morton3d_quantizer(const Real (&lo)[3], const Real (&hi)[3], const unsigned int bits)
+	{
+		assert(bits >= 1 && bits <= 21);
+		for (int a = 0; a < 3; ++a)
+			axes[a] = morton_quantizer_axis(lo[a], hi[a], bits);
+	}
+
+	inline morton3 encode(const Real x, const Real y, const Real z) const
+	{
+		return morton3(axes[0].quantize(x), axes[1].quantize(y), axes[2].quantize(z));
+	}
+
+	inline void decode(const morton3 m, Real& x, Real& y, Real& z) const
+	{
+		uint64_t cx, cy, cz;
+		m.decode(cx, cy, cz);
+		x = static_cast<Real>(axes[0].center(cx));
+		y = static_cast<Real>(axes[1].center(cy));
+		z = static_cast<Real>(axes[2].center(cz));
+	}
+
+	void encode_scalar(const Real* x, const Real* y, const Real* z, uint64_t* out, const size_t n) const
+	{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = encode(x[i], y[i], z[i]).key;
+	}
+
+	/* Cells have at most 21 bits : bit 21 of z, which encode3d_avx2 moves to bit 63, is always 0 */
+	MORTON_TARGET("avx2") void encode_avx2(const Real* x, const Real* y, const Real* z, uint64_t* out, const size_t n) const
+	{
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m256i xx = spreadBits3_avx2(quantize_avx2(loadpd_avx2(x + i), axes[0]));
+			const __m256i yy = spreadBits3_avx2(quantize_avx2(loadpd_avx2(y + i), axes[1]));
+			const __m256i zz = spreadBits3_avx2(quantize_avx2(loadpd_avx2(z + i), axes[2]));
+			const __m256i key = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi64(xx, 2), _mm256_slli_epi64(yy, 1)), zz);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), key);
+		}
+		encode_scalar(x + i, y + i, z + i, out + i, n - i);
+	}
+
+	MORTON_TARGET("avx512f") void encode_avx512(const Real* x, const Real* y, const Real* z, uint64_t* out, const size_t n) const
+	{
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m512i xx = spreadBits3_avx512(quantize_avx512(loadpd_avx512(x + i), axes[0]));
+			const __m512i yy = spreadBits3_avx512(quantize_avx512(loadpd_avx512(y + i), axes[1]));
+			const __m512i zz = spreadBits3_avx512(quantize_avx512(loadpd_avx512(z + i), axes[2]));
+			const __m512i key = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi64(xx, 2), _mm512_slli_epi64(yy, 1)), zz);
+			_mm512_storeu_si512(out + i, key);
+		}
+		encode_scalar(x + i, y + i, z + i, out + i, n - i);
+	}
+
+	void encode(const Real* x, const Real* y, const Real* z, uint64_t* out, const size_t n) const
+	{
+		if (mortonCpu().avx512f)
+			encode_avx512(x, y, z, out, n);
+		else if (mortonCpu().avx2)
+			encode_avx2(x, y, z, out, n);
+		else
+			encode_scalar(x, y, z, out, n);
+	}
+
+	void decode(const uint64_t* keys, Real* x, Real* y, Real* z, const size_t n) const
+	{
+		uint32_t cx[mortonQuantizerChunk], cy[mortonQuantizerChunk], cz[mortonQuantizerChunk];
+		for (size_t i = 0; i < n; i += mortonQuantizerChunk)
+		{
+			const size_t count = std::min(mortonQuantizerChunk, n - i);
+			decode3d(keys + i, cx, cy, cz, count);
+			for (size_t j = 0; j < count; ++j)
+			{
+				x[i + j] = static_cast<Real>(axes[0].center(cx[j]));
+				y[i + j] = static_cast<Real>(axes[1].center(cy[j]));
+				z[i + j] = static_cast<Real>(axes[2].center(cz[j]));
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,520 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_RANGE_H
+#define MORTON_RANGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "morton2d.h"
+#include "morton3d.h"
+#include "mortonNd.h"
+
+/*
+Axis aligned box queries on sorted morton keys. A box is given by its min and max corners, both inclusive :
+
+  mortonInBox(m, min, max);          // Is m inside the box ?
+  mortonBigMin(m, min, max, next);   // Smallest key of the box greater than m
+  mortonLitMax(m, min, max, prev);   // Greatest key of the box lower than m
+  mortonBoxRanges(min, max, 64);     // The box as at most 64 intervals of keys
+  mortonBoxQuery(keys, n, min, max, f); // Calls f on each key of a sorted array inside the box
+  for (Key m : mortonBox(min, max)) {}  // Keys of the box, in the order of the curve
+
+Keys between min and max are mostly outside the box : BIGMIN jumps over the keys which are not.
+Ref : H. Tropf, H. Herzog, "Multidimensional Range Search in Dynamically Balanced Trees", 1981
+Ref : https://en.wikipedia.org/wiki/Z-order_curve#Use_with_one-dimensional_data_structures_for_range_searching
+*/
+template<class Key>
+struct morton_range_traits;
+
+template<class T, class C>
+struct morton_range_traits<morton2d<T, C>>
+{
+	typedef T key_type;
+	static const unsigned int dims = 2;
+};
+
+template<class T, class C>
+struct morton_range_traits<morton3d<T, C>>
+{
+	typedef T key_type;
+	static const unsigned int dims = 3;
+};
+
+template<unsigned int D, class T, class C>
+struct morton_range_traits<mortonNd<D, T, C>>
+{
+	typedef T key_type;
+	static const unsigned int dims = D;
+};
+
+/* Interval of keys, first and last included */
+template<class Key>
+struct morton_range
+{
+	Key first;
+	Key last;
+};
+
+/* Bits [0, bits) set */
+template<class T>
+inline T mortonLowMask(const unsigned int bits)
+{
+	return bits >= 8 * sizeof(T) ? ~static_cast<T>(0) : (static_cast<T>(1) << bits) - 1;
+}
+
+/* Position of the highest bit set, -1 for 0 */
+template<class T>
+inline int mortonHighestBit(T v)
+{
+	int bit = -1;
+	for (; v != 0; v >>= 1)
+		++bit;
+	return bit;
+}
+
+template<>
+inline int mortonHighestBit<uint32_t>(const uint32_t v)
+{
+#if _MSC_VER
+	unsigned long bit;
+	return _BitScanReverse(&bit, v) ? static_cast<int>(bit) : -1;
+#else
+	return v == 0 ? -1 : 31 - __builtin_clz(v);
+#endif
+}
+
+template<>
+inline int mortonHighestBit<uint64_t>(const uint64_t v)
+{
+#if _MSC_VER
+	unsigned long bit;
+	return _BitScanReverse64(&bit, v) ? static_cast<int>(bit) : -1;
+#else
+	return v == 0 ? -1 : 63 - __builtin_clzll(v);
+#endif
+}
+
+#ifdef __SIZEOF_INT128__
+template<>
+inline int mortonHighestBit<morton_uint128>(const morton_uint128 v)
+{
+	const uint64_t high = static_cast<uint64_t>(v >> 64);
+	return high != 0 ? 64 + mortonHighestBit<uint64_t>(high) : mortonHighestBit<uint64_t>(static_cast<uint64_t>(v));
+}
+#endif
+
+template<class Key>
+inline bool mortonInBox(const Key m, const Key min, const Key max)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	for (unsigned int a = 0; a < traits::dims; ++a)
+	{
+		const T mask = mortonNd_traits<traits::dims, T>::masks.axis[a];
+		const T v = m.key & mask;
+		if (v < (min.key & mask) || v > (max.key & mask))
+			return false;
+	}
+	return true;
+}
+
+/*
+Smallest key inside the box and greater than m. Returns false when there is none.
+BIGMIN walks down the bits where m, min and max differ : each bit of min and max is compared
+with the one of m, and the box is cut in half along the axis of the bit.
+*/
+template<class Key>
+inline bool mortonBigMin(const Key m, Key min, Key max, Key& bigmin)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	const unsigned int D = traits::dims;
+	bool found = false;
+
+	for (int i = mortonHighestBit<T>((m.key ^ min.key) | (m.key ^ max.key)); i >= 0; --i)
+	{
+		const T bit = static_cast<T>(1) << i;
+		//Lower bits of the same axis
+		const T lower = mortonNd_traits<D, T>::masks.axis[D - 1 - i % D] & (bit - 1);
+		const unsigned int code = ((m.key & bit) ? 4 : 0) | ((min.key & bit) ? 2 : 0) | ((max.key & bit) ? 1 : 0);
+		switch (code)
+		{
+		case 1: // 0 0 1 : the box is split, the upper half is after m
+			bigmin = Key(((min.key & ~lower) | bit));
+			found = true;
+			max = Key(((max.key | lower) & ~bit));
+			break;
+		case 3: // 0 1 1 : the whole box is after m
+			bigmin = min;
+			return true;
+		case 4: // 1 0 0 : the whole box is before m
+			return found;
+		case 5: // 1 0 1 : only the upper half can hold keys after m
+			min = Key(((min.key & ~lower) | bit));
+			break;
+		default: // 0 0 0, 1 1 1 : m is in the box along this bit. 0 1 0 and 1 1 0 would be an empty box
+			break;
+		}
+	}
+	return found;
+}
+
+/* Greatest key inside the box and lower than m. Returns false when there is none. */
+template<class Key>
+inline bool mortonLitMax(const Key m, Key min, Key max, Key& litmax)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	const unsigned int D = traits::dims;
+	bool found = false;
+
+	for (int i = mortonHighestBit<T>((m.key ^ min.key) | (m.key ^ max.key)); i >= 0; --i)
+	{
+		const T bit = static_cast<T>(1) << i;
+		const T lower = mortonNd_traits<D, T>::masks.axis[D - 1 - i % D] & (bit - 1);
+		const unsigned int code = ((m.key & bit) ? 4 : 0) | ((min.key & bit) ? 2 : 0) | ((max.key & bit) ? 1 : 0);
+		switch (code)
+		{
+		case 1: // 0 0 1 : only the lower half can hold keys before m
+			max = Key(((max.key | lower) & ~bit));
+			break;
+		case 3: // 0 1 1 : the whole box is after m
+			return found;
+		case 4: // 1 0 0 : the whole box is before m
+			litmax = max;
+			return true;
+		case 5: // 1 0 1 : the box is split, the lower half is before m
+			litmax = Key(((max.key | lower) & ~bit));
+			found = true;
+			min = Key(((min.key & ~lower) | bit));
+			break;
+		default:
+			break;
+		}
+	}
+	return found;
+}
+
+/*
+Intervals of keys covering the box, sorted and disjoint. The box is split into cells of the curve level by level :
+cells inside the box are finished intervals, merged with the previous one when they touch, and only the cells crossing
+the border of the box are split again, so the work grows with the surface of the box and not its volume.
+When refining the next level would give more than maxRanges intervals, the cells crossing the border are kept whole :
+intervals then also hold some keys outside the box, which callers filter with mortonInBox. maxRanges = 0 means no limit.
+*/
+template<class Key>
+std::vector<morton_range<Key>> mortonBoxRanges(const Key min, const Key max, const size_t maxRanges = 0)
+{
+	typedef morton_range_traits<Key> traits;
+	typedef typename traits::key_type T;
+	const unsigned int D = traits::dims;
+
+	//Finished interval, or cell of the current level crossing the border
+	struct item
+	{
+		T first;
+		T last;
+		bool border;
+	};
+
+	//Smallest cell holding the whole box
+	unsigned int level = static_cast<unsigned int>(mortonHighestBit<T>(min.key ^ max.key) + D) / D;
+	const T first = min.key & ~mortonLowMask<T>(D * level);
+	std::vector<item> items = { { first, first | mortonLowMask<T>(D * level), true } };
+	std::vector<item> next;
+
+	while (level > 0)
+	{
+		//Children of the cells crossing the border. count is the number of intervals once touching items are merged
+		next.clear();
+		size_t count = 0;
+		bool partial = false;
+		auto add = [&](const T f, const T l, const bool border)
+		{
+			const bool touches = !next.empty() && next.back().last + 1 == f;
+			if (!touches)
+				++count;
+			if (touches && !border && !next.back().border)
+				next.back().last = l;
+			else
+				next.push_back({ f, l, border });
+		};
+
+		const unsigned int childLevel = level - 1;
+		const T childSize = mortonLowMask<T>(D * childLevel);
+		for (const item& c : items)
+		{
+			if (maxRanges != 0 && count > maxRanges)
+				break;
+			if (!c.border)
+			{
+				add(c.first, c.last, false);
+				continue;
+			}
+
+			for (unsigned int k = 0; k < (1u << D); ++k)
+			{
+				const T f = c.first | static_cast<T>(k) << (D * childLevel);
+				const T l = f | childSize;
+				bool inside = true, outside = false;
+				for (unsigned int a = 0; a < D; ++a)
+				{
+					const T mask = mortonNd_traits<D, T>::masks.axis[a];
+					inside = inside && (f & mask) >= (min.key & mask) && (l & mask) <= (max.key & mask);
+					outside = outside || (l & mask) < (min.key & mask) || (f & mask) > (max.key & mask);
+				}
+				if (!outside)
+				{
+					add(f, l, !inside);
+					partial = partial || !inside;
+				}
+			}
+		}
+
+		if (maxRanges != 0 && count > maxRanges)
+			break;
+		items.swap(next);
+		level = childLevel;
+		if (!partial)
+			break;
+	}
+
+	std::vector<morton_range<Key>> ranges;
+	for (const item& c : items)
+	{
+		if (!ranges.empty() && ranges.back().last.key + 1 == c.first)
+			ranges.back().last = Key(c.last);
+		else
+			ranges.push_back({ Key(c.first), Key(c.last) });
+	}
+	return ranges;
+}
+
+/*
+Calls f(i) for each key keys[i] of a sorted array inside the box.
+Returns the number of keys read, in the box or not : keys outside the box are skipped with BIGMIN and a binary search.
+*/
+template<class Key, class F>
+size_t mortonBoxQuery(const Key* keys, const size_t n, const Key min, const Key max, const F& f)
+{
+	auto less = [](const Key& a, const Key& b) { return a.key < b.key; };
+	size_t visited = 0;
+	const Key* end = keys + n;
+	const Key* it = std::lower_bound(keys, end, min, less);
+	while (it != end && it->key <= max.key)
+	{
+		++visited;
+		if (mortonInBox(*it, min, max))
+		{
+			f(static_cast<size_t>(it - keys));
+			++it;
+			continue;
+		}
+
+		Key next;
+		if (!mortonBigMin(*it, min, max, next))
+			break;
+		it = std::lower_bound(it + 1, end, next, less);
+	}
+	return visited;
+}
+
+/*
+Keys of a box in the order of the curve, for range-for loops and STL algorithms :
+
+  for (morton3 m : mortonBox(morton3(10, 20, 30), morton3(40, 50, 60))) {}
+  std::vector<morton3> keys(box.begin(), box.end());
+
+No coordinate is encoded. Keys of an aligned block (a quadtree / octree node) inside the box are consecutive : the iterator
+steps through each of them with m + 1. The next block starts after the last key of the current one : the largest node
+starting there is split while it overlaps the border of the box, and skipped when it is outside (the carry of the
+addition moves to the next node of the same or of an upper level). Moving to the next block costs a few comparisons
+per node, where BIGMIN would walk down all the bits of the key, and the iterator needs no stack.
+*/
+template<class Key>
+class morton_box_iterator
+{
+	typedef typename morton_range_traits<Key>::key_type T;
+	static const unsigned int D = morton_range_traits<Key>::dims;
+
+public:
+	typedef std::forward_iterator_tag iterator_category;
+	typedef Key value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const Key* pointer;
+	typedef const Key& reference;
+
+	//End of any box
+	morton_box_iterator() : m(), last(0), min(), max(), levels(0), done(true) {}
+
+	morton_box_iterator(const Key min, const Key max) : m(), last(0), min(min), max(max), done(false)
+	{
+		//Levels of the smallest node holding the box
+		levels = static_cast<unsigned int>(mortonHighestBit<T>(min.key ^ max.key) + D) / D;
+		find(min.key);
+	}
+
+	reference operator*() const { return m; }
+	pointer operator->() const { return &m; }
+
+	morton_box_iterator& operator++()
+	{
+		if (m.key != last)
+			m.key += 1;
+		else if (last >= max.key)
+			done = true;
+		else
+			find(last + 1);
+		return *this;
+	}
+
+	morton_box_iterator operator++(int)
+	{
+		const morton_box_iterator it = *this;
+		++(*this);
+		return it;
+	}
+
+	bool operator==(const morton_box_iterator& other) const
+	{
+		return done == other.done && (done || m.key == other.m.key);
+	}
+
+	bool operator!=(const morton_box_iterator& other) const
+	{
+		return !(*this == other);
+	}
+
+private:
+	/* First block inside the box starting at k or after it */
+	void find(T k)
+	{
+		unsigned int level = aligned(k);
+		for (;;)
+		{
+			const T end = k | mortonLowMask<T>(D * level);
+			bool inside = true, outside = false;
+			for (unsigned int a = 0; a < D; ++a)
+			{
+				const T mask = mortonNd_traits<D, T>::masks.axis[a];
+				const T lo = k & mask, hi = end & mask;
+				outside |= lo > (max.key & mask) || hi < (min.key & mask);
+				inside &= lo >= (min.key & mask) && hi <= (max.key & mask);
+			}
+
+			if (inside)
+			{
+				m = Key(k);
+				last = end;
+				return;
+			}
+			if (!outside)
+			{
+				--level;
+				continue;
+			}
+			//Next node, which can't be inside the box after max
+			if (end >= max.key)
+			{
+				done = true;
+				return;
+			}
+			k = end + 1;
+			level = aligned(k);
+		}
+	}
+
+	/* Level of the largest node starting at k, at most the one holding the box */
+	unsigned int aligned(const T k) const
+	{
+		unsigned int level = 0;
+		while (level < levels && (k & mortonLowMask<T>(D * (level + 1))) == 0)
+			++level;
+		return level;
+	}
+
+	Key m;
+	T last; // Last key of the block holding m
+	Key min, max;
+	unsigned int levels;
+	bool done;
+};
+
+/* Box from min to max, both included */
+template<class Key>
+struct morton_box
+{
+	Key min;
+	Key max;
+
+	morton_box_iterator<Key> begin() const
+	{
+		return empty() ? end() : morton_box_iterator<Key>(min, max);
+	}
+
+	morton_box_iterator<Key> end() const
+	{
+		return morton_box_iterator<Key>();
+	}
+
+	bool empty() const
+	{
+		typedef morton_range_traits<Key> traits;
+		for (unsigned int a = 0; a < traits::dims; ++a)
+		{
+			const typename traits::key_type mask = mortonNd_traits<traits::dims, typename traits::key_type>::masks.axis[a];
+			if ((min.key & mask) > (max.key & mask))
+				return true;
+		}
+		return false;
+	}
+
+	/* Number of keys in the box */
+	uint64_t size() const
+	{
+		typedef morton_range_traits<Key> traits;
+		typedef mortonNd_codec<traits::dims, typename traits::key_type, morton_magicbits> codec;
+		if (empty())
+			return 0;
+		uint64_t lo[traits::dims], hi[traits::dims];
+		codec::decode(min.key, lo);
+		codec::decode(max.key, hi);
+		uint64_t size = 1;
+		for (unsigned int a = 0; a < traits::dims; ++a)
+			size *= hi[a] - lo[a] + 1;
+		return size;
+	}
+};
+
+template<class Key>
+inline morton_box<Key> mortonBox(const Key min, const Key max)
+{
+	return morton_box<Key>{ min, max };
+}
+
+#endif
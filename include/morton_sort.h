@@ -0,0 +1,450 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_SORT_H
+#define MORTON_SORT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "morton2d.h"
+#include "morton3d.h"
+#include "mortonNd.h"
+
+/*
+Radix sorts of morton keys : morton2d, morton3d, mortonNd or raw unsigned keys (uint32_t, uint64_t, morton_uint128).
+
+  mortonSort(keys, n);                    // Stable LSD radix sort, n extra keys of memory
+  mortonSort(keys, payload, n);           // Same, payload[i] follows keys[i]
+  mortonSortPermutation(keys, perm, n);   // keys are left untouched, keys[perm[i]] is sorted
+  mortonSortInPlace(keys, n);             // MSD radix sort without extra memory, not stable
+
+Keys are sorted one byte at a time. Bytes above the highest bit set in any key are skipped, as well as bytes
+which are the same for all keys : 64 x 64 x 64 grids only need 3 passes over 64 bits keys.
+The last parameter is the number of threads : 0 uses all the cores of the host. Small arrays are sorted by a single thread.
+
+Ref : http://stereopsis.com/radix.html
+Ref : https://en.wikipedia.org/wiki/American_flag_sort
+*/
+
+/* Unsigned integer holding the bits of a key */
+template<class T, class C>
+inline T mortonSortKey(const morton2d<T, C>& m)
+{
+	return m.key;
+}
+
+template<class T, class C>
+inline T mortonSortKey(const morton3d<T, C>& m)
+{
+	return m.key;
+}
+
+template<unsigned int D, class T, class C>
+inline T mortonSortKey(const mortonNd<D, T, C>& m)
+{
+	return m.key;
+}
+
+inline uint32_t mortonSortKey(const uint32_t key)
+{
+	return key;
+}
+
+inline uint64_t mortonSortKey(const uint64_t key)
+{
+	return key;
+}
+
+#ifdef __SIZEOF_INT128__
+inline morton_uint128 mortonSortKey(const morton_uint128 key)
+{
+	return key;
+}
+#endif
+
+template<class Key>
+inline unsigned int mortonSortDigit(const Key& k, const unsigned int shift)
+{
+	return static_cast<unsigned int>(mortonSortKey(k) >> shift) & 0xFF;
+}
+
+/* Co-sorting without payload */
+struct morton_sort_nopayload {};
+
+template<class Payload>
+inline void mortonSortMovePayload(Payload* dst, const size_t j, const Payload* src, const size_t i)
+{
+	dst[j] = src[i];
+}
+
+inline void mortonSortMovePayload(morton_sort_nopayload*, const size_t, const morton_sort_nopayload*, const size_t) {}
+
+template<class Payload>
+inline Payload* mortonSortAdvance(Payload* payload, const size_t i)
+{
+	return payload + i;
+}
+
+inline morton_sort_nopayload* mortonSortAdvance(morton_sort_nopayload* payload, const size_t)
+{
+	return payload;
+}
+
+/* Runs f(0) ... f(threads - 1), f(0) on the calling thread */
+template<class F>
+inline void mortonParallelFor(const unsigned int threads, const F& f)
+{
+	std::vector<std::thread> pool;
+	for (unsigned int t = 1; t < threads; ++t)
+		pool.emplace_back(f, t);
+	f(0);
+	for (std::thread& thread : pool)
+		thread.join();
+}
+
+/* Keys per thread under which adding a thread doesn't pay off */
+static const size_t mortonSortGrain = 1 << 16;
+
+inline unsigned int mortonSortThreads(unsigned int threads, const size_t n)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	return static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(threads, n / mortonSortGrain)));
+}
+
+/* Number of bytes up to the highest bit set in any key */
+template<class Key>
+inline unsigned int mortonSortBytes(const Key* keys, const size_t n, const unsigned int threads)
+{
+	typedef decltype(mortonSortKey(keys[0])) T;
+	std::vector<T> bits(threads, 0);
+	mortonParallelFor(threads, [&](const unsigned int t)
+	{
+		T acc = 0;
+		for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+			acc |= mortonSortKey(keys[i]);
+		bits[t] = acc;
+	});
+
+	T acc = 0;
+	for (const T b : bits)
+		acc |= b;
+	unsigned int bytes = 0;
+	for (; acc != 0; acc >>= 8)
+		++bytes;
+	return bytes;
+}
+
+template<class Key>
+inline void mortonSortInsertion(Key* keys, const size_t n)
+{
+	for (size_t i = 1; i < n; ++i)
+	{
+		const Key k = keys[i];
+		size_t j = i;
+		for (; j > 0 && mortonSortKey(k) < mortonSortKey(keys[j - 1]); --j)
+			keys[j] = keys[j - 1];
+		keys[j] = k;
+	}
+}
+
+/*
+Single thread LSD radix sort on the lower bytes of the keys. The counts of all bytes are gathered in a single read,
+and bytes which are the same for all keys are skipped. Keys move back and forth between src and dst,
+and sorted keys are finally copied to out, which is either src or dst.
+*/
+template<class Key, class Payload>
+void mortonSortLSD(Key* src, Key* dst, Payload* payloadSrc, Payload* payloadDst, const size_t n, const unsigned int bytes,
+	Key* out, Payload* payloadOut)
+{
+	typedef decltype(mortonSortKey(src[0])) T;
+	if (n == 0)
+		return;
+
+	size_t counts[sizeof(T)][256] = {};
+	for (size_t i = 0; i < n; ++i)
+	{
+		const T k = mortonSortKey(src[i]);
+		for (unsigned int b = 0; b < bytes; ++b)
+			++counts[b][static_cast<unsigned int>(k >> (8 * b)) & 0xFF];
+	}
+
+	for (unsigned int b = 0; b < bytes; ++b)
+	{
+		size_t* offset = counts[b];
+		if (offset[mortonSortDigit(src[0], 8 * b)] == n)
+			continue;
+
+		size_t total = 0;
+		for (unsigned int d = 0; d < 256; ++d)
+		{
+			const size_t c = offset[d];
+			offset[d] = total;
+			total += c;
+		}
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			const Key k = src[i];
+			const size_t j = offset[mortonSortDigit(k, 8 * b)]++;
+			dst[j] = k;
+			mortonSortMovePayload(payloadDst, j, payloadSrc, i);
+		}
+		std::swap(src, dst);
+		std::swap(payloadSrc, payloadDst);
+	}
+
+	if (src != out)
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			out[i] = src[i];
+			mortonSortMovePayload(payloadOut, i, payloadSrc, i);
+		}
+	}
+}
+
+/*
+Stable radix sort. Large arrays are first split on their highest byte, each thread scattering its slice
+of the array to the positions given by the counts of all threads. The buckets, which mostly fit in cache,
+are then sorted in parallel with mortonSortLSD on the remaining bytes.
+tmp and payloadTmp are buffers of n elements.
+*/
+template<class Key, class Payload>
+void mortonSortStable(Key* keys, Key* tmp, Payload* payload, Payload* payloadTmp, const size_t n, unsigned int threads)
+{
+	threads = mortonSortThreads(threads, n);
+	const unsigned int bytes = mortonSortBytes(keys, n, threads);
+	if (bytes <= 1 || n < mortonSortGrain)
+	{
+		mortonSortLSD(keys, tmp, payload, payloadTmp, n, bytes, keys, payload);
+		return;
+	}
+
+	const unsigned int shift = 8 * (bytes - 1);
+	std::vector<size_t> counts(threads * 256);
+	mortonParallelFor(threads, [&](const unsigned int t)
+	{
+		size_t count[256] = {};
+		for (size_t i = n * t / threads, end = n * (t + 1) / threads; i < end; ++i)
+			++count[mortonSortDigit(keys[i], shift)];
+		std::copy(count, count + 256, &counts[t * 256]);
+	});
+
+	//Exclusive prefix sum, digit major then thread
+	size_t begin[257];
+	size_t total = 0;
+	for (unsigned int d = 0; d < 256; ++d)
+	{
+		begin[d] = total;
+		for (unsigned int t = 0; t < threads; ++t)
+		{
+			const size_t c = counts[t * 256 + d];
+			counts[t * 256 + d] = total;
+			total += c;
+		}
+	}
+	begin[256] = n;
+
+	mortonParallelFor(threads, [&](const unsigned int t)
+	{
+		size_t offset[256];
+		std::copy(&counts[t * 256], &counts[t * 256] + 256, offset);
+		for (size_t i = n * t / threads, end = n * (t + 1) / threads; i < end; ++i)
+		{
+			const Key k = keys[i];
+			const size_t j = offset[mortonSortDigit(k, shift)]++;
+			tmp[j] = k;
+			mortonSortMovePayload(payloadTmp, j, payload, i);
+		}
+	});
+
+	//Buckets are handed out to threads, largest first
+	std::vector<unsigned int> order(256);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](const unsigned int a, const unsigned int b) { return begin[a + 1] - begin[a] > begin[b + 1] - begin[b]; });
+	std::atomic<unsigned int> next(0);
+	mortonParallelFor(threads, [&](const unsigned int)
+	{
+		for (unsigned int i = next++; i < 256; i = next++)
+		{
+			const size_t b = begin[order[i]];
+			const size_t count = begin[order[i] + 1] - b;
+			mortonSortLSD(tmp + b, keys + b, mortonSortAdvance(payloadTmp, b), mortonSortAdvance(payload, b), count, bytes - 1,
+				keys + b, mortonSortAdvance(payload, b));
+		}
+	});
+}
+
+/*
+Moves keys into the 256 buckets of their byte at shift (American flag sort) : keys are swapped
+into their bucket following permutation cycles. count[d] is the number of keys in bucket d.
+*/
+template<class Key>
+void mortonSortPartition(Key* keys, const size_t* count, const unsigned int shift)
+{
+	size_t head[256], tail[256];
+	size_t total = 0;
+	for (unsigned int d = 0; d < 256; ++d)
+	{
+		head[d] = total;
+		total += count[d];
+		tail[d] = total;
+	}
+
+	for (unsigned int d = 0; d < 256; ++d)
+	{
+		while (head[d] < tail[d])
+		{
+			Key k = keys[head[d]];
+			unsigned int digit = mortonSortDigit(k, shift);
+			while (digit != d)
+			{
+				std::swap(k, keys[head[digit]++]);
+				digit = mortonSortDigit(k, shift);
+			}
+			keys[head[d]++] = k;
+		}
+	}
+}
+
+/* In place MSD radix sort of keys whose bytes above shift are all equal */
+template<class Key>
+void mortonSortMSD(Key* keys, const size_t n, unsigned int shift)
+{
+	for (;;)
+	{
+		if (n <= 64)
+		{
+			mortonSortInsertion(keys, n);
+			return;
+		}
+
+		size_t count[256] = {};
+		for (size_t i = 0; i < n; ++i)
+			++count[mortonSortDigit(keys[i], shift)];
+
+		//Same byte everywhere : go straight to the next one
+		if (count[mortonSortDigit(keys[0], shift)] == n)
+		{
+			if (shift == 0)
+				return;
+			shift -= 8;
+			continue;
+		}
+
+		mortonSortPartition(keys, count, shift);
+		if (shift == 0)
+			return;
+
+		size_t begin = 0;
+		for (unsigned int d = 0; d < 256; ++d)
+		{
+			if (count[d] > 1)
+				mortonSortMSD(keys + begin, count[d], shift - 8);
+			begin += count[d];
+		}
+		return;
+	}
+}
+
+/* Stable LSD radix sort of n keys, with n extra keys of memory */
+template<class Key>
+void mortonSort(Key* keys, const size_t n, const unsigned int threads = 0)
+{
+	std::vector<Key> tmp(n);
+	mortonSortStable(keys, tmp.data(), static_cast<morton_sort_nopayload*>(nullptr), static_cast<morton_sort_nopayload*>(nullptr), n, threads);
+}
+
+/* Stable LSD radix sort, payload[i] is moved along with keys[i] */
+template<class Key, class Payload>
+void mortonSort(Key* keys, Payload* payload, const size_t n, const unsigned int threads = 0)
+{
+	std::vector<Key> tmp(n);
+	std::vector<Payload> payloadTmp(n);
+	mortonSortStable(keys, tmp.data(), payload, payloadTmp.data(), n, threads);
+}
+
+/* Stable sorting permutation : keys[perm[0]] <= keys[perm[1]] <= ... keys are not modified.
+Index is an unsigned integer type able to hold n - 1 */
+template<class Key, class Index>
+void mortonSortPermutation(const Key* keys, Index* perm, const size_t n, const unsigned int threads = 0)
+{
+	std::vector<Key> sorted(keys, keys + n);
+	for (size_t i = 0; i < n; ++i)
+		perm[i] = static_cast<Index>(i);
+	mortonSort(sorted.data(), perm, n, threads);
+}
+
+/*
+In place radix sort, for memory tight runs : not stable.
+The first byte is split by a single thread, the 256 buckets are then sorted in parallel.
+*/
+template<class Key>
+void mortonSortInPlace(Key* keys, const size_t n, unsigned int threads = 0)
+{
+	threads = mortonSortThreads(threads, n);
+	const unsigned int bytes = mortonSortBytes(keys, n, threads);
+	if (bytes == 0)
+		return;
+	const unsigned int shift = 8 * (bytes - 1);
+
+	if (threads == 1 || shift == 0)
+	{
+		mortonSortMSD(keys, n, shift);
+		return;
+	}
+
+	//Split on the highest byte
+	size_t count[256] = {};
+	for (size_t i = 0; i < n; ++i)
+		++count[mortonSortDigit(keys[i], shift)];
+	mortonSortPartition(keys, count, shift);
+	size_t begin[256];
+	std::partial_sum(count, count + 255, begin + 1);
+	begin[0] = 0;
+
+	//Buckets are handed out to threads, largest first
+	std::vector<unsigned int> order(256);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](const unsigned int a, const unsigned int b) { return count[a] > count[b]; });
+	std::atomic<unsigned int> next(0);
+	mortonParallelFor(threads, [&](const unsigned int)
+	{
+		for (unsigned int i = next++; i < 256; i = next++)
+		{
+			const unsigned int d = order[i];
+			if (count[d] > 1)
+				mortonSortMSD(keys + begin[d], count[d], shift - 8);
+		}
+	});
+}
+
+#endif
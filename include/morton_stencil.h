@@ -0,0 +1,147 @@
+/*
+The MIT License(MIT)
+
+Copyright(c) 2015 Alexandre Avenel
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files(the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORTON_STENCIL_H
+#define MORTON_STENCIL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "morton_neighbors.h"
+#include "morton_sort.h"
+
+/*
+Stencils over a volume stored in morton order : in[m.key] is the cell m of a grid of size^3 cells, size a power of 2.
+
+  mortonStencil<6>(in, out, size, [](float c, const float (&n)[6]) { return c + 0.1f * (n[0] + n[1] + n[2] + n[3] + n[4] + n[5] - 6 * c); },
+    MORTON_BOUNDARY_CLAMP);
+
+f receives a cell and its N neighbors (6, 18 or 26, in the order of mortonNeighborhood<3, N>.offset) and returns the new value
+of the cell. With MORTON_BOUNDARY_SKIP, neighbors outside the grid read as T().
+The grid is split in morton aligned blocks of 16^3 cells (8^3 for types larger than 4 bytes), which are contiguous ranges of keys.
+Each block and its halo are copied into a small row major buffer which stays in L1, where f is applied, so coordinates are never
+encoded : the keys of a row of the block are the keys of its first cell moved with tesseral increments.
+Blocks are split between threads (0 : all cores) as contiguous runs of the curve.
+*/
+
+/* Keys of one axis for the cells [-1, side] of a block starting at the key part p, after the boundary rule (inside[i] is false for skipped cells) */
+inline void mortonStencilAxis(const unsigned int a, const uint64_t p, const uint64_t max, const morton_boundary boundary, const uint32_t side,
+	uint64_t* part, bool* inside)
+{
+	const uint64_t mask = mortonNd_traits<3, uint64_t>::masks.axis[a];
+	const uint64_t one = 4 >> a;
+	const uint64_t top = max & mask;
+	part[1] = p;
+	for (uint32_t i = 2; i <= side; ++i)
+		part[i] = ((part[i - 1] | ~mask) + one) & mask;
+	for (uint32_t i = 0; i <= side + 1; ++i)
+		inside[i] = true;
+
+	//Cells before and after the block, from the keys of its first and last cells
+	uint64_t below[3][3], above[3][3];
+	mortonNeighborParts<3, 6>(p, max, boundary, below);
+	mortonNeighborParts<3, 6>(part[side], max, boundary, above);
+	part[0] = below[a][0];
+	part[side + 1] = above[a][2];
+	inside[0] = boundary != MORTON_BOUNDARY_SKIP || p != 0;
+	inside[side + 1] = boundary != MORTON_BOUNDARY_SKIP || part[side] < top;
+}
+
+template<unsigned int N, class T, class F>
+inline void mortonStencilBlock(const T* in, T* out, const uint64_t first, const uint64_t max, const morton_boundary boundary, const uint32_t side,
+	const int (&offset)[N], const F& f, T* buffer)
+{
+	//Keys of each axis of the block and its halo
+	const uint32_t h = side + 2;
+	uint64_t part[3][16 + 2];
+	bool inside[3][16 + 2];
+	for (unsigned int a = 0; a < 3; ++a)
+		mortonStencilAxis(a, first & mortonNd_traits<3, uint64_t>::masks.axis[a], max, boundary, side, part[a], inside[a]);
+
+	for (uint32_t x = 0; x < h; ++x)
+		for (uint32_t y = 0; y < h; ++y)
+		{
+			T* row = buffer + (x * h + y) * h;
+			const uint64_t xy = part[0][x] | part[1][y];
+			if (!inside[0][x] || !inside[1][y])
+			{
+				std::fill(row, row + h, T());
+				continue;
+			}
+			for (uint32_t z = 0; z < h; ++z)
+				row[z] = inside[2][z] ? in[xy | part[2][z]] : T();
+		}
+
+	T values[N];
+	for (uint32_t x = 1; x <= side; ++x)
+		for (uint32_t y = 1; y <= side; ++y)
+		{
+			const T* row = buffer + (x * h + y) * h;
+			const uint64_t xy = part[0][x] | part[1][y];
+			for (int z = 1; z <= static_cast<int>(side); ++z)
+			{
+				for (unsigned int j = 0; j < N; ++j)
+					values[j] = row[z + offset[j]];
+				out[xy | part[2][z]] = f(row[z], values);
+			}
+		}
+}
+
+template<unsigned int N, class T, class F>
+inline void mortonStencil(const T* in, T* out, const uint32_t size, const F& f, const morton_boundary boundary, unsigned int threads = 0)
+{
+	assert(size != 0 && (size & (size - 1)) == 0 && in != out);
+	unsigned int levels = 0;
+	while ((1u << levels) < size)
+		++levels;
+	const unsigned int blockLevels = std::min(levels, sizeof(T) <= 4 ? 4u : 3u);
+	const uint64_t blockCells = 1ull << (3 * blockLevels);
+	const uint64_t blocks = (1ull << (3 * levels)) / blockCells;
+	const uint32_t side = 1u << blockLevels, h = side + 2;
+	const uint64_t max = morton3(size - 1, size - 1, size - 1).key;
+
+	//Offsets of the neighbors in the buffer of a block
+	int offset[N];
+	for (unsigned int j = 0; j < N; ++j)
+	{
+		const int (&o)[3] = mortonNeighborhood<3, N>.offset[j];
+		offset[j] = (o[0] * static_cast<int>(h) + o[1]) * static_cast<int>(h) + o[2];
+	}
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = static_cast<unsigned int>(std::min<uint64_t>(threads, blocks));
+
+	mortonParallelFor(threads, [&](const unsigned int t)
+	{
+		std::vector<T> buffer(h * h * h);
+		for (uint64_t b = blocks * t / threads; b < blocks * (t + 1) / threads; ++b)
+			mortonStencilBlock<N>(in, out, b * blockCells, max, boundary, side, offset, f, buffer.data());
+	});
+}
+
+#endif
@@ -10,6 +10,20 @@
 #include <chrono>
 
 #include "grids.h"
+#include "../include/morton_batch.h"
+#include "../include/mortonNd.h"
+#include "../include/morton_quantizer.h"
+#include "../include/morton_sort.h"
+#include "../include/morton_range.h"
+#include "../include/morton_octree.h"
+#include "../include/morton_hashgrid.h"
+#include "../include/morton_knn.h"
+#include "../include/morton_lbvh.h"
+#include "../include/morton_neighbors.h"
+#include "../include/morton_stencil.h"
+#include "../include/morton_file.h"
+#include "../include/morton_external_sort.h"
+#include "../include/morton_packed.h"
 
 struct Profiler
 {
@@ -17,8 +31,9 @@ private:
   std::string name;
   std::chrono::high_resolution_clock::time_point t_start;
   bool exportCSV;
+  double keys;
 public:
-  Profiler(std::string name, bool exportCSV = false) : name(name), exportCSV(exportCSV)
+  Profiler(std::string name, bool exportCSV = false, double keys = 0) : name(name), exportCSV(exportCSV), keys(keys)
   {
     t_start = std::chrono::high_resolution_clock::now();
   };
@@ -29,7 +44,11 @@ public:
     auto duration = std::chrono::duration<double, std::milli>(t_end - t_start).count();
     if (!exportCSV)
     {
-      std::cout << name << " : " << duration << "ms" << std::endl;
+      std::cout << name << " : " << duration << "ms";
+      //Throughput, in millions of keys per second
+      if (keys > 0)
+        std::cout << " (" << keys / (duration * 1e3) << " Mkeys/s)";
+      std::cout << std::endl;
     }
     else
     {
@@ -39,6 +58,7 @@ public:
 };
 
 #define BEGINPROFILE(name) { Profiler p(name, false);
+#define BEGINPROFILE_KEYS(name, keys) { Profiler p(name, false, keys);
 #define ENDPROFILE }
 
 
@@ -298,6 +318,39 @@ void benchmark2d(const int gridsize = 64, const int iMax = 1e8)
   }
   ENDPROFILE
 
+  BEGINPROFILE("Morton  2d grid get() random + 8 neighbors mortonNeighbors")
+  volatile gridType r;
+  int x, y;
+  const morton2 max(gridsize - 1, gridsize - 1);
+  morton2 neighbors[8];
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 2];
+    y = random_pool[i * 2 + 1];
+
+    const morton2 mkey(x, y);
+    r = gm.get(mkey);
+    const unsigned int count = mortonNeighbors<8>(mkey, max, neighbors, MORTON_BOUNDARY_SKIP);
+    for (unsigned int n = 0; n < count; ++n)
+      r = gm.get(neighbors[n]);
+  }
+  ENDPROFILE
+
+  BEGINPROFILE("Morton  2d grid get() random + 8 neighbors mortonForEachNeighbor")
+  volatile gridType r;
+  int x, y;
+  const morton2 max(gridsize - 1, gridsize - 1);
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 2];
+    y = random_pool[i * 2 + 1];
+
+    const morton2 mkey(x, y);
+    r = gm.get(mkey);
+    mortonForEachNeighbor<8>(mkey, max, MORTON_BOUNDARY_SKIP, [&](const morton2 n) { r = gm.get(n); });
+  }
+  ENDPROFILE
+
 #ifdef USE_BMI2
   BEGINPROFILE("Morton  2d grid get() random + 8 neighbors C")
   volatile gridType r;
@@ -361,6 +414,8 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
   typedef uint64_t gridType;
   Grid3d<gridType> g = Grid3d<gridType>(gridsize);
   MortonGrid3d<gridType> gm = MortonGrid3d<gridType>(gridsize);
+  BrickGrid3d<gridType, 4> gb = BrickGrid3d<gridType, 4>(gridsize);
+  typedef BrickGrid3d<gridType, 4> brick;
 
   BEGINPROFILE("Classic 3d grid get() linear")
   volatile gridType r;
@@ -389,6 +444,34 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
   }
   ENDPROFILE
 
+  BEGINPROFILE("Brick   3d grid get() linear")
+  volatile gridType r;
+  for (int it = 0; it < iMax / (gridsize*gridsize*gridsize); ++it)
+  {
+    for (int i = 0; i < gridsize; ++i)
+      for (int j = 0; j < gridsize; ++j)
+        for (int k = 0; k < gridsize; ++k)
+        {
+          r = gb.get(i, j, k);
+        }
+  }
+  ENDPROFILE
+
+  BEGINPROFILE("Brick   3d grid row() linear")
+  volatile gridType r;
+  for (int it = 0; it < iMax / (gridsize*gridsize*gridsize); ++it)
+  {
+    for (int i = 0; i < gridsize; ++i)
+      for (int j = 0; j < gridsize; ++j)
+        for (int k = 0; k < gridsize; k += 4)
+        {
+          //Rows of a brick are contiguous : one (vectorizable) sum per row
+          const gridType* row = gb.row(i, j, k);
+          r = row[0] + row[1] + row[2] + row[3];
+        }
+  }
+  ENDPROFILE
+
   srand(42);
   std::vector<int> random_pool;
   random_pool.resize(iMax * 3);
@@ -419,6 +502,18 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
   }
   ENDPROFILE
 
+  BEGINPROFILE("Brick   3d grid get() random")
+  volatile gridType r;
+  int x, y, z;
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 3];
+    y = random_pool[i * 3 + 1];
+    z = random_pool[i * 3 + 2];
+    r = gb.get(x, y, z);
+  }
+  ENDPROFILE
+
   BEGINPROFILE("Classic 3d grid get() linear non cache friendly")
   volatile gridType r;
   for (int it = 0; it < iMax / (gridsize*gridsize*gridsize); ++it)
@@ -453,6 +548,23 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
   }
   ENDPROFILE
 
+  BEGINPROFILE("Brick   3d grid get() linear non cache friendly")
+  volatile gridType r;
+  for (int it = 0; it < iMax / (gridsize*gridsize*gridsize); ++it)
+  {
+    for (int i = 0; i < gridsize; ++i)
+    {
+      for (int j = 0; j < gridsize; ++j)
+      {
+        for (int k = 0; k < gridsize; ++k)
+        {
+          r = gb.get(k, j, i);
+        }
+      }
+    }
+  }
+  ENDPROFILE
+
   BEGINPROFILE("Classic 3d grid get() random + 6 neighbors")
   volatile gridType r;
   int x, y, z;
@@ -505,6 +617,33 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
   }
   ENDPROFILE
 
+  BEGINPROFILE("Brick   3d grid get() random + 6 neighbors")
+  volatile gridType r;
+  int x, y, z;
+  uint64_t bkey;
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 3];
+    y = random_pool[i * 3 + 1];
+    z = random_pool[i * 3 + 2];
+    bkey = brick::index(x, y, z);
+    r = gb.get(bkey);
+    //Neighbors
+    if (z - 1 >= 0)
+      r = gb.get(brick::decZ(bkey));
+    if (z + 1 < gridsize)
+      r = gb.get(brick::incZ(bkey));
+    if (y + 1 < gridsize)
+      r = gb.get(brick::incY(bkey));
+    if (y - 1 >= 0)
+      r = gb.get(brick::decY(bkey));
+    if (x + 1 < gridsize)
+      r = gb.get(brick::incX(bkey));
+    if (x - 1 >= 0)
+      r = gb.get(brick::decX(bkey));
+  }
+  ENDPROFILE
+
   BEGINPROFILE("Classic 3d grid get() random + 26 neighbors")
   volatile gridType r;
   int x, y, z;
@@ -681,6 +820,83 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
   }
   ENDPROFILE
 
+  BEGINPROFILE("Morton  3d grid get() random + 26 neighbors mortonNeighbors")
+  volatile gridType r;
+  int x, y, z;
+  const morton3 max(gridsize - 1, gridsize - 1, gridsize - 1);
+  morton3 neighbors[26];
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 3];
+    y = random_pool[i * 3 + 1];
+    z = random_pool[i * 3 + 2];
+
+    const morton3 mkey(x, y, z);
+    r = gm.get(mkey);
+    const unsigned int count = mortonNeighbors<26>(mkey, max, neighbors, MORTON_BOUNDARY_SKIP);
+    for (unsigned int n = 0; n < count; ++n)
+      r = gm.get(neighbors[n]);
+  }
+  ENDPROFILE
+
+  BEGINPROFILE("Morton  3d grid get() random + 26 neighbors mortonForEachNeighbor")
+  volatile gridType r;
+  int x, y, z;
+  const morton3 max(gridsize - 1, gridsize - 1, gridsize - 1);
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 3];
+    y = random_pool[i * 3 + 1];
+    z = random_pool[i * 3 + 2];
+
+    const morton3 mkey(x, y, z);
+    r = gm.get(mkey);
+    mortonForEachNeighbor<26>(mkey, max, MORTON_BOUNDARY_SKIP, [&](const morton3 n) { r = gm.get(n); });
+  }
+  ENDPROFILE
+
+  BEGINPROFILE("Morton  3d grid get() random + 26 neighbors neighbors3d")
+  volatile gridType r;
+  const size_t block = 256;
+  const morton3 max(gridsize - 1, gridsize - 1, gridsize - 1);
+  std::vector<uint64_t> keys(block), neighbors(26 * block);
+  std::vector<uint32_t> valid(block);
+  for (int i = 0; i + static_cast<int>(block) <= iMax; i += block)
+  {
+    for (size_t k = 0; k < block; ++k)
+      keys[k] = morton3(random_pool[(i + k) * 3], random_pool[(i + k) * 3 + 1], random_pool[(i + k) * 3 + 2]).key;
+    neighbors3d<26>(keys.data(), max, MORTON_BOUNDARY_SKIP, neighbors.data(), block, valid.data());
+    for (size_t k = 0; k < block; ++k)
+    {
+      r = gm.get(morton3(keys[k]));
+      for (unsigned int n = 0; n < 26; ++n)
+        if (valid[k] & (1u << n))
+          r = gm.get(morton3(neighbors[n * block + k]));
+    }
+  }
+  ENDPROFILE
+
+  BEGINPROFILE("Brick   3d grid get() random + 26 neighbors")
+  volatile gridType r;
+  int x, y, z;
+  for (int i = 0; i < iMax; i++)
+  {
+    x = random_pool[i * 3];
+    y = random_pool[i * 3 + 1];
+    z = random_pool[i * 3 + 2];
+
+    //Bits of each axis of the index of the 3 cells along that axis, combined like the keys of the classic grid
+    const uint64_t bkey = brick::index(x, y, z);
+    const uint64_t xpart[3] = { brick::decX(bkey) & brick::xMask, bkey & brick::xMask, brick::incX(bkey) & brick::xMask };
+    const uint64_t ypart[3] = { brick::decY(bkey) & brick::yMask, bkey & brick::yMask, brick::incY(bkey) & brick::yMask };
+    const uint64_t zpart[3] = { brick::decZ(bkey) & brick::zMask, bkey & brick::zMask, brick::incZ(bkey) & brick::zMask };
+    for (int xx = ((x - 1 >= 0) ? 0 : 1); xx < ((x + 1 < gridsize) ? 3 : 2); ++xx)
+      for (int yy = ((y - 1 >= 0) ? 0 : 1); yy < ((y + 1 < gridsize) ? 3 : 2); ++yy)
+        for (int zz = ((z - 1 >= 0) ? 0 : 1); zz < ((z + 1 < gridsize) ? 3 : 2); ++zz)
+          r = gb.get(xpart[xx] | ypart[yy] | zpart[zz]);
+  }
+  ENDPROFILE
+
 #ifdef USE_BMI2
   BEGINPROFILE("Morton  3d grid get() random + 26 neighbors C")
   volatile gridType r;
@@ -810,4 +1026,1355 @@ void benchmark3d(const int gridsize = 64, const int iMax= 1e8)
 
 }
 
+template<class Codec>
+void benchmarkCodec(const std::string& name, const std::vector<uint32_t>& coords, const int n)
+{
+  BEGINPROFILE_KEYS("Morton  2d encode " + name, n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = morton2d<uint64_t, Codec>(coords[i * 3], coords[i * 3 + 1]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d encode " + name, n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = morton3d<uint64_t, Codec>(coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2]).key;
+  ENDPROFILE
+
+  //Coordinates are used as random keys
+  BEGINPROFILE_KEYS("Morton  2d decode " + name, n)
+  volatile uint64_t r;
+  uint64_t x, y;
+  for (int i = 0; i < n; ++i)
+  {
+    morton2d<uint64_t, Codec>(static_cast<uint64_t>(coords[i * 3]) << 32 | coords[i * 3 + 1]).decode(x, y);
+    r = x + y;
+  }
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d decode " + name, n)
+  volatile uint64_t r;
+  uint64_t x, y, z;
+  for (int i = 0; i < n; ++i)
+  {
+    morton3d<uint64_t, Codec>(static_cast<uint64_t>(coords[i * 3]) << 32 | coords[i * 3 + 1]).decode(x, y, z);
+    r = x + y + z;
+  }
+  ENDPROFILE
+}
+
+void benchmarkCodecs(const int n = 1e7)
+{
+  std::cout << "Selected codec : " << mortonCodecName(mortonCodec()) << std::endl;
+
+  srand(42);
+  std::vector<uint32_t> coords(n * 3);
+  std::generate(coords.begin(), coords.end(), [&](){ return rand() % 0x1fffff; });
+
+  benchmarkCodec<morton_dispatch>("selected codec", coords, n);
+  if (mortonCpu().bmi2)
+    benchmarkCodec<morton_bmi2>("BMI2", coords, n);
+  benchmarkCodec<morton_lut8>("LUT 8 bits", coords, n);
+  benchmarkCodec<morton_lut16>("LUT 16 bits", coords, n);
+  benchmarkCodec<morton_magicbits>("magic bits", coords, n);
+
+  //Coordinates lower than 256
+  std::vector<uint32_t> smallCoords(n * 3);
+  std::generate(smallCoords.begin(), smallCoords.end(), [&](){ return rand() % 256; });
+  benchmarkCodec<morton_dispatch>("selected codec (< 256)", smallCoords, n);
+  benchmarkCodec<morton_lut256>("LUT 256 (< 256)", smallCoords, n);
+}
+
+void benchmarkNd(const int n = 1e7)
+{
+  srand(42);
+  std::vector<uint32_t> coords(n * 4);
+  std::generate(coords.begin(), coords.end(), [&](){ return rand() % 0xffff; });
+
+  BEGINPROFILE_KEYS("Morton  3d encode morton3", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = morton3(coords[i * 4], coords[i * 4 + 1], coords[i * 4 + 2]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d encode mortonNd<3>", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = mortonNd<3>(coords[i * 4], coords[i * 4 + 1], coords[i * 4 + 2]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  4d encode", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = morton4(coords[i * 4], coords[i * 4 + 1], coords[i * 4 + 2], coords[i * 4 + 3]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  4d encode magic bits", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = mortonNd<4, uint64_t, morton_magicbits>(coords[i * 4], coords[i * 4 + 1], coords[i * 4 + 2], coords[i * 4 + 3]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  4d decode", n)
+  volatile uint64_t r;
+  uint64_t c[4];
+  for (int i = 0; i < n; ++i)
+  {
+    morton4(coords[i * 4]).decode(c);
+    r = c[0] + c[1] + c[2] + c[3];
+  }
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  4d add + inc", n)
+  morton4 m = morton4(0, 0, 0, 0);
+  for (int i = 0; i < n; ++i)
+    m = (m + morton4(coords[i * 4])).inc(3);
+  volatile uint64_t r = m.key;
+  ENDPROFILE
+}
+
+void benchmarkBatch(const int n = 1e7)
+{
+  srand(42);
+  std::vector<uint32_t> x(n), y(n), z(n), xd(n), yd(n), zd(n);
+  std::vector<uint64_t> keys(n);
+  std::generate(x.begin(), x.end(), [&](){ return rand() % 0x1fffff; });
+  std::generate(y.begin(), y.end(), [&](){ return rand() % 0x1fffff; });
+  std::generate(z.begin(), z.end(), [&](){ return rand() % 0x1fffff; });
+
+  BEGINPROFILE_KEYS("Batch 2d encode scalar", n)
+  encode2d_scalar(x.data(), y.data(), keys.data(), n);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 2d decode scalar", n)
+  decode2d_scalar(keys.data(), xd.data(), yd.data(), n);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 2d decode SSE2", n)
+  decode2d_sse2(keys.data(), xd.data(), yd.data(), n);
+  ENDPROFILE
+
+  if (mortonCpu().avx2)
+  {
+    BEGINPROFILE_KEYS("Batch 2d encode AVX2", n)
+    encode2d_avx2(x.data(), y.data(), keys.data(), n);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Batch 2d decode AVX2", n)
+    decode2d_avx2(keys.data(), xd.data(), yd.data(), n);
+    ENDPROFILE
+  }
+
+  if (mortonCpu().avx512f)
+  {
+    BEGINPROFILE_KEYS("Batch 2d encode AVX-512", n)
+    encode2d_avx512(x.data(), y.data(), keys.data(), n);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Batch 2d decode AVX-512", n)
+    decode2d_avx512(keys.data(), xd.data(), yd.data(), n);
+    ENDPROFILE
+  }
+
+  BEGINPROFILE_KEYS("Batch 3d encode scalar", n)
+  encode3d_scalar(x.data(), y.data(), z.data(), keys.data(), n);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 3d decode scalar", n)
+  decode3d_scalar(keys.data(), xd.data(), yd.data(), zd.data(), n);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 3d decode SSE2", n)
+  decode3d_sse2(keys.data(), xd.data(), yd.data(), zd.data(), n);
+  ENDPROFILE
+
+  if (mortonCpu().avx2)
+  {
+    BEGINPROFILE_KEYS("Batch 3d encode AVX2", n)
+    encode3d_avx2(x.data(), y.data(), z.data(), keys.data(), n);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Batch 3d decode AVX2", n)
+    decode3d_avx2(keys.data(), xd.data(), yd.data(), zd.data(), n);
+    ENDPROFILE
+  }
+
+  if (mortonCpu().avx512f)
+  {
+    BEGINPROFILE_KEYS("Batch 3d encode AVX-512", n)
+    encode3d_avx512(x.data(), y.data(), z.data(), keys.data(), n);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Batch 3d decode AVX-512", n)
+    decode3d_avx512(keys.data(), xd.data(), yd.data(), zd.data(), n);
+    ENDPROFILE
+  }
+}
+
+#ifdef __SIZEOF_INT128__
+void benchmarkBatchArithmetic(const int n = 1e7)
+{
+  srand(42);
+  std::vector<uint64_t> keys(n), out(n);
+  std::generate(keys.begin(), keys.end(), [&](){ return static_cast<uint64_t>(rand()) << 42 ^ static_cast<uint64_t>(rand()) << 21 ^ rand(); });
+  const morton3 offset = morton3(1, 0x1fffff, 2);
+  const morton3 lo = morton3(1000, 2000, 3000), hi = morton3(1000000, 1500000, 2000000);
+
+  BEGINPROFILE_KEYS("Morton  3d add loop", n)
+  for (int i = 0; i < n; ++i)
+    out[i] = (morton3(keys[i]) + offset).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 3d add scalar", n)
+  addKeys_scalar(morton3dAxes, keys.data(), offset.key, out.data(), n);
+  ENDPROFILE
+
+  if (mortonCpu().avx2)
+  {
+    BEGINPROFILE_KEYS("Batch 3d add AVX2", n)
+    addKeys_avx2(morton3dAxes, keys.data(), offset.key, out.data(), n);
+    ENDPROFILE
+  }
+
+  if (mortonCpu().avx512f)
+  {
+    BEGINPROFILE_KEYS("Batch 3d add AVX-512", n)
+    addKeys_avx512(morton3dAxes, keys.data(), offset.key, out.data(), n);
+    ENDPROFILE
+  }
+
+  BEGINPROFILE_KEYS("Morton  3d clamp loop", n)
+  for (int i = 0; i < n; ++i)
+    out[i] = morton3::min(morton3::max(morton3(keys[i]), lo), hi).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 3d clamp scalar", n)
+  clampKeys_scalar(morton3dAxes, keys.data(), lo.key, hi.key, out.data(), n);
+  ENDPROFILE
+
+  if (mortonCpu().avx2)
+  {
+    BEGINPROFILE_KEYS("Batch 3d clamp AVX2", n)
+    clampKeys_avx2(morton3dAxes, keys.data(), lo.key, hi.key, out.data(), n);
+    ENDPROFILE
+  }
+
+  if (mortonCpu().avx512f)
+  {
+    BEGINPROFILE_KEYS("Batch 3d clamp AVX-512", n)
+    clampKeys_avx512(morton3dAxes, keys.data(), lo.key, hi.key, out.data(), n);
+    ENDPROFILE
+  }
+
+  BEGINPROFILE_KEYS("Morton  3d incY loop", n)
+  for (int i = 0; i < n; ++i)
+    out[i] = morton3(keys[i]).incY().key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Batch 3d incY", n)
+  inc3d(keys.data(), 1, out.data(), n);
+  ENDPROFILE
+}
+
+void benchmarkQuantizer(const int n = 1e7)
+{
+  srand(42);
+  std::vector<float> x(n), y(n), z(n);
+  std::vector<uint32_t> cx(n), cy(n), cz(n);
+  std::vector<uint64_t> keys(n);
+  std::generate(x.begin(), x.end(), [&](){ return 100.f * rand() / RAND_MAX; });
+  std::generate(y.begin(), y.end(), [&](){ return 100.f * rand() / RAND_MAX; });
+  std::generate(z.begin(), z.end(), [&](){ return 100.f * rand() / RAND_MAX; });
+  const morton3d_quantizer<float> q({ 0.f, 0.f, 0.f }, { 100.f, 100.f, 100.f }, 21);
+
+  BEGINPROFILE_KEYS("Quantize then batch encode3d", n)
+  for (int i = 0; i < n; ++i)
+  {
+    cx[i] = q.axes[0].quantize(x[i]);
+    cy[i] = q.axes[1].quantize(y[i]);
+    cz[i] = q.axes[2].quantize(z[i]);
+  }
+  encode3d(cx.data(), cy.data(), cz.data(), keys.data(), n);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Quantizer 3d encode scalar", n)
+  q.encode_scalar(x.data(), y.data(), z.data(), keys.data(), n);
+  ENDPROFILE
+
+  if (mortonCpu().avx2)
+  {
+    BEGINPROFILE_KEYS("Quantizer 3d encode AVX2", n)
+    q.encode_avx2(x.data(), y.data(), z.data(), keys.data(), n);
+    ENDPROFILE
+  }
+
+  if (mortonCpu().avx512f)
+  {
+    BEGINPROFILE_KEYS("Quantizer 3d encode AVX-512", n)
+    q.encode_avx512(x.data(), y.data(), z.data(), keys.data(), n);
+    ENDPROFILE
+  }
+
+  BEGINPROFILE_KEYS("Quantizer 3d decode", n)
+  q.decode(keys.data(), x.data(), y.data(), z.data(), n);
+  ENDPROFILE
+}
+
+/* C++14 has no parallel std::sort : slices are sorted by one thread each, then merged pairwise in parallel */
+template<class T>
+void parallelStdSort(std::vector<T>& v, const unsigned int threads)
+{
+  std::vector<size_t> bounds(threads + 1);
+  for (unsigned int t = 0; t <= threads; ++t)
+    bounds[t] = v.size() * t / threads;
+  mortonParallelFor(threads, [&](const unsigned int t) { std::sort(v.begin() + bounds[t], v.begin() + bounds[t + 1]); });
+
+  for (unsigned int width = 1; width < threads; width *= 2)
+  {
+    const unsigned int merges = (threads + 2 * width - 1) / (2 * width);
+    mortonParallelFor(merges, [&](const unsigned int m)
+    {
+      const unsigned int first = 2 * width * m;
+      if (first + width < threads)
+        std::inplace_merge(v.begin() + bounds[first], v.begin() + bounds[first + width], v.begin() + bounds[std::min(first + 2 * width, threads)]);
+    });
+  }
+}
+
+void benchmarkSort()
+{
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::cout << "Sort threads : " << threads << std::endl;
+
+  for (const int n : { 100000, 1000000, 10000000 })
+  {
+    srand(42);
+    std::vector<morton3> keys(n);
+    std::generate(keys.begin(), keys.end(), [&](){ return morton3(rand() % 0x1fffff, rand() % 0x1fffff, rand() % 0x1fffff); });
+    std::vector<morton3> sorted(n);
+    std::vector<uint32_t> payload(n);
+    const std::string size = " " + std::to_string(n);
+
+    sorted = keys;
+    BEGINPROFILE_KEYS("std::sort" + size, n)
+    std::sort(sorted.begin(), sorted.end());
+    ENDPROFILE
+
+    sorted = keys;
+    BEGINPROFILE_KEYS("Parallel std::sort" + size, n)
+    parallelStdSort(sorted, threads);
+    ENDPROFILE
+
+    sorted = keys;
+    BEGINPROFILE_KEYS("mortonSort 1 thread" + size, n)
+    mortonSort(sorted.data(), n, 1);
+    ENDPROFILE
+
+    sorted = keys;
+    BEGINPROFILE_KEYS("mortonSort" + size, n)
+    mortonSort(sorted.data(), n);
+    ENDPROFILE
+
+    sorted = keys;
+    std::iota(payload.begin(), payload.end(), 0);
+    BEGINPROFILE_KEYS("mortonSort with payload" + size, n)
+    mortonSort(sorted.data(), payload.data(), n);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("mortonSortPermutation" + size, n)
+    mortonSortPermutation(keys.data(), payload.data(), n);
+    ENDPROFILE
+
+    sorted = keys;
+    BEGINPROFILE_KEYS("mortonSortInPlace" + size, n)
+    mortonSortInPlace(sorted.data(), n);
+    ENDPROFILE
+
+    //64 x 64 x 64 grid : 3 passes
+    std::generate(sorted.begin(), sorted.end(), [&](){ return morton3(rand() % 64, rand() % 64, rand() % 64); });
+    BEGINPROFILE_KEYS("mortonSort 64^3 grid" + size, n)
+    mortonSort(sorted.data(), n);
+    ENDPROFILE
+  }
+}
+
+/* Box queries on a sorted array of random keys : linear scan of [min, max], BIGMIN jumps, and capped ranges */
+void benchmarkRange(const int n = 1000000, const int queries = 1000)
+{
+  srand(42);
+  auto less = [](const morton3& a, const morton3& b) { return a.key < b.key; };
+  std::vector<morton3> keys(n);
+  std::generate(keys.begin(), keys.end(), [&](){ return morton3(rand() % 1024, rand() % 1024, rand() % 1024); });
+  std::sort(keys.begin(), keys.end(), less);
+
+  for (const int side : { 16, 64, 256 })
+  {
+    std::vector<morton3> mins(queries), maxs(queries);
+    for (int q = 0; q < queries; ++q)
+    {
+      const uint64_t x = rand() % (1024 - side), y = rand() % (1024 - side), z = rand() % (1024 - side);
+      mins[q] = morton3(x, y, z);
+      maxs[q] = morton3(x + side - 1, y + side - 1, z + side - 1);
+    }
+    const std::string name = " box " + std::to_string(side) + "^3, " + std::to_string(queries) + " queries";
+    size_t visited = 0, found = 0;
+
+    BEGINPROFILE("Linear scan" + name)
+    for (int q = 0; q < queries; ++q)
+    {
+      const morton3* last = std::upper_bound(keys.data(), keys.data() + n, maxs[q], less);
+      for (const morton3* it = std::lower_bound(keys.data(), keys.data() + n, mins[q], less); it != last; ++it, ++visited)
+        found += mortonInBox(*it, mins[q], maxs[q]);
+    }
+    ENDPROFILE
+    std::cout << "  keys read per query : " << visited / queries << ", found : " << found / queries << std::endl;
+
+    visited = found = 0;
+    BEGINPROFILE("BIGMIN" + name)
+    for (int q = 0; q < queries; ++q)
+      visited += mortonBoxQuery(keys.data(), n, mins[q], maxs[q], [&](const size_t) { ++found; });
+    ENDPROFILE
+    std::cout << "  keys read per query : " << visited / queries << ", found : " << found / queries << std::endl;
+
+    for (const size_t cap : { 8, 64 })
+    {
+      visited = found = 0;
+      BEGINPROFILE("Ranges, at most " + std::to_string(cap) + name)
+      for (int q = 0; q < queries; ++q)
+      {
+        for (const morton_range<morton3>& r : mortonBoxRanges(mins[q], maxs[q], cap))
+        {
+          const morton3* last = std::upper_bound(keys.data(), keys.data() + n, r.last, less);
+          for (const morton3* it = std::lower_bound(keys.data(), keys.data() + n, r.first, less); it != last; ++it, ++visited)
+            found += mortonInBox(*it, mins[q], maxs[q]);
+        }
+      }
+      ENDPROFILE
+      std::cout << "  keys read per query : " << visited / queries << ", found : " << found / queries << std::endl;
+    }
+  }
+
+  //Exact decomposition of large boxes : the number of intervals grows with the surface of the box
+  for (const uint32_t side : { 128u, 512u, 1024u })
+  {
+    size_t ranges = 0;
+    BEGINPROFILE("Ranges, no limit, box " + std::to_string(side) + "^3")
+    ranges = mortonBoxRanges(morton3(3, 5, 7), morton3(side + 2, side + 4, side + 6)).size();
+    ENDPROFILE
+    std::cout << "  intervals : " << ranges << std::endl;
+  }
+}
+
+/* Pointer based octree, built like morton_octree::adaptive, as a baseline for the linear octree */
+struct PointerOctree
+{
+  PointerOctree* children[8] = {};
+  bool leaf = false;
+
+  PointerOctree(const morton3* first, const morton3* last, const unsigned int level, const size_t maxKeys)
+  {
+    if (static_cast<size_t>(last - first) <= maxKeys || level == mortonNodeLevels<morton3>())
+    {
+      leaf = true;
+      return;
+    }
+    const unsigned int shift = 3 * (mortonNodeLevels<morton3>() - level - 1);
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+      const morton3* end = std::upper_bound(first, last, i, [&](const unsigned int c, const morton3& m) { return c < ((m.key >> shift) & 7); });
+      if (end > first)
+        children[i] = new PointerOctree(first, end, level + 1, maxKeys);
+      first = end;
+    }
+  }
+
+  ~PointerOctree()
+  {
+    for (PointerOctree* c : children)
+      delete c;
+  }
+
+  const PointerOctree* find(const uint64_t x, const uint64_t y, const uint64_t z) const
+  {
+    const PointerOctree* n = this;
+    for (unsigned int shift = mortonNodeLevels<morton3>() - 1; n && !n->leaf; --shift)
+      n = n->children[((x >> shift) & 1) << 2 | ((y >> shift) & 1) << 1 | ((z >> shift) & 1)];
+    return n;
+  }
+
+  size_t count() const
+  {
+    size_t n = 1;
+    for (const PointerOctree* c : children)
+      n += c ? c->count() : 0;
+    return n;
+  }
+};
+
+void benchmarkOctree(const int n = 1e7, const size_t maxKeys = 8)
+{
+  srand(42);
+  auto less = [](const morton3& a, const morton3& b) { return a.key < b.key; };
+  std::vector<morton3> keys(n);
+  std::generate(keys.begin(), keys.end(), [&](){ return morton3(rand() % 0x1fffff, rand() % 0x1fffff, rand() % 0x1fffff); });
+  std::sort(keys.begin(), keys.end(), less);
+  std::vector<morton3> queries(keys);
+  for (size_t i = queries.size(); i > 1; --i)
+    std::swap(queries[i - 1], queries[static_cast<size_t>(rand()) % i]);
+
+  morton_octree3 tree;
+  BEGINPROFILE_KEYS("Linear octree build", n)
+  tree = morton_octree3::adaptive(keys.data(), n, maxKeys);
+  ENDPROFILE
+  std::cout << "  leaves : " << tree.size() << ", " << tree.size() * (sizeof(morton3) + 1) / (1 << 20) << " MB" << std::endl;
+
+  PointerOctree* pointerTree;
+  BEGINPROFILE_KEYS("Pointer octree build", n)
+  pointerTree = new PointerOctree(keys.data(), keys.data() + n, 0, maxKeys);
+  ENDPROFILE
+  std::cout << "  nodes : " << pointerTree->count() << ", " << pointerTree->count() * sizeof(PointerOctree) / (1 << 20) << " MB" << std::endl;
+
+  BEGINPROFILE_KEYS("Linear octree find", n)
+  volatile size_t r;
+  for (const morton3& m : queries)
+    r = tree.find(m);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Pointer octree find", n)
+  const PointerOctree* volatile r;
+  uint64_t x, y, z;
+  for (const morton3& m : queries)
+  {
+    m.decode(x, y, z);
+    r = pointerTree->find(x, y, z);
+  }
+  ENDPROFILE
+  delete pointerTree;
+}
+
+/* Sphere shell of voxels : dense morton grid against the sparse hash grid */
+void benchmarkHashGrid(const int n = 1e7)
+{
+  srand(42);
+  for (const int size : { 256, 4096 })
+  {
+    const double radius = std::min(size * 0.4, 400.0), center = size / 2;
+    std::vector<morton3> shell;
+    for (int x = 0; x < size; ++x)
+      for (int y = 0; y < size; ++y)
+      {
+        const double d2 = radius * radius - (x - center) * (x - center) - (y - center) * (y - center);
+        if (d2 < 0)
+          continue;
+        const int dz = static_cast<int>(std::sqrt(d2));
+        shell.push_back(morton3(x, y, static_cast<int>(center) + dz));
+        shell.push_back(morton3(x, y, static_cast<int>(center) - dz));
+      }
+    std::vector<morton3> queries(n);
+    std::generate(queries.begin(), queries.end(), [&](){ return shell[rand() % shell.size()]; });
+    const std::string name = " " + std::to_string(size) + "^3 shell";
+
+    morton_hashgrid3d<int> grid;
+    BEGINPROFILE_KEYS("Hash grid set" + name, shell.size())
+    for (const morton3& m : shell)
+      grid.set(m, static_cast<int>(m.key));
+    ENDPROFILE
+    std::cout << "  voxels : " << grid.size() << ", bricks : " << grid.brickCount() << ", bytes per voxel : " << grid.memory() / grid.size() << std::endl;
+
+    BEGINPROFILE_KEYS("Hash grid get" + name, n)
+    volatile int r;
+    for (const morton3& m : queries)
+      r = grid.get(m);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Hash grid +x neighbor" + name, n)
+    const int* volatile r;
+    for (const morton3& m : queries)
+      r = grid.neighbor(m, 0, 1);
+    ENDPROFILE
+
+    if (size <= 256)
+    {
+      MortonGrid3d<int> dense(size);
+      for (const morton3& m : shell)
+        dense.get(m) = static_cast<int>(m.key);
+      std::cout << "Dense morton grid" << name << " bytes per voxel : " << static_cast<size_t>(size) * size * size * sizeof(int) / grid.size() << std::endl;
+
+      BEGINPROFILE_KEYS("Dense morton grid get" + name, n)
+      volatile int r;
+      for (const morton3& m : queries)
+        r = dense.get(m);
+      ENDPROFILE
+    }
+  }
+}
+
+/* kNN on sorted random points : single queries, and batches reusing the previous result */
+void benchmarkKnn(const int n = 1000000, const int queries = 100000)
+{
+  srand(42);
+  std::vector<morton3> points(n), q(queries);
+  std::generate(points.begin(), points.end(), [&](){ return morton3(rand() % 1024, rand() % 1024, rand() % 1024); });
+  std::generate(q.begin(), q.end(), [&](){ return morton3(rand() % 1024, rand() % 1024, rand() % 1024); });
+
+  BEGINPROFILE_KEYS("kNN index : mortonSort", n)
+  mortonSort(points.data(), n);
+  ENDPROFILE
+
+  for (const size_t k : { 1, 8, 32 })
+  {
+    const std::string name = " k = " + std::to_string(k) + ", " + std::to_string(queries) + " queries";
+    std::vector<size_t> indices(queries * k);
+    std::vector<double> dist2(queries * k);
+
+    morton_knn_search<morton3> search;
+    BEGINPROFILE_KEYS("mortonKnn" + name, queries)
+    for (int j = 0; j < queries; ++j)
+      search.query(points.data(), n, q[j], k, &indices[j * k], &dist2[j * k]);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("mortonKnnBatch 1 thread" + name, queries)
+    mortonKnnBatch(points.data(), n, q.data(), queries, k, indices.data(), dist2.data(), 1);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("mortonKnnBatch" + name, queries)
+    mortonKnnBatch(points.data(), n, q.data(), queries, k, indices.data(), dist2.data());
+    ENDPROFILE
+  }
+
+  size_t found = 0;
+  BEGINPROFILE_KEYS("mortonRadiusSearch r = 10", queries)
+  for (int j = 0; j < queries; ++j)
+    found += mortonRadiusSearch(points.data(), n, q[j], 10.0, [](const size_t, const double) {});
+  ENDPROFILE
+  std::cout << "  points per query : " << static_cast<double>(found) / queries << std::endl;
+}
+
+/* LBVH build of random boxes. Mkeys/s is millions of primitives per second */
+void benchmarkLbvh()
+{
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  morton_lbvh bvh;
+  for (const int n : { 100000, 1000000, 10000000 })
+  {
+    srand(42);
+    std::vector<morton_aabb> boxes(n);
+    for (morton_aabb& b : boxes)
+    {
+      for (int a = 0; a < 3; ++a)
+      {
+        b.lo[a] = static_cast<float>(rand()) / RAND_MAX * 1000.f;
+        b.hi[a] = b.lo[a] + static_cast<float>(rand()) / RAND_MAX;
+      }
+    }
+    const std::string size = " " + std::to_string(n);
+
+    BEGINPROFILE_KEYS("LBVH build 1 thread" + size, n)
+    bvh.build(boxes.data(), n, 1);
+    ENDPROFILE
+
+    //Second build reuses the buffers, like the next frame
+    BEGINPROFILE_KEYS("LBVH build " + std::to_string(threads) + " threads" + size, n)
+    bvh.build(boxes.data(), n, threads);
+    ENDPROFILE
+  }
+}
+
+/* Layout of the cells of a box in a grid : contiguous runs of keys, and distinct 64 bytes lines of ints */
+template<class Index>
+void benchmarkLayout(const std::string& name, const int dims, const int size, const int side, const int queries, Index index)
+{
+  srand(42);
+  size_t runs = 0, lines = 0;
+  std::vector<uint64_t> keys;
+  for (int q = 0; q < queries; ++q)
+  {
+    const int x = rand() % (size - side), y = rand() % (size - side), z = dims == 3 ? rand() % (size - side) : 0;
+    keys.clear();
+    for (int k = z; k < z + (dims == 3 ? side : 1); ++k)
+      for (int j = y; j < y + side; ++j)
+        for (int i = x; i < x + side; ++i)
+          keys.push_back(index(i, j, k));
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+      runs += i == 0 || keys[i] != keys[i - 1] + 1;
+      lines += i == 0 || keys[i] * sizeof(int) / 64 != keys[i - 1] * sizeof(int) / 64;
+    }
+  }
+  std::cout << name << " box " << side << (dims == 3 ? "^3" : "^2") << " : " << static_cast<double>(runs) / queries << " runs, "
+    << static_cast<double>(lines) / queries << " cache lines per box" << std::endl;
+}
+
+/* Box sums, reading the cells in x, y, z order */
+template<class Grid>
+void benchmarkBoxSum(const std::string& name, Grid& grid, const int side, const int queries)
+{
+  srand(42);
+  const int size = grid.gridSize;
+  BEGINPROFILE_KEYS(name + " box sum " + std::to_string(side) + "^3", static_cast<double>(queries) * side * side * side)
+  volatile int r;
+  for (int q = 0; q < queries; ++q)
+  {
+    const int x = rand() % (size - side), y = rand() % (size - side), z = rand() % (size - side);
+    int sum = 0;
+    for (int k = z; k < z + side; ++k)
+      for (int j = y; j < y + side; ++j)
+        for (int i = x; i < x + side; ++i)
+          sum += grid.get(i, j, k);
+    r = sum;
+  }
+  ENDPROFILE
+}
+
+/* Hilbert keys against morton keys : encoding, decoding, and locality of boxes */
+void benchmarkHilbert(const int n = 1e7)
+{
+  srand(42);
+  std::vector<uint32_t> coords(3 * n);
+  std::generate(coords.begin(), coords.end(), [](){ return rand() % 0x1fffff; });
+  std::vector<uint64_t> keys(n);
+
+  BEGINPROFILE_KEYS("Encode morton3", n)
+  for (int i = 0; i < n; ++i)
+    keys[i] = morton3(coords[3 * i], coords[3 * i + 1], coords[3 * i + 2]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Encode hilbert3", n)
+  for (int i = 0; i < n; ++i)
+    keys[i] = hilbert3(coords[3 * i], coords[3 * i + 1], coords[3 * i + 2]).key;
+  ENDPROFILE
+
+  volatile uint64_t r;
+  uint64_t x, y, z;
+  BEGINPROFILE_KEYS("Decode morton3", n)
+  for (int i = 0; i < n; ++i)
+  {
+    morton3(keys[i]).decode(x, y, z);
+    r = x + y + z;
+  }
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Decode hilbert3", n)
+  for (int i = 0; i < n; ++i)
+  {
+    hilbert3(keys[i]).decode(x, y, z);
+    r = x + y + z;
+  }
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Encode morton2", n)
+  for (int i = 0; i < n; ++i)
+    keys[i] = morton2(coords[2 * i], coords[2 * i + 1]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Encode hilbert2", n)
+  for (int i = 0; i < n; ++i)
+    keys[i] = hilbert2(coords[2 * i], coords[2 * i + 1]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Decode hilbert2", n)
+  for (int i = 0; i < n; ++i)
+  {
+    hilbert2(keys[i]).decode(x, y);
+    r = x + y;
+  }
+  ENDPROFILE
+
+  for (const int side : { 16, 100 })
+  {
+    benchmarkLayout("Row major 2d", 2, 1024, side, 1000, [](int i, int j, int) { return static_cast<uint64_t>(j) * 1024 + i; });
+    benchmarkLayout("Morton 2d   ", 2, 1024, side, 1000, [](int i, int j, int) { return morton2(i, j).key; });
+    benchmarkLayout("Hilbert 2d  ", 2, 1024, side, 1000, [](int i, int j, int) { return hilbert2(i, j).key; });
+  }
+  for (const int side : { 8, 20 })
+  {
+    benchmarkLayout("Row major 3d", 3, 256, side, 1000, [](int i, int j, int k) { return (static_cast<uint64_t>(k) * 256 + j) * 256 + i; });
+    benchmarkLayout("Morton 3d   ", 3, 256, side, 1000, [](int i, int j, int k) { return morton3(i, j, k).key; });
+    benchmarkLayout("Hilbert 3d  ", 3, 256, side, 1000, [](int i, int j, int k) { return hilbert3(i, j, k).key; });
+  }
+
+  Grid3d<int> grid(256);
+  MortonGrid3d<int> mortonGrid(256);
+  HilbertGrid3d<int> hilbertGrid(256);
+  for (const int side : { 8, 32 })
+  {
+    benchmarkBoxSum("Row major grid", grid, side, 100000 / side);
+    benchmarkBoxSum("Morton grid", mortonGrid, side, 100000 / side);
+    benchmarkBoxSum("Hilbert grid", hilbertGrid, side, 100000 / side);
+  }
+}
+
+/* 7 point diffusion and 27 point smoothing, clamped at the border. Mkeys/s is millions of cells per second */
+void benchmarkStencil(const int steps = 4)
+{
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  auto diffusion = [](const float c, const float (&n)[6]) { return c + 0.1f * (n[0] + n[1] + n[2] + n[3] + n[4] + n[5] - 6 * c); };
+  auto smoothing = [](const float c, const float (&n)[26])
+  {
+    float sum = c;
+    for (int j = 0; j < 26; ++j)
+      sum += n[j];
+    return sum * (1.f / 27);
+  };
+
+  for (const int size : { 128, 256 })
+  {
+    const double cells = static_cast<double>(size) * size * size * steps;
+    const std::string name = " " + std::to_string(size) + "^3";
+    Grid3d<float> g(size), gout(size);
+    MortonGrid3d<float> gm(size), gmout(size);
+    volatile float r;
+
+    BEGINPROFILE_KEYS("Classic 3d grid 7 point" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      for (int x = 0; x < size; ++x)
+        for (int y = 0; y < size; ++y)
+          for (int z = 0; z < size; ++z)
+          {
+            const float n[6] = { g.get(std::max(x - 1, 0), y, z), g.get(x, std::max(y - 1, 0), z), g.get(x, y, std::max(z - 1, 0)),
+              g.get(x, y, std::min(z + 1, size - 1)), g.get(x, std::min(y + 1, size - 1), z), g.get(std::min(x + 1, size - 1), y, z) };
+            gout.get(x, y, z) = diffusion(g.get(x, y, z), n);
+          }
+    ENDPROFILE
+    r = gout.get(1, 2, 3);
+
+    BEGINPROFILE_KEYS("Morton  3d grid 7 point get(x, y, z)" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      for (int x = 0; x < size; ++x)
+        for (int y = 0; y < size; ++y)
+          for (int z = 0; z < size; ++z)
+          {
+            const float n[6] = { gm.get(std::max(x - 1, 0), y, z), gm.get(x, std::max(y - 1, 0), z), gm.get(x, y, std::max(z - 1, 0)),
+              gm.get(x, y, std::min(z + 1, size - 1)), gm.get(x, std::min(y + 1, size - 1), z), gm.get(std::min(x + 1, size - 1), y, z) };
+            gmout.get(x, y, z) = diffusion(gm.get(x, y, z), n);
+          }
+    ENDPROFILE
+    r = gmout.get(1, 2, 3);
+
+    BEGINPROFILE_KEYS("mortonStencil 7 point 1 thread" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      mortonStencil<6>(&gm.get(morton3(0)), &gmout.get(morton3(0)), size, diffusion, MORTON_BOUNDARY_CLAMP, 1);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("mortonStencil 7 point " + std::to_string(threads) + " threads" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      mortonStencil<6>(&gm.get(morton3(0)), &gmout.get(morton3(0)), size, diffusion, MORTON_BOUNDARY_CLAMP, threads);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Classic 3d grid 27 point" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      for (int x = 0; x < size; ++x)
+        for (int y = 0; y < size; ++y)
+          for (int z = 0; z < size; ++z)
+          {
+            float n[26];
+            int j = 0;
+            for (int xx = x - 1; xx <= x + 1; ++xx)
+              for (int yy = y - 1; yy <= y + 1; ++yy)
+                for (int zz = z - 1; zz <= z + 1; ++zz)
+                  if (xx != x || yy != y || zz != z)
+                    n[j++] = g.get(std::min(std::max(xx, 0), size - 1), std::min(std::max(yy, 0), size - 1), std::min(std::max(zz, 0), size - 1));
+            gout.get(x, y, z) = smoothing(g.get(x, y, z), n);
+          }
+    ENDPROFILE
+    r = gout.get(1, 2, 3);
+
+    BEGINPROFILE_KEYS("mortonStencil 27 point 1 thread" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      mortonStencil<26>(&gm.get(morton3(0)), &gmout.get(morton3(0)), size, smoothing, MORTON_BOUNDARY_CLAMP, 1);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("mortonStencil 27 point " + std::to_string(threads) + " threads" + name, cells)
+    for (int s = 0; s < steps; ++s)
+      mortonStencil<26>(&gm.get(morton3(0)), &gmout.get(morton3(0)), size, smoothing, MORTON_BOUNDARY_CLAMP, threads);
+    ENDPROFILE
+    r = gmout.get(1, 2, 3);
+  }
+}
+
+/* Sums over random boxes of a morton grid : nested loops encoding each cell, and mortonBox. Mkeys/s is millions of cells per second */
+void benchmarkBoxIterator(const int size = 256, const int queries = 2000)
+{
+  srand(42);
+  MortonGrid3d<int> gm(size);
+  std::vector<morton3> mins(queries), maxs(queries);
+  double cells = 0;
+  for (int q = 0; q < queries; ++q)
+  {
+    uint32_t lo[3], hi[3];
+    for (int a = 0; a < 3; ++a)
+    {
+      lo[a] = rand() % (size - 64);
+      hi[a] = lo[a] + rand() % 64;
+    }
+    mins[q] = morton3(lo[0], lo[1], lo[2]);
+    maxs[q] = morton3(hi[0], hi[1], hi[2]);
+    cells += static_cast<double>(mortonBox(mins[q], maxs[q]).size());
+  }
+  volatile int r;
+
+  BEGINPROFILE_KEYS("Box sum, nested loops get(x, y, z)", cells)
+  for (int q = 0; q < queries; ++q)
+  {
+    uint64_t x0, y0, z0, x1, y1, z1;
+    mins[q].decode(x0, y0, z0);
+    maxs[q].decode(x1, y1, z1);
+    int sum = 0;
+    for (uint64_t x = x0; x <= x1; ++x)
+      for (uint64_t y = y0; y <= y1; ++y)
+        for (uint64_t z = z0; z <= z1; ++z)
+          sum += gm.get(static_cast<int>(x), static_cast<int>(y), static_cast<int>(z));
+    r = sum;
+  }
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Box sum, for (morton3 m : mortonBox(min, max))", cells)
+  for (int q = 0; q < queries; ++q)
+  {
+    int sum = 0;
+    for (const morton3 m : mortonBox(mins[q], maxs[q]))
+      sum += gm.get(m);
+    r = sum;
+  }
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Box sum, std::accumulate on mortonBox", cells)
+  for (int q = 0; q < queries; ++q)
+  {
+    const morton_box<morton3> box = mortonBox(mins[q], maxs[q]);
+    r = std::accumulate(box.begin(), box.end(), 0, [&](const int sum, const morton3& m) { return sum + gm.get(m); });
+  }
+  ENDPROFILE
+}
+
+/* Grids which are not a power of 2 : row major, morton padded to the next power of 2, and compact morton */
+void benchmarkExtents(const int iMax = 2e7)
+{
+  typedef uint32_t gridType;
+  for (const int size : { 100, 300 })
+  {
+    const std::string name = " " + std::to_string(size) + "^3";
+    Grid3d<gridType> g(size);
+    MortonGrid3d<gridType> gm(size);
+    CompactMortonGrid3d<gridType> gc(size, size, size);
+    int padded = 1;
+    while (padded < size)
+      padded *= 2;
+    std::cout << "Morton  3d grid" << name << " : " << static_cast<double>(padded) * padded * padded / (static_cast<double>(size) * size * size)
+      << "x memory padded, " << static_cast<double>(gc.size()) / (static_cast<double>(size) * size * size) << "x compact" << std::endl;
+
+    srand(42);
+    std::vector<int> random_pool(iMax * 3);
+    std::generate(random_pool.begin(), random_pool.end(), [&]() { return rand() % size; });
+
+    BEGINPROFILE_KEYS("Classic 3d grid get() random" + name, iMax)
+    volatile gridType r;
+    for (int i = 0; i < iMax; i++)
+      r = g.get(random_pool[i * 3], random_pool[i * 3 + 1], random_pool[i * 3 + 2]);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Morton  3d grid get() random padded" + name, iMax)
+    volatile gridType r;
+    for (int i = 0; i < iMax; i++)
+      r = gm.get(random_pool[i * 3], random_pool[i * 3 + 1], random_pool[i * 3 + 2]);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Morton  3d grid get() random compact" + name, iMax)
+    volatile gridType r;
+    for (int i = 0; i < iMax; i++)
+      r = gc.get(random_pool[i * 3], random_pool[i * 3 + 1], random_pool[i * 3 + 2]);
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Classic 3d grid get() random + 6 neighbors" + name, iMax)
+    volatile gridType r;
+    for (int i = 0; i < iMax; i++)
+    {
+      const int x = random_pool[i * 3], y = random_pool[i * 3 + 1], z = random_pool[i * 3 + 2];
+      r = g.get(x, y, z);
+      if (z - 1 >= 0)
+        r = g.get(x, y, z - 1);
+      if (z + 1 < size)
+        r = g.get(x, y, z + 1);
+      if (y - 1 >= 0)
+        r = g.get(x, y - 1, z);
+      if (y + 1 < size)
+        r = g.get(x, y + 1, z);
+      if (x - 1 >= 0)
+        r = g.get(x - 1, y, z);
+      if (x + 1 < size)
+        r = g.get(x + 1, y, z);
+    }
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Morton  3d grid get() random + 6 neighbors padded" + name, iMax)
+    volatile gridType r;
+    for (int i = 0; i < iMax; i++)
+    {
+      const int x = random_pool[i * 3], y = random_pool[i * 3 + 1], z = random_pool[i * 3 + 2];
+      const morton3 m(x, y, z);
+      r = gm.get(m);
+      if (z - 1 >= 0)
+        r = gm.get(m.decZ());
+      if (z + 1 < size)
+        r = gm.get(m.incZ());
+      if (y - 1 >= 0)
+        r = gm.get(m.decY());
+      if (y + 1 < size)
+        r = gm.get(m.incY());
+      if (x - 1 >= 0)
+        r = gm.get(m.decX());
+      if (x + 1 < size)
+        r = gm.get(m.incX());
+    }
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Morton  3d grid get() random + 6 neighbors compact" + name, iMax)
+    volatile gridType r;
+    for (int i = 0; i < iMax; i++)
+    {
+      const int x = random_pool[i * 3], y = random_pool[i * 3 + 1], z = random_pool[i * 3 + 2];
+      const morton3 m(x, y, z);
+      r = gc.get(m);
+      if (z - 1 >= 0)
+        r = gc.get(m.decZ());
+      if (z + 1 < size)
+        r = gc.get(m.incZ());
+      if (y - 1 >= 0)
+        r = gc.get(m.decY());
+      if (y + 1 < size)
+        r = gc.get(m.incY());
+      if (x - 1 >= 0)
+        r = gc.get(m.decX());
+      if (x + 1 < size)
+        r = gc.get(m.incX());
+    }
+    ENDPROFILE
+  }
+
+  //A flat grid, which a morton grid would pad to a cube
+  const int nx = 1024, ny = 1024, nz = 8;
+  CompactMortonGrid3d<gridType> gc(nx, ny, nz);
+  std::cout << "Morton  3d grid " << nx << "x" << ny << "x" << nz << " : " << static_cast<double>(nx) * nx * nx / (static_cast<double>(nx) * ny * nz)
+    << "x memory padded, " << static_cast<double>(gc.size()) / (static_cast<double>(nx) * ny * nz) << "x compact" << std::endl;
+  srand(42);
+  std::vector<int> random_pool(iMax * 3);
+  for (int i = 0; i < iMax; i++)
+  {
+    random_pool[i * 3] = rand() % nx;
+    random_pool[i * 3 + 1] = rand() % ny;
+    random_pool[i * 3 + 2] = rand() % nz;
+  }
+
+  std::vector<gridType> g(static_cast<size_t>(nx) * ny * nz);
+  std::generate(g.begin(), g.end(), std::rand);
+
+  BEGINPROFILE_KEYS("Classic 3d grid get() random flat", iMax)
+  volatile gridType r;
+  for (int i = 0; i < iMax; i++)
+    r = g[(static_cast<size_t>(random_pool[i * 3]) * ny + random_pool[i * 3 + 1]) * nz + random_pool[i * 3 + 2]];
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d grid get() random compact flat", iMax)
+  volatile gridType r;
+  for (int i = 0; i < iMax; i++)
+    r = gc.get(random_pool[i * 3], random_pool[i * 3 + 1], random_pool[i * 3 + 2]);
+  ENDPROFILE
+}
+
+template<class Allocator>
+void benchmarkGridPages(const std::string& name, const int gridsize, const std::vector<int>& random_pool, const int iMax)
+{
+  typedef uint64_t gridType;
+  MortonGrid3d<gridType, Allocator> gm(gridsize);
+
+  BEGINPROFILE_KEYS("Morton  3d grid get() random " + name, iMax)
+  volatile gridType r;
+  for (int i = 0; i < iMax; i++)
+    r = gm.get(random_pool[i * 3], random_pool[i * 3 + 1], random_pool[i * 3 + 2]);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d grid get() random + 26 neighbors " + name, iMax)
+  volatile gridType r;
+  const morton3 max(gridsize - 1, gridsize - 1, gridsize - 1);
+  for (int i = 0; i < iMax; i++)
+  {
+    const morton3 mkey(random_pool[i * 3], random_pool[i * 3 + 1], random_pool[i * 3 + 2]);
+    r = gm.get(mkey);
+    mortonForEachNeighbor<26>(mkey, max, MORTON_BOUNDARY_SKIP, [&](const morton3 n) { r = gm.get(n); });
+  }
+  ENDPROFILE
+}
+
+/* Random accesses to a 1 GiB grid (512^3 uint64_t) with each allocator : TLB misses with 4 KiB pages */
+void benchmarkAllocators(const int gridsize = 512, const int iMax = 4e6)
+{
+  srand(42);
+  std::vector<int> random_pool(iMax * 3);
+  std::generate(random_pool.begin(), random_pool.end(), [&]() { return rand() % gridsize; });
+
+  benchmarkGridPages<std::allocator<uint64_t>>("std::allocator", gridsize, random_pool, iMax);
+  benchmarkGridPages<morton_allocator<uint64_t, MORTON_PAGES_CACHE_LINE>>("cache line", gridsize, random_pool, iMax);
+  benchmarkGridPages<morton_allocator<uint64_t, MORTON_PAGES_ALIGNED>>("4 KiB aligned", gridsize, random_pool, iMax);
+  benchmarkGridPages<morton_allocator<uint64_t, MORTON_PAGES_TRANSPARENT_HUGE>>("transparent huge pages", gridsize, random_pool, iMax);
+  benchmarkGridPages<morton_allocator<uint64_t, MORTON_PAGES_HUGETLB>>("MAP_HUGETLB", gridsize, random_pool, iMax);
+  benchmarkGridPages<morton_allocator<uint64_t, MORTON_PAGES_TRANSPARENT_HUGE, true>>("huge pages first touch", gridsize, random_pool, iMax);
+}
+
+/* Drops a file from the page cache, so that the next reads come from the disk */
+void benchmarkEvict(const char* path)
+{
+#if __linux__
+  const int fd = open(path, O_RDONLY);
+  if (fd >= 0)
+  {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#else
+  (void)path;
+#endif
+}
+
+/* Grid file of size^3 floats read from a cold page cache : read() into a vector against mmap. Mkeys/s is millions of cells per second */
+void benchmarkFile(const int size = 256, const int iMax = 1e7)
+{
+  const char* path = "morton_benchmark_grid.bin";
+  if (!mortonFileWrite<float>(path, size, size, size, [](uint32_t x, uint32_t y, uint32_t z) { return static_cast<float>(x + y + z); }))
+  {
+    std::cout << "Can't write " << path << std::endl;
+    return;
+  }
+  const double cells = static_cast<double>(size) * size * size;
+
+  srand(42);
+  std::vector<morton3> random_pool(iMax);
+  std::generate(random_pool.begin(), random_pool.end(), [&]() { return morton3(rand() % size, rand() % size, rand() % size); });
+
+  //Loads the whole file as the vector based grids do
+  morton_file_tiles tiles;
+  std::vector<float> cellsRead;
+  auto readAll = [&]()
+  {
+    morton_file_header header;
+    FILE* file = fopen(path, "rb");
+    const bool ok = fread(&header, sizeof(header), 1, file) == 1;
+    tiles.build(header.extent, header.tileLevels);
+    cellsRead.resize(static_cast<size_t>(header.tiles << (3 * header.tileLevels)));
+    const bool read = mortonFileSeek(file, header.payload) && fread(cellsRead.data(), sizeof(float), cellsRead.size(), file) == cellsRead.size();
+    fclose(file);
+    assert(ok && read);
+    (void)ok;
+    (void)read;
+    return header.tileLevels * 3;
+  };
+  volatile float r;
+
+  benchmarkEvict(path);
+  BEGINPROFILE_KEYS("Grid file read() into vector, random get()", iMax)
+  const unsigned int shift = readAll();
+  float sum = 0;
+  for (int i = 0; i < iMax; ++i)
+  {
+    const uint64_t key = random_pool[i].key;
+    sum += cellsRead[(static_cast<size_t>(tiles.rank[tiles.index(key >> shift)]) << shift) | (key & ((1ull << shift) - 1))];
+  }
+  r = sum;
+  ENDPROFILE
+
+  benchmarkEvict(path);
+  BEGINPROFILE_KEYS("Grid file mmap, random get()", iMax)
+  morton_file_grid<float> grid;
+  grid.open(path);
+  float sum = 0;
+  for (int i = 0; i < iMax; ++i)
+    sum += grid.get(random_pool[i]);
+  r = sum;
+  ENDPROFILE
+
+  benchmarkEvict(path);
+  BEGINPROFILE_KEYS("Grid file read() into vector, sum in morton order", cells)
+  readAll();
+  r = std::accumulate(cellsRead.begin(), cellsRead.end(), 0.f);
+  ENDPROFILE
+
+  benchmarkEvict(path);
+  BEGINPROFILE_KEYS("Grid file mmap, traverse() without read ahead", cells)
+  morton_file_grid<float> grid;
+  grid.open(path);
+  float sum = 0;
+  grid.traverse([&](const morton3, const float& v) { sum += v; }, 0);
+  r = sum;
+  ENDPROFILE
+
+  benchmarkEvict(path);
+  BEGINPROFILE_KEYS("Grid file mmap, traverse() with read ahead", cells)
+  morton_file_grid<float> grid;
+  grid.open(path);
+  float sum = 0;
+  grid.traverse([&](const morton3, const float& v) { sum += v; });
+  r = sum;
+  ENDPROFILE
+
+  std::remove(path);
+}
+
+/* Out of core sort of random points, 10 times the memory budget. Mkeys/s is millions of points per second */
+void benchmarkExternalSort(const size_t memory = 32 << 20, const size_t ratio = 10)
+{
+  const char* path = "morton_benchmark_sorted.bin";
+  const size_t n = memory * ratio / (sizeof(uint64_t) + sizeof(uint32_t));
+  std::cout << "External sort : " << n << " points, " << (n * (sizeof(uint64_t) + sizeof(uint32_t)) >> 20) << " MiB, "
+    << (memory >> 20) << " MiB of memory" << std::endl;
+
+  //Positions are made and encoded in blocks, as when streaming a point cloud file
+  const morton3d_quantizer<float> q({ 0.f, 0.f, 0.f }, { 1.f, 1.f, 1.f }, 21);
+  std::vector<float> xs, ys, zs;
+  size_t next = 0;
+  auto read = [&](uint64_t* keys, uint32_t* payload, const size_t max)
+  {
+    const size_t count = std::min<size_t>(std::min<size_t>(max, 1 << 16), n - next);
+    xs.resize(count);
+    ys.resize(count);
+    zs.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      xs[i] = rand() / static_cast<float>(RAND_MAX);
+      ys[i] = rand() / static_cast<float>(RAND_MAX);
+      zs[i] = rand() / static_cast<float>(RAND_MAX);
+      payload[i] = static_cast<uint32_t>(next + i);
+    }
+    q.encode(xs.data(), ys.data(), zs.data(), keys, count);
+    next += count;
+    return count;
+  };
+
+  srand(42);
+  BEGINPROFILE_KEYS("mortonExternalSort " + std::to_string(ratio) + "x memory", n)
+  if (!mortonExternalSort<uint32_t>(path, read, memory))
+    std::cout << "Can't write " << path << std::endl;
+  ENDPROFILE
+
+  morton_sorted_file<uint32_t> sorted;
+  if (sorted.open(path))
+  {
+    volatile bool r = std::is_sorted(sorted.keys(), sorted.keys() + sorted.size(), [](const morton3 a, const morton3 b) { return a.key < b.key; });
+    (void)r;
+  }
+  sorted.close();
+  std::remove(path);
+}
+
+/* Compressed sorted keys, uniform and clustered points. Mkeys/s times 8 is the decoded MB/s */
+void benchmarkPacked(const int n = 1e7, const int queries = 1e6)
+{
+  for (const bool clustered : { false, true })
+  {
+    srand(42);
+    std::vector<uint64_t> keys(n);
+    if (clustered)
+    {
+      //1000 clusters of 64^3 cells in a 2^21 grid
+      std::vector<uint32_t> centers(3000);
+      std::generate(centers.begin(), centers.end(), [&]() { return rand() % (0x1fffff - 64); });
+      for (int i = 0; i < n; ++i)
+      {
+        const int c = rand() % 1000;
+        keys[i] = morton3(centers[c * 3] + rand() % 64, centers[c * 3 + 1] + rand() % 64, centers[c * 3 + 2] + rand() % 64).key;
+      }
+    }
+    else
+      std::generate(keys.begin(), keys.end(), [&]() { return morton3(rand() % 0x1fffff, rand() % 0x1fffff, rand() % 0x1fffff).key; });
+    mortonSort(keys.data(), keys.size());
+    const std::string name = clustered ? " clustered" : " uniform";
+
+    const morton_packed_keys packed(keys.data(), keys.size());
+    std::cout << "Packed keys" << name << " : " << 8.0 * n / packed.memory() << "x smaller, "
+      << 8.0 * packed.memory() / n << " bits per key" << std::endl;
+
+    std::vector<uint64_t> out(n);
+    volatile uint64_t r;
+    BEGINPROFILE_KEYS("Copy keys" + name, n)
+    std::copy(keys.begin(), keys.end(), out.begin());
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Packed keys decode" + name, n)
+    packed.decode(out.data());
+    ENDPROFILE
+    r = out[n / 2];
+
+    BEGINPROFILE_KEYS("Packed keys decode scalar" + name, n)
+    for (size_t b = 0; b + 1 < packed.blockCount(); ++b)
+      packed.decodeBlock_scalar(b, out.data() + b * morton_packed_keys::blockSize);
+    ENDPROFILE
+    r = out[n / 2];
+
+    std::vector<uint64_t> lookups(queries);
+    std::generate(lookups.begin(), lookups.end(), [&]() { return keys[rand() % n] + rand() % 2; });
+
+    BEGINPROFILE_KEYS("std::lower_bound" + name, queries)
+    size_t sum = 0;
+    for (const uint64_t k : lookups)
+      sum += std::lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+    r = sum;
+    ENDPROFILE
+
+    BEGINPROFILE_KEYS("Packed keys lowerBound" + name, queries)
+    size_t sum = 0;
+    for (const uint64_t k : lookups)
+      sum += packed.lowerBound(k);
+    r = sum;
+    ENDPROFILE
+  }
+}
+
+void benchmark128(const int n = 1e7)
+{
+  srand(42);
+  std::vector<uint64_t> coords(n * 3);
+  std::generate(coords.begin(), coords.end(), [&](){ return rand() % 0x1fffff; });
+
+  BEGINPROFILE_KEYS("Morton  3d encode 64 bits keys", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = morton3(coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d encode 128 bits keys", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = static_cast<uint64_t>(morton3_128(coords[i * 3] << 21, coords[i * 3 + 1] << 21, coords[i * 3 + 2] << 21).key >> 64);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  2d encode 64 bits keys", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = morton2(coords[i * 3], coords[i * 3 + 1]).key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  2d encode 128 bits keys", n)
+  volatile uint64_t r;
+  for (int i = 0; i < n; ++i)
+    r = static_cast<uint64_t>(morton2_128(coords[i * 3] << 32, coords[i * 3 + 1] << 32).key >> 64);
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d add 64 bits keys", n)
+  morton3 m(0);
+  const morton3 offset = morton3(1, 2, 3);
+  for (int i = 0; i < n; ++i)
+    m = m + offset;
+  volatile uint64_t r = m.key;
+  ENDPROFILE
+
+  BEGINPROFILE_KEYS("Morton  3d add 128 bits keys", n)
+  morton3_128 m(0);
+  const morton3_128 offset = morton3_128(1, 2, 3);
+  for (int i = 0; i < n; ++i)
+    m = m + offset;
+  volatile uint64_t r = static_cast<uint64_t>(m.key);
+  ENDPROFILE
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -6,6 +6,10 @@
 
 #include "../include/morton2d.h"
 #include "../include/morton3d.h"
+#include "../include/hilbert2d.h"
+#include "../include/hilbert3d.h"
+#include "../include/morton_allocator.h"
+#include "../include/morton_file.h"
 
 
 template<typename T>
@@ -49,15 +53,19 @@ private:
 
 };
 
-template<typename T>
+/* Allocator : std::allocator or morton_allocator, for aligned or huge pages and NUMA first touch */
+template<typename T, class Allocator = std::allocator<T>>
 class MortonGrid2d
 {
 public:
 
 	MortonGrid2d(int gridSize)
 	{
-		//reserve space
-		storage.resize(gridSize*gridSize);
+		//reserve space : keys of a grid which is not a power of 2 go up to the next power of 2 on each axis
+		int padded = 1;
+		while (padded < gridSize)
+			padded *= 2;
+		storage.resize(padded*padded);
 		this->gridSize = gridSize;
 
 		//Fill with random values
@@ -88,7 +96,7 @@ public:
 	int gridSize;
 
 private:
-	std::vector<T> storage;
+	std::vector<T, Allocator> storage;
 
 };
 
@@ -134,15 +142,19 @@ private:
 };
 
 
-template<typename T>
+/* Allocator : std::allocator or morton_allocator, for aligned or huge pages and NUMA first touch */
+template<typename T, class Allocator = std::allocator<T>>
 class MortonGrid3d
 {
 public:
 
 	MortonGrid3d(int gridSize)
 	{
-		//reserve space
-		storage.resize(gridSize*gridSize*gridSize);
+		//reserve space : keys of a grid which is not a power of 2 go up to the next power of 2 on each axis
+		int padded = 1;
+		while (padded < gridSize)
+			padded *= 2;
+		storage.resize(padded*padded*padded);
 		this->gridSize = gridSize;
 
 		//Fill with random values
@@ -169,6 +181,256 @@ public:
 	}
 
 
+public:
+	int gridSize;
+
+private:
+	std::vector<T, Allocator> storage;
+
+};
+
+/*
+Morton grid of any size nx * ny * nz, where a MortonGrid3d would pad each axis to a power of 2 (up to 8 times the memory).
+Cells are grouped in morton aligned blocks of 8^3 cells, and only the blocks which cross the grid are stored, in morton order.
+The blocks are the tiles of a morton_file_tiles : the top bits of the key give the dense index of the block (the key itself for
+a cube), whose rank is the offset of the block. The table has one entry per block of the bounding box of the grid, so flat or long
+grids don't pay for the morton padding, and the storage is at most one block larger than the grid on each axis.
+Keys are still morton3 keys : incX(), mortonNeighbors()...
+*/
+template<typename T>
+class CompactMortonGrid3d
+{
+public:
+	static const unsigned int blockBits = 9;
+	static const uint64_t cellMask = (uint64_t(1) << blockBits) - 1;
+
+	CompactMortonGrid3d(int nx, int ny, int nz)
+	{
+		assert(nx > 0 && ny > 0 && nz > 0);
+		this->nx = nx;
+		this->ny = ny;
+		this->nz = nz;
+
+		//Rank of each block, blocks outside the grid are not stored
+		const uint32_t extent[3] = { static_cast<uint32_t>(nx), static_cast<uint32_t>(ny), static_cast<uint32_t>(nz) };
+		const bool built = blocks.build(extent, blockBits / 3);
+		assert(built);
+		(void)built;
+
+		//reserve space
+		storage.resize(static_cast<size_t>(blocks.count) << blockBits);
+
+		//Fill with random values
+		std::generate(storage.begin(), storage.end(), std::rand);
+	}
+
+	inline size_t index(const morton3 m) const
+	{
+		return (static_cast<size_t>(blocks.rank[blocks.index(m.key >> blockBits)]) << blockBits) | (m.key & cellMask);
+	}
+
+	inline void push(const int x, const int y, const int z, T data)
+	{
+		assert(x < this->nx && y < this->ny && z < this->nz);
+		this->storage[index(morton3(x, y, z))] = data;
+	}
+
+	inline T& get(const morton3 m)
+	{
+		return this->storage[index(m)];
+	}
+
+	inline T& get(const int x, const int y, const int z)
+	{
+		assert(x < this->nx && y < this->ny && z < this->nz);
+		return this->storage[index(morton3(x, y, z))];
+	}
+
+	inline size_t size() const
+	{
+		return storage.size();
+	}
+
+
+public:
+	int nx, ny, nz;
+
+private:
+	morton_file_tiles blocks;
+	std::vector<T> storage;
+
+};
+
+/*
+Bricks of B^3 cells (B a power of 2) stored in morton order of the bricks, cells of a brick in row major order like Grid3d :
+the B cells of a row along z are contiguous and can be loaded as a vector, and bricks keep the locality of morton order.
+The index of a cell is the morton key of its brick followed by the x, y and z bits of the cell in the brick. Each axis is still
+a fixed set of bits of the index, so neighbors are found with the same masked increments as morton keys, without decoding.
+gridSize must be a power of 2 and a multiple of B.
+*/
+template<typename T, unsigned int B>
+class BrickGrid3d
+{
+	static_assert(B >= 2 && B <= 16 && (B & (B - 1)) == 0, "B must be a power of 2 between 2 and 16");
+
+public:
+	static constexpr unsigned int brickBits = B == 2 ? 1 : B == 4 ? 2 : B == 8 ? 3 : 4;
+	static constexpr uint64_t cellMask = B - 1;
+
+	//Bits of each axis in an index
+	static constexpr uint64_t xMask = (cellMask << (2 * brickBits)) | (x3_mask << (3 * brickBits));
+	static constexpr uint64_t yMask = (cellMask << brickBits) | (y3_mask << (3 * brickBits));
+	static constexpr uint64_t zMask = cellMask | (z3_mask << (3 * brickBits));
+
+	BrickGrid3d(int gridSize)
+	{
+		assert(gridSize > 0 && (gridSize & (gridSize - 1)) == 0 && gridSize % B == 0);
+
+		//reserve space
+		storage.resize(gridSize*gridSize*gridSize);
+		this->gridSize = gridSize;
+
+		//Fill with random values
+		std::generate(storage.begin(), storage.end(), std::rand);
+	}
+
+	static inline uint64_t index(const int x, const int y, const int z)
+	{
+		const morton3 brick = morton3(x >> brickBits, y >> brickBits, z >> brickBits);
+		return (brick.key << (3 * brickBits)) | ((x & cellMask) << (2 * brickBits)) | ((y & cellMask) << brickBits) | (z & cellMask);
+	}
+
+	inline void push(const int x, const int y, const int z, T data)
+	{
+		assert(x < this->gridSize && y < this->gridSize && z < this->gridSize);
+		this->storage[index(x, y, z)] = data;
+	}
+
+	inline T& get(const uint64_t index)
+	{
+		return this->storage[index];
+	}
+
+	inline T& get(const int x, const int y, const int z)
+	{
+		assert(x < this->gridSize && y < this->gridSize && z < this->gridSize);
+		return this->storage[index(x, y, z)];
+	}
+
+	/* The B contiguous cells of the brick row holding (x, y, z), starting at z & ~(B - 1) */
+	inline T* row(const int x, const int y, const int z)
+	{
+		assert(x < this->gridSize && y < this->gridSize && z < this->gridSize);
+		return &this->storage[index(x, y, z) & ~cellMask];
+	}
+
+	/* Index of the next / previous cell along an axis, across bricks. No bound check, like morton3::incX */
+	static inline uint64_t incX(const uint64_t index) { return inc(index, xMask, uint64_t(1) << (2 * brickBits)); }
+	static inline uint64_t incY(const uint64_t index) { return inc(index, yMask, uint64_t(1) << brickBits); }
+	static inline uint64_t incZ(const uint64_t index) { return inc(index, zMask, 1); }
+	static inline uint64_t decX(const uint64_t index) { return dec(index, xMask, uint64_t(1) << (2 * brickBits)); }
+	static inline uint64_t decY(const uint64_t index) { return dec(index, yMask, uint64_t(1) << brickBits); }
+	static inline uint64_t decZ(const uint64_t index) { return dec(index, zMask, 1); }
+
+
+public:
+	int gridSize;
+
+private:
+	static inline uint64_t inc(const uint64_t index, const uint64_t mask, const uint64_t one)
+	{
+		return (((index | ~mask) + one) & mask) | (index & ~mask);
+	}
+
+	static inline uint64_t dec(const uint64_t index, const uint64_t mask, const uint64_t one)
+	{
+		return (((index & mask) - one) & mask) | (index & ~mask);
+	}
+
+	std::vector<T> storage;
+
+};
+
+/* Cells stored along the hilbert curve. gridSize must be a power of 2 */
+template<typename T>
+class HilbertGrid2d
+{
+public:
+
+	HilbertGrid2d(int gridSize)
+	{
+		//reserve space
+		storage.resize(gridSize*gridSize);
+		this->gridSize = gridSize;
+
+		//Fill with random values
+		std::generate(storage.begin(), storage.end(), std::rand);
+	}
+
+	inline void push(const int x, const int y, T data)
+	{
+		assert(x < this->gridSize && y < this->gridSize);
+		hilbert2 h = hilbert2(x, y);
+		this->storage[h.key] = data;
+	}
+
+	inline T& get(const hilbert2 index)
+	{
+		return this->storage[index.key];
+	}
+
+	inline T& get(const int x, const int y)
+	{
+		assert(x < this->gridSize && y < this->gridSize);
+		hilbert2 h = hilbert2(x, y);
+		return this->storage[h.key];
+	}
+
+
+public:
+	int gridSize;
+
+private:
+	std::vector<T> storage;
+
+};
+
+/* Cells stored along the hilbert curve. gridSize must be a power of 2 */
+template<typename T>
+class HilbertGrid3d
+{
+public:
+
+	HilbertGrid3d(int gridSize)
+	{
+		//reserve space
+		storage.resize(gridSize*gridSize*gridSize);
+		this->gridSize = gridSize;
+
+		//Fill with random values
+		std::generate(storage.begin(), storage.end(), std::rand);
+	}
+
+	inline void push(const int x, const int y, const int z, T data)
+	{
+		assert(x < this->gridSize && y < this->gridSize && z < this->gridSize);
+		hilbert3 h = hilbert3(x, y, z);
+		this->storage[h.key] = data;
+	}
+
+	inline T& get(const hilbert3 index)
+	{
+		return this->storage[index.key];
+	}
+
+	inline T& get(const int x, const int y, const int z)
+	{
+		assert(x < this->gridSize && y < this->gridSize && z < this->gridSize);
+		hilbert3 h = hilbert3(x, y, z);
+		return this->storage[h.key];
+	}
+
+
 public:
 	int gridSize;
 
@@ -3,8 +3,27 @@
 #include <cstdint>
 
 #include <iostream>
+#include <cmath>
+#include <limits>
+#include <numeric>
 #include "../include/morton2d.h"
 #include "../include/morton3d.h"
+#include "../include/mortonNd.h"
+#include "../include/morton_quantizer.h"
+#include "../include/morton_sort.h"
+#include "../include/morton_range.h"
+#include "../include/morton_octree.h"
+#include "../include/morton_hashgrid.h"
+#include "../include/morton_knn.h"
+#include "../include/morton_lbvh.h"
+#include "../include/hilbert2d.h"
+#include "../include/hilbert3d.h"
+#include "../include/morton_neighbors.h"
+#include "../include/morton_stencil.h"
+#include "../include/morton_batch.h"
+#include "../include/morton_file.h"
+#include "../include/morton_external_sort.h"
+#include "../include/morton_packed.h"
 #include "benchmark.h"
 
 
@@ -163,12 +182,1752 @@ void test_morton3d()
 
 }
 
+#ifdef __SIZEOF_INT128__
+void test_morton128()
+{
+	//Reference bit by bit interleaving
+	auto interleave3 = [](uint64_t x, uint64_t y, uint64_t z)
+	{
+		morton_uint128 key = 0;
+		for (int i = 0; i < 42; ++i)
+		{
+			key |= static_cast<morton_uint128>((x >> i) & 1) << (3 * i + 2);
+			key |= static_cast<morton_uint128>((y >> i) & 1) << (3 * i + 1);
+			key |= static_cast<morton_uint128>((z >> i) & 1) << (3 * i);
+		}
+		return key;
+	};
+
+	typedef morton3d<morton_uint128, morton_magicbits> morton3_128_mb;
+	typedef morton3d<morton_uint128, morton_lut16> morton3_128_lut16;
+	const uint64_t max42 = (1ull << 42) - 1;
+	srand(42);
+	for (int i = 0; i < 10000; ++i)
+	{
+		const uint64_t x = ((static_cast<uint64_t>(rand()) << 32) ^ rand() * 2654435761u) & max42;
+		const uint64_t y = ((static_cast<uint64_t>(rand()) << 32) ^ rand() * 2246822519u) & max42;
+		const uint64_t z = ((static_cast<uint64_t>(rand()) << 32) ^ rand() * 3266489917u) & max42;
+
+		morton3_128 m = morton3_128(x, y, z);
+		assert(m.key == interleave3(x, y, z));
+		assert(morton3_128_mb(x, y, z).key == m.key);
+		assert(morton3_128_lut16(x, y, z).key == m.key);
+
+		uint64_t x1, y1, z1;
+		m.decode(x1, y1, z1);
+		assert(x1 == x && y1 == y && z1 == z);
+
+		morton2_128 m2 = morton2_128(x * 2654435761u, y * 2246822519u);
+		uint64_t x2, y2;
+		m2.decode(x2, y2);
+		assert(x2 == x * 2654435761u && y2 == y * 2246822519u);
+	}
+
+	//Tesseral arithmetic across the two halves
+	const uint64_t x = 0x1fffff, y = 0x2fffff, z = 0x3ffffffffff;
+	morton3_128 m1 = morton3_128(x, y, z);
+	assert(m1.incX() == morton3_128(x + 1, y, z));
+	assert(m1.incY() == morton3_128(x, y + 1, z));
+	assert(m1.decZ() == morton3_128(x, y, z - 1));
+	assert(m1.incX().decX() == m1);
+	assert(m1 + morton3_128(1ull << 40, 5, 0) == morton3_128(x + (1ull << 40), y + 5, z));
+	assert(m1 - morton3_128(0x1fffff, 1, 1ull << 41) == morton3_128(0, y - 1, z - (1ull << 41)));
+	assert(morton3_128::min(m1, morton3_128(1ull << 41, 7, 9)) == morton3_128(x, 7, 9));
+	assert(morton3_128::max(m1, morton3_128(1ull << 41, 7, 9)) == morton3_128(1ull << 41, y, z));
+	assert((morton3_128(1ull << 41, 0, 0) >> 41) == morton3_128(1, 0, 0));
+	assert((morton3_128(1, 1, 1) << 40) == morton3_128(1ull << 40, 1ull << 40, 1ull << 40));
+
+	//Increments wrap at the largest coordinate, without reaching the last bit of the key
+	const morton3_128 top = morton3_128(max42, max42, (1ull << 43) - 1);
+	assert(top.incX() == morton3_128(0, max42, (1ull << 43) - 1) && top.incY() == morton3_128(max42, 0, (1ull << 43) - 1));
+	assert(top.incZ() == morton3_128(max42, max42, 0) && (top.incY().key >> 127) == 0 && (top.incX().key >> 127) == 0);
+	assert(morton3_128(0, 0, 0).decY() == morton3_128(0, max42, 0) && morton3_128(0, 0, 0).decX() == morton3_128(max42, 0, 0));
+	assert(top + morton3_128(0, 1, 0) == morton3_128(max42, 0, (1ull << 43) - 1));
+
+	morton2_128 m2 = morton2_128(0xffffffffull, 0x100000000ull);
+	assert(m2.incX() == morton2_128(0x100000000ull, 0x100000000ull));
+	assert(m2.decY() == morton2_128(0xffffffffull, 0xffffffffull));
+	assert(m2 + morton2_128(1ull << 63, 3) == morton2_128(0xffffffffull + (1ull << 63), 0x100000003ull));
+	assert(morton2_128::max(m2, morton2_128(1, ~0ull)) == morton2_128(0xffffffffull, ~0ull));
+}
+#endif
+
+void test_codecs()
+{
+	//Host selection
+	morton_cpu_features cpu = { true, true, true, false };
+	assert(mortonSelectCodec(cpu, nullptr) == MORTON_CODEC_BMI2);
+	assert(mortonSelectCodec(cpu, "lut") == MORTON_CODEC_LUT);
+	assert(mortonSelectCodec(cpu, "magicbits") == MORTON_CODEC_MAGICBITS);
+	assert(mortonSelectCodec(cpu, "unknown") == MORTON_CODEC_BMI2);
+	cpu.slowBMI2 = true;
+	assert(mortonSelectCodec(cpu, nullptr) == MORTON_CODEC_LUT);
+	assert(mortonSelectCodec(cpu, "bmi2") == MORTON_CODEC_BMI2);
+	cpu.bmi2 = false;
+	assert(mortonSelectCodec(cpu, "bmi2") == MORTON_CODEC_LUT);
+
+	//All codecs give the same keys
+	srand(42);
+	for (int i = 0; i < 10000; ++i)
+	{
+		const uint32_t x = static_cast<uint32_t>(rand()) * 2654435761u;
+		const uint32_t y = static_cast<uint32_t>(rand()) * 2246822519u;
+		const uint32_t z = static_cast<uint32_t>(rand()) * 3266489917u;
+
+		const uint64_t key2 = morton2d_codec<morton_lut8>::encode(x, y);
+		assert(morton2d_codec<morton_lut16>::encode(x, y) == key2);
+		assert(morton2d_codec<morton_magicbits>::encode(x, y) == key2);
+		assert(morton2d_codec<morton_dispatch>::encode(x, y) == key2);
+		const uint64_t key3 = morton3d_codec<morton_lut8>::encode(x, y, z);
+		assert(morton3d_codec<morton_lut16>::encode(x, y, z) == key3);
+		assert(morton3d_codec<morton_magicbits>::encode(x, y, z) == key3);
+		assert(morton3d_codec<morton_dispatch>::encode(x, y, z) == key3);
+
+		uint64_t x1, y1, z1, x2, y2, z2;
+		morton2d_codec<morton_magicbits>::decode(key2, x1, y1);
+		assert(x1 == x && y1 == y);
+		morton3d_codec<morton_magicbits>::decode(key3, x1, y1, z1);
+		assert(x1 == (x & 0x1fffff) && y1 == (y & 0x1fffff) && z1 == (z & 0x3fffff));
+		morton2d_codec<morton_lut8>::decode(key2, x2, y2);
+		assert(x2 == x && y2 == y);
+		morton3d_codec<morton_lut8>::decode(key3, x2, y2, z2);
+		assert(x2 == x1 && y2 == y1 && z2 == z1);
+		morton3d_codec<morton_dispatch>::decode(key3, x2, y2, z2);
+		assert(x2 == x1 && y2 == y1 && z2 == z1);
+
+		if (mortonCpu().bmi2)
+		{
+			assert(morton2d_codec<morton_bmi2>::encode(x, y) == key2);
+			assert(morton3d_codec<morton_bmi2>::encode(x, y, z) == key3);
+			morton2d_codec<morton_bmi2>::decode(key2, x2, y2);
+			assert(x2 == x && y2 == y);
+			morton3d_codec<morton_bmi2>::decode(key3, x2, y2, z2);
+			assert(x2 == x1 && y2 == y1 && z2 == z1);
+		}
+
+		const uint32_t xs = x & 0xFF, ys = y & 0xFF, zs = z & 0xFF;
+		assert(morton2d_codec<morton_lut256>::encode(xs, ys) == morton2d_codec<morton_lut8>::encode(xs, ys));
+		assert(morton3d_codec<morton_lut256>::encode(xs, ys, zs) == morton3d_codec<morton_lut8>::encode(xs, ys, zs));
+	}
+
+	//Codec as template parameter
+	typedef morton3d<uint64_t, morton_magicbits> morton3_mb;
+	morton3_mb m1 = morton3_mb(15, 79, 74);
+	assert(m1.key == morton3(15, 79, 74).key);
+	assert(m1 + morton3_mb(1, 2, 3) == morton3_mb(16, 81, 77));
+	assert(m1.incX().decY() == morton3_mb(16, 78, 74));
+	assert(morton3_mb::min(m1, morton3_mb(10, 80, 80)) == morton3_mb(10, 79, 74));
+	assert(morton3::morton3d_256(4, 5, 6) == morton3(4, 5, 6));
+
+	typedef morton2d<uint32_t, morton_lut16> morton2_lut16;
+	morton2_lut16 m2 = morton2_lut16(15, 79);
+	uint64_t x2, y2;
+	m2.decode(x2, y2);
+	assert(x2 == 15 && y2 == 79);
+	assert(m2 - morton2_lut16(5, 9) == morton2_lut16(10, 70));
+	assert(morton2::morton2d_256(4, 5) == morton2(4, 5));
+}
+
+void test_batch()
+{
+	//Odd size, to go through the scalar tail of the SIMD kernels
+	const size_t n = 1003;
+	std::vector<uint32_t> x(n), y(n), z(n);
+	srand(42);
+	for (size_t i = 0; i < n; ++i)
+	{
+		x[i] = static_cast<uint32_t>(rand()) * 2654435761u;
+		y[i] = static_cast<uint32_t>(rand()) * 2246822519u;
+		z[i] = static_cast<uint32_t>(rand()) * 3266489917u;
+	}
+	x[0] = 0xffffffff; y[0] = 0xffffffff; z[0] = 0xffffffff;
+	x[1] = 0x1fffff; y[1] = 0x1fffff; z[1] = 0x3fffff;
+	x[2] = 0; y[2] = 0; z[2] = 0;
+
+	std::vector<uint64_t> ref2(n), ref3(n), keys(n);
+	std::vector<uint32_t> xd(n), yd(n), zd(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		ref2[i] = morton2(x[i], y[i]).key;
+		ref3[i] = morton3(x[i], y[i], z[i]).key;
+	}
+
+	auto check2d = [&](void(*enc)(const uint32_t*, const uint32_t*, uint64_t*, size_t),
+		void(*dec)(const uint64_t*, uint32_t*, uint32_t*, size_t))
+	{
+		enc(x.data(), y.data(), keys.data(), n);
+		assert(keys == ref2);
+		dec(keys.data(), xd.data(), yd.data(), n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			uint64_t x1, y1;
+			morton2(keys[i]).decode(x1, y1);
+			assert(xd[i] == x1 && yd[i] == y1);
+		}
+	};
+
+	auto check3d = [&](void(*enc)(const uint32_t*, const uint32_t*, const uint32_t*, uint64_t*, size_t),
+		void(*dec)(const uint64_t*, uint32_t*, uint32_t*, uint32_t*, size_t))
+	{
+		enc(x.data(), y.data(), z.data(), keys.data(), n);
+		assert(keys == ref3);
+		dec(keys.data(), xd.data(), yd.data(), zd.data(), n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			uint64_t x1, y1, z1;
+			morton3(keys[i]).decode(x1, y1, z1);
+			assert(xd[i] == x1 && yd[i] == y1 && zd[i] == z1);
+		}
+	};
+
+	check2d(encode2d_scalar, decode2d_scalar);
+	check2d(encode2d, decode2d);
+	check3d(encode3d_scalar, decode3d_scalar);
+	check3d(encode3d, decode3d);
+	check2d(encode2d_scalar, decode2d_sse2);
+	check3d(encode3d_scalar, decode3d_sse2);
+
+	if (mortonCpu().avx2)
+	{
+		check2d(encode2d_avx2, decode2d_avx2);
+		check3d(encode3d_avx2, decode3d_avx2);
+	}
+
+	if (mortonCpu().avx512f)
+	{
+		check2d(encode2d_avx512, decode2d_avx512);
+		check3d(encode3d_avx512, decode3d_avx512);
+	}
+}
+
+void test_batchArithmetic()
+{
+	const size_t n = 1003;
+	std::vector<uint64_t> keys(n), out(n);
+	srand(42);
+	for (size_t i = 0; i < n; ++i)
+		keys[i] = static_cast<uint64_t>(rand()) << 42 ^ static_cast<uint64_t>(rand()) << 21 ^ static_cast<uint64_t>(rand());
+	keys[0] = 0;
+	keys[1] = ~0ull;
+
+	const morton3 offset3 = morton3(0x1fffff, 3, 100); // x - 1, y + 3, z + 100
+	const morton3 lo3 = morton3(1000, 20000, 300000), hi3 = morton3(1500000, 30000, 3000000);
+	const morton2 offset2 = morton2(5, 0xffffff00);
+	const morton2 lo2 = morton2(1000, 20000), hi2 = morton2(1500000, 0xf0000000);
+
+	typedef void(*arith3d)(const uint64_t (&)[3], const uint64_t*, uint64_t, uint64_t*, size_t);
+	typedef void(*clampFunc3d)(const uint64_t (&)[3], const uint64_t*, uint64_t, uint64_t, uint64_t*, size_t);
+	auto check3d = [&](arith3d add, arith3d sub, clampFunc3d clamp)
+	{
+		add(morton3dAxes, keys.data(), offset3.key, out.data(), n);
+		for (size_t i = 0; i < n; ++i)
+			assert(out[i] == (morton3(keys[i]) + offset3).key);
+		sub(morton3dAxes, keys.data(), offset3.key, out.data(), n);
+		for (size_t i = 0; i < n; ++i)
+			assert(out[i] == (morton3(keys[i]) - offset3).key);
+		clamp(morton3dAxes, keys.data(), lo3.key, hi3.key, out.data(), n);
+		for (size_t i = 0; i < n; ++i)
+			assert(out[i] == morton3::min(morton3::max(morton3(keys[i]), lo3), hi3).key);
+	};
+
+	typedef void(*arith2d)(const uint64_t (&)[2], const uint64_t*, uint64_t, uint64_t*, size_t);
+	typedef void(*clampFunc2d)(const uint64_t (&)[2], const uint64_t*, uint64_t, uint64_t, uint64_t*, size_t);
+	auto check2d = [&](arith2d add, arith2d sub, clampFunc2d clamp)
+	{
+		add(morton2dAxes, keys.data(), offset2.key, out.data(), n);
+		for (size_t i = 0; i < n; ++i)
+			assert(out[i] == (morton2(keys[i]) + offset2).key);
+		sub(morton2dAxes, keys.data(), offset2.key, out.data(), n);
+		for (size_t i = 0; i < n; ++i)
+			assert(out[i] == (morton2(keys[i]) - offset2).key);
+		clamp(morton2dAxes, keys.data(), lo2.key, hi2.key, out.data(), n);
+		for (size_t i = 0; i < n; ++i)
+			assert(out[i] == morton2::min(morton2::max(morton2(keys[i]), lo2), hi2).key);
+	};
+
+	check3d(addKeys_scalar<3>, subKeys_scalar<3>, clampKeys_scalar<3>);
+	check2d(addKeys_scalar<2>, subKeys_scalar<2>, clampKeys_scalar<2>);
+
+	if (mortonCpu().avx2)
+	{
+		check3d(addKeys_avx2<3>, subKeys_avx2<3>, clampKeys_avx2<3>);
+		check2d(addKeys_avx2<2>, subKeys_avx2<2>, clampKeys_avx2<2>);
+	}
+
+	if (mortonCpu().avx512f)
+	{
+		check3d(addKeys_avx512<3>, subKeys_avx512<3>, clampKeys_avx512<3>);
+		check2d(addKeys_avx512<2>, subKeys_avx512<2>, clampKeys_avx512<2>);
+	}
+
+	//Wrappers
+	add3d(keys.data(), offset3, out.data(), n);
+	sub3d(out.data(), offset3, out.data(), n);
+	assert(out == keys);
+	clamp3d(keys.data(), lo3, hi3, out.data(), n);
+	for (size_t i = 0; i < n; ++i)
+		assert(out[i] == morton3::min(morton3::max(morton3(keys[i]), lo3), hi3).key);
+	add2d(keys.data(), offset2, out.data(), n);
+	sub2d(out.data(), offset2, out.data(), n);
+	assert(out == keys);
+	clamp2d(keys.data(), lo2, hi2, out.data(), n);
+	for (size_t i = 0; i < n; ++i)
+		assert(out[i] == morton2::min(morton2::max(morton2(keys[i]), lo2), hi2).key);
+
+	inc3d(keys.data(), 0, out.data(), n);
+	for (size_t i = 0; i < n; ++i)
+		assert(out[i] == morton3(keys[i]).incX().key);
+	dec3d(keys.data(), 2, out.data(), n);
+	for (size_t i = 0; i < n; ++i)
+		assert(out[i] == morton3(keys[i]).decZ().key);
+	inc2d(keys.data(), 1, out.data(), n);
+	for (size_t i = 0; i < n; ++i)
+		assert(out[i] == morton2(keys[i]).incY().key);
+	dec2d(keys.data(), 0, out.data(), n);
+	for (size_t i = 0; i < n; ++i)
+		assert(out[i] == morton2(keys[i]).decX().key);
+}
+
+template<class Real>
+void test_quantizerArrays()
+{
+	const size_t n = 1003;
+	std::vector<Real> x(n), y(n), z(n), xd(n), yd(n), zd(n);
+	std::vector<uint64_t> keys(n), ref(n);
+	srand(42);
+	for (size_t i = 0; i < n; ++i)
+	{
+		//Slightly larger than the box, to check clamping
+		x[i] = static_cast<Real>(-1.5 + 13.0 * rand() / RAND_MAX);
+		y[i] = static_cast<Real>(-0.5 + 2.0 * rand() / RAND_MAX);
+		z[i] = static_cast<Real>(99.0 + 3.0 * rand() / RAND_MAX);
+	}
+	x[0] = std::numeric_limits<Real>::quiet_NaN();
+	x[1] = -std::numeric_limits<Real>::infinity();
+	x[2] = std::numeric_limits<Real>::infinity();
+
+	const morton3d_quantizer<Real> q3({ -1, 0, 100 }, { 11, 1, 101 }, 21);
+	q3.encode_scalar(x.data(), y.data(), z.data(), ref.data(), n);
+	q3.encode(x.data(), y.data(), z.data(), keys.data(), n);
+	assert(keys == ref);
+	if (mortonCpu().avx2)
+	{
+		q3.encode_avx2(x.data(), y.data(), z.data(), keys.data(), n);
+		assert(keys == ref);
+	}
+	if (mortonCpu().avx512f)
+	{
+		q3.encode_avx512(x.data(), y.data(), z.data(), keys.data(), n);
+		assert(keys == ref);
+	}
+	q3.decode(keys.data(), xd.data(), yd.data(), zd.data(), n);
+	for (size_t i = 3; i < n; ++i)
+	{
+		Real x1, y1, z1;
+		q3.decode(morton3(keys[i]), x1, y1, z1);
+		assert(xd[i] == x1 && yd[i] == y1 && zd[i] == z1);
+		if (x[i] >= -1 && x[i] <= 11)
+			assert(std::abs(xd[i] - x[i]) <= 12.0 / (1 << 21) / 2 * 1.0001);
+		if (y[i] >= 0 && y[i] <= 1 && std::is_same<Real, double>::value)
+			assert(std::abs(yd[i] - y[i]) <= 1.0 / (1 << 21) / 2 * 1.0001);
+	}
+
+	const morton2d_quantizer<Real> q2({ -1, 0 }, { 11, 1 }, 32);
+	q2.encode_scalar(x.data(), y.data(), ref.data(), n);
+	q2.encode(x.data(), y.data(), keys.data(), n);
+	assert(keys == ref);
+	if (mortonCpu().avx2)
+	{
+		q2.encode_avx2(x.data(), y.data(), keys.data(), n);
+		assert(keys == ref);
+	}
+	if (mortonCpu().avx512f)
+	{
+		q2.encode_avx512(x.data(), y.data(), keys.data(), n);
+		assert(keys == ref);
+	}
+	q2.decode(keys.data(), xd.data(), yd.data(), n);
+	for (size_t i = 3; i < n; ++i)
+	{
+		Real x1, y1;
+		q2.decode(morton2(keys[i]), x1, y1);
+		assert(xd[i] == x1 && yd[i] == y1);
+	}
+}
+
+void test_quantizer()
+{
+	//4 cells of 0.25 per axis
+	const morton3d_quantizer<double> q({ 0, 0, 0 }, { 1, 2, 4 }, 2);
+	assert(q.encode(0, 0, 0) == morton3(0, 0, 0));
+	assert(q.encode(0.24, 0.49, 0.99) == morton3(0, 0, 0));
+	assert(q.encode(0.25, 0.5, 1) == morton3(1, 1, 1));
+	assert(q.encode(1, 2, 4) == morton3(3, 3, 3)); // The box is closed
+	assert(q.encode(-5, 5, std::numeric_limits<double>::quiet_NaN()) == morton3(0, 3, 0));
+	double x, y, z;
+	q.decode(morton3(1, 2, 3), x, y, z);
+	assert(x == 0.375 && y == 1.25 && z == 3.5);
+
+	//Flat axis
+	const morton2d_quantizer<float> flat({ 0.f, 1.f }, { 1.f, 1.f }, 8);
+	assert(flat.encode(0.5f, 1.f) == morton2(128, 0));
+	assert(flat.encode(0.5f, 7.f) == morton2(128, 0));
+
+	//Cell boundaries of a 32 bits axis
+	const morton2d_quantizer<double> q2({ 0, 0 }, { 4294967296.0, 1 }, 32);
+	assert(q2.encode(4294967295.0, 0) == morton2(0xffffffff, 0));
+	assert(q2.encode(4294967294.5, 0) == morton2(0xfffffffe, 0));
+	assert(q2.encode(2147483648.0, 0) == morton2(0x80000000, 0));
+	assert(q2.encode(2147483647.9, 0) == morton2(0x7fffffff, 0));
+
+	test_quantizerArrays<float>();
+	test_quantizerArrays<double>();
+}
+
+template<class Key>
+void test_sortKeys(const std::vector<Key>& keys, const unsigned int threads)
+{
+	typedef decltype(mortonSortKey(keys[0])) T;
+	auto less = [](const Key& a, const Key& b) { return mortonSortKey(a) < mortonSortKey(b); };
+	std::vector<Key> ref = keys;
+	std::stable_sort(ref.begin(), ref.end(), less);
+
+	std::vector<Key> sorted = keys;
+	mortonSort(sorted.data(), sorted.size(), threads);
+	assert(std::equal(sorted.begin(), sorted.end(), ref.begin(), [](const Key& a, const Key& b) { return mortonSortKey(a) == mortonSortKey(b); }));
+
+	sorted = keys;
+	mortonSortInPlace(sorted.data(), sorted.size(), threads);
+	assert(std::equal(sorted.begin(), sorted.end(), ref.begin(), [](const Key& a, const Key& b) { return mortonSortKey(a) == mortonSortKey(b); }));
+
+	//Payload and permutation follow the stable order
+	std::vector<uint32_t> perm(keys.size()), payload(keys.size());
+	mortonSortPermutation(keys.data(), perm.data(), keys.size(), threads);
+	sorted = keys;
+	std::iota(payload.begin(), payload.end(), 0);
+	mortonSort(sorted.data(), payload.data(), sorted.size(), threads);
+	assert(perm == payload);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		assert(mortonSortKey(keys[perm[i]]) == mortonSortKey(ref[i]));
+		assert(i == 0 || mortonSortKey(keys[perm[i - 1]]) != mortonSortKey(keys[perm[i]]) || perm[i - 1] < perm[i]);
+	}
+	(void)sizeof(T);
+}
+
+void test_sort()
+{
+	srand(42);
+	for (const size_t n : { 0, 1, 50, 1000, 300000 })
+	{
+		//Full keys, a small grid (3 bytes, with duplicates), and raw keys
+		std::vector<morton3> full(n), grid(n);
+		std::vector<uint64_t> raw(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			full[i] = morton3(static_cast<uint64_t>(rand()) << 42 ^ static_cast<uint64_t>(rand()) << 21 ^ rand());
+			grid[i] = morton3(rand() % 64, rand() % 64, rand() % 64);
+			raw[i] = grid[i].key << 20;
+		}
+
+		for (const unsigned int threads : { 1, 4 })
+		{
+			test_sortKeys(full, threads);
+			test_sortKeys(grid, threads);
+			test_sortKeys(raw, threads);
+		}
+
+		std::vector<morton2d<uint32_t>> keys2(n);
+		for (size_t i = 0; i < n; ++i)
+			keys2[i] = morton2d<uint32_t>(rand() % 65536, rand() % 65536);
+		test_sortKeys(keys2, 0);
+#ifdef __SIZEOF_INT128__
+		std::vector<morton3_128> keys128(n);
+		for (size_t i = 0; i < n; ++i)
+			keys128[i] = morton3_128(static_cast<uint64_t>(rand()) << 20 ^ rand(), rand(), rand() % 16);
+		test_sortKeys(keys128, 2);
+#endif
+	}
+}
+
+/* Every key of a small grid against brute force BIGMIN / LITMAX, ranges and queries */
+template<class Key>
+void test_rangeBox(const std::vector<Key>& grid, const Key min, const Key max)
+{
+	std::vector<Key> inBox;
+	for (const Key& m : grid)
+	{
+		if (mortonInBox(m, min, max))
+			inBox.push_back(m);
+	}
+	assert(!inBox.empty() && inBox.front().key == min.key && inBox.back().key == max.key);
+
+	for (const Key& m : grid)
+	{
+		auto next = std::upper_bound(inBox.begin(), inBox.end(), m, [](const Key& a, const Key& b) { return a.key < b.key; });
+		Key bigmin;
+		assert(mortonBigMin(m, min, max, bigmin) == (next != inBox.end()));
+		assert(next == inBox.end() || bigmin.key == next->key);
+
+		auto prev = std::lower_bound(inBox.begin(), inBox.end(), m, [](const Key& a, const Key& b) { return a.key < b.key; });
+		Key litmax;
+		assert(mortonLitMax(m, min, max, litmax) == (prev != inBox.begin()));
+		assert(prev == inBox.begin() || litmax.key == (prev - 1)->key);
+	}
+
+	//Exact ranges hold the keys of the box and nothing else
+	std::vector<morton_range<Key>> ranges = mortonBoxRanges(min, max);
+	size_t count = 0;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		assert(ranges[i].first.key <= ranges[i].last.key);
+		assert(i == 0 || ranges[i - 1].last.key + 1 < ranges[i].first.key);
+		count += static_cast<size_t>(ranges[i].last.key - ranges[i].first.key + 1);
+	}
+	assert(count == inBox.size());
+	for (const Key& m : inBox)
+		assert(std::any_of(ranges.begin(), ranges.end(), [&](const morton_range<Key>& r) { return r.first.key <= m.key && m.key <= r.last.key; }));
+
+	//Capped ranges cover the box
+	for (const size_t cap : { 1, 2, 3, 8 })
+	{
+		std::vector<morton_range<Key>> capped = mortonBoxRanges(min, max, cap);
+		assert(capped.size() <= cap);
+		for (const Key& m : inBox)
+			assert(std::any_of(capped.begin(), capped.end(), [&](const morton_range<Key>& r) { return r.first.key <= m.key && m.key <= r.last.key; }));
+	}
+
+	//Query on half of the grid
+	std::vector<Key> keys;
+	for (size_t i = 0; i < grid.size(); i += 2)
+		keys.push_back(grid[i]);
+	std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.key < b.key; });
+	std::vector<size_t> found;
+	const size_t visited = mortonBoxQuery(keys.data(), keys.size(), min, max, [&](const size_t i) { found.push_back(i); });
+	assert(visited >= found.size() && visited <= keys.size());
+	size_t expected = 0;
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		if (mortonInBox(keys[i], min, max))
+		{
+			assert(expected < found.size() && found[expected] == i);
+			++expected;
+		}
+	}
+	assert(expected == found.size());
+}
+
+void test_range()
+{
+	srand(7);
+	std::vector<morton3> grid3;
+	for (uint64_t x = 0; x < 16; ++x)
+		for (uint64_t y = 0; y < 16; ++y)
+			for (uint64_t z = 0; z < 16; ++z)
+				grid3.push_back(morton3(x, y, z));
+	std::sort(grid3.begin(), grid3.end(), [](const morton3& a, const morton3& b) { return a.key < b.key; });
+
+	std::vector<morton2> grid2;
+	for (uint64_t x = 0; x < 64; ++x)
+		for (uint64_t y = 0; y < 64; ++y)
+			grid2.push_back(morton2(x, y));
+	std::sort(grid2.begin(), grid2.end(), [](const morton2& a, const morton2& b) { return a.key < b.key; });
+
+	for (int i = 0; i < 40; ++i)
+	{
+		uint64_t lo[3], hi[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			lo[a] = rand() % 16;
+			hi[a] = lo[a] + rand() % (16 - lo[a]);
+		}
+		test_rangeBox(grid3, morton3(lo[0], lo[1], lo[2]), morton3(hi[0], hi[1], hi[2]));
+
+		for (int a = 0; a < 2; ++a)
+		{
+			lo[a] = rand() % 64;
+			hi[a] = lo[a] + rand() % (64 - lo[a]);
+		}
+		test_rangeBox(grid2, morton2(lo[0], lo[1]), morton2(hi[0], hi[1]));
+	}
+
+	//Single key box, whole grid box and a 4d box
+	test_rangeBox(grid3, morton3(5, 6, 7), morton3(5, 6, 7));
+	test_rangeBox(grid3, morton3(0, 0, 0), morton3(15, 15, 15));
+	assert(mortonBoxRanges(morton3(0, 0, 0), morton3(15, 15, 15)).size() == 1);
+	std::vector<morton4> grid4;
+	for (uint64_t k = 0; k < 4096; ++k)
+		grid4.push_back(morton4(k));
+	test_rangeBox(grid4, morton4(1, 2, 0, 3), morton4(6, 5, 7, 4));
+
+	//Keys on the highest bits
+	const morton3 far(0x1fffff, 0x1fffff, 0x3fffff);
+	morton3 next;
+	assert(mortonBigMin(morton3(0, 0, 0), morton3(0x1ffff0, 0x1ffff0, 0x3ffff0), far, next) && next == morton3(0x1ffff0, 0x1ffff0, 0x3ffff0));
+	assert(!mortonBigMin(far, morton3(0, 0, 0), far, next));
+	assert(mortonBoxRanges(morton3(0, 0, 0), far).size() == 1);
+
+	//Large unaligned box : cells inside are not split, the intervals cover exactly its 512^3 keys
+	const std::vector<morton_range<morton3>> large = mortonBoxRanges(morton3(3, 5, 7), morton3(514, 516, 518));
+	uint64_t cells = 0;
+	for (const morton_range<morton3>& r : large)
+		cells += r.last.key - r.first.key + 1;
+	assert(cells == 512ull * 512 * 512);
+	assert(mortonBoxRanges(morton3(3, 5, 7), morton3(514, 516, 518), 100).size() <= 100);
+}
+
+void test_octree()
+{
+	typedef morton_node<morton3> node3;
+	typedef morton_node<morton2> node2;
+	const unsigned int levels = mortonNodeLevels<morton3>();
+	assert(levels == 21 && mortonNodeLevels<morton2>() == 32);
+
+	//Navigation
+	const node3 cell = { morton3(5, 6, 7), levels };
+	const node3 n = mortonNode(morton3(5, 6, 7), levels - 2); // (4, 4, 4) to (7, 7, 7)
+	assert(n.key == morton3(4, 4, 4) && n.level == levels - 2);
+	assert(mortonNodeRange(n).first == morton3(4, 4, 4) && mortonNodeRange(n).last == morton3(7, 7, 7));
+	assert(mortonParent(mortonParent(cell)) == n);
+	assert(mortonChild(n, 7) == mortonNode(morton3(6, 6, 6), levels - 1));
+	assert(mortonChild(mortonChild(n, 3), 5) == cell);
+	assert(mortonChildIndex(cell) == 5 && mortonChildIndex(mortonChild(n, 5)) == 5);
+	assert(mortonSibling(cell, 0) == node3({ morton3(4, 6, 6), levels }));
+	assert(mortonSibling(cell, mortonChildIndex(cell)) == cell);
+	assert(mortonIsAncestor(n, cell) && !mortonIsAncestor(cell, n) && !mortonIsAncestor(n, n));
+	assert(mortonIsAncestor(node3({ morton3(0, 0, 0), 0 }), cell));
+	assert(!mortonIsAncestor(mortonNode(morton3(8, 4, 4), levels - 2), cell));
+	assert(mortonCommonAncestor(cell, node3({ morton3(4, 5, 6), levels })) == n);
+	assert(mortonCommonAncestor(cell, n) == n && mortonCommonAncestor(cell, cell) == cell);
+	assert(mortonCommonAncestor(cell, node3({ morton3(0x1fffff, 0, 0), levels })).level == 0);
+	assert(mortonCommonAncestor(node2({ morton2(3, 0), 32 }), node2({ morton2(2, 1), 32 })) == mortonNode(morton2(2, 0), 31));
+	assert(n < cell && mortonParent(n) < n && cell < mortonNode(morton3(8, 0, 0), levels - 3));
+
+	//Common ancestor against a walk up the tree
+	srand(3);
+	for (int i = 0; i < 1000; ++i)
+	{
+		const node3 a = mortonNode(morton3(rand() % 64, rand() % 64, rand() % 64), levels - rand() % 7);
+		const node3 b = mortonNode(morton3(rand() % 64, rand() % 64, rand() % 64), levels - rand() % 7);
+		node3 p = a;
+		while (p != b && !mortonIsAncestor(p, b))
+			p = mortonParent(p);
+		assert(mortonCommonAncestor(a, b) == p && mortonCommonAncestor(b, a) == p);
+	}
+
+	//Adaptive octree : every key is in exactly one leaf, with at most 4 keys per leaf
+	std::vector<morton3> keys(5000);
+	std::generate(keys.begin(), keys.end(), [](){ return morton3(rand() % 256, rand() % 256, rand() % 256); });
+	std::sort(keys.begin(), keys.end(), [](const morton3& a, const morton3& b) { return a.key < b.key; });
+	const morton_octree3 tree = morton_octree3::adaptive(keys.data(), keys.size(), 4);
+	assert(!tree.empty());
+	std::vector<size_t> count(tree.size());
+	for (const morton3& k : keys)
+	{
+		const size_t leaf = tree.find(k);
+		assert(leaf != morton_octree3::npos);
+		++count[leaf];
+	}
+	for (size_t i = 0; i < tree.size(); ++i)
+	{
+		assert(count[i] > 0 && (count[i] <= 4 || tree[i].level == levels));
+		assert(i == 0 || (tree[i - 1] < tree[i] && !mortonIsAncestor(tree[i - 1], tree[i])));
+		assert(tree.isLeaf(tree[i]) && !tree.isLeaf(mortonParent(tree[i])));
+	}
+	assert(tree.find(morton3(1000, 0, 0)) == morton_octree3::npos);
+
+	//Keys outside the cells of the tree (z above 2^21 sets bit 63 of the key), and at its last cell
+	const morton3 outside(1, 1, (1u << 21) + 5), last(0x1fffff, 0x1fffff, 0x1fffff);
+	const node3 above = { outside, levels };
+	assert(tree.find(outside) == morton_octree3::npos && !tree.isLeaf(above));
+	assert(tree.overlap(above).first == tree.size() && tree.overlap(above).second == tree.size());
+	assert(tree.find(last) == morton_octree3::npos && morton_octree3().find(outside) == morton_octree3::npos);
+	const morton_octree3 corner(&last, 1);
+	assert(corner.find(last) == 0 && corner.find(outside) == morton_octree3::npos);
+
+	//Leaves overlapping a node
+	const node3 root = { morton3(0, 0, 0), 0 };
+	assert(tree.overlap(root) == std::make_pair(static_cast<size_t>(0), tree.size()));
+	const node3 octant = mortonNode(morton3(128, 0, 128), levels - 7);
+	const std::pair<size_t, size_t> o = tree.overlap(octant);
+	for (size_t i = 0; i < tree.size(); ++i)
+		assert((i >= o.first && i < o.second) == mortonIsAncestor(octant, tree[i]));
+	const node3 below = mortonChild(tree[0], 3);
+	assert(tree.overlap(below) == std::make_pair(static_cast<size_t>(0), static_cast<size_t>(1)));
+
+	//Leaves of a single level, and from nodes
+	const morton_octree3 level5(keys.data(), keys.size(), 5);
+	for (const morton3& k : keys)
+		assert(level5[level5.find(k)] == mortonNode(k, 5));
+	const node3 nodes[] = { mortonNode(morton3(0, 0, 0), 1), mortonNode(morton3(3, 3, 3), 20), mortonNode(morton3(0x100000, 0, 0), 2), mortonNode(morton3(0x100000, 0, 0), 2) };
+	const morton_octree3 fromNodes(nodes, 4);
+	assert(fromNodes.size() == 2 && fromNodes[0] == nodes[0] && fromNodes[1] == nodes[2]);
+
+	std::vector<morton2> keys2 = { morton2(0, 0), morton2(1, 0), morton2(1000, 7) };
+	std::sort(keys2.begin(), keys2.end(), [](const morton2& a, const morton2& b) { return a.key < b.key; });
+	const morton_quadtree2 quadtree = morton_quadtree2::adaptive(keys2.data(), keys2.size(), 1);
+	assert(quadtree.size() == 3 && quadtree.find(morton2(1, 0)) == 1 && quadtree[1].level == 32);
+	assert(morton_quadtree2().find(morton2(3, 3)) == morton_quadtree2::npos);
+}
+
+void test_hashgrid()
+{
+	//Random sets and erases against a dense reference
+	srand(11);
+	const int size = 40;
+	std::vector<int> ref(size * size * size, -1);
+	morton_hashgrid3d<int> grid;
+	assert(grid.size() == 0 && grid.find(morton3(0, 0, 0)) == nullptr && grid.get(morton3(1, 2, 3), 7) == 7);
+	for (int i = 0; i < 200000; ++i)
+	{
+		const int x = rand() % size, y = rand() % size, z = rand() % size;
+		const morton3 m(x, y, z);
+		int& r = ref[(x * size + y) * size + z];
+		if (rand() % 3 == 0)
+		{
+			assert(grid.erase(m) == (r >= 0));
+			r = -1;
+		}
+		else
+		{
+			r = i;
+			grid.set(m, i);
+		}
+	}
+
+	size_t count = 0;
+	for (int x = 0; x < size; ++x)
+		for (int y = 0; y < size; ++y)
+			for (int z = 0; z < size; ++z)
+			{
+				const morton3 m(x, y, z);
+				const int r = ref[(x * size + y) * size + z];
+				assert(grid.contains(m) == (r >= 0) && grid.get(m, -1) == r);
+				count += r >= 0;
+
+				const int xn = x > 0 ? ref[((x - 1) * size + y) * size + z] : -1;
+				const int zn = z + 1 < size ? ref[(x * size + y) * size + z + 1] : -1;
+				assert(x == 0 || (grid.neighbor(m, 0, -1) ? *grid.neighbor(m, 0, -1) : -1) == xn);
+				assert(z + 1 == size || (grid.neighbor(m, 2, 1) ? *grid.neighbor(m, 2, 1) : -1) == zn);
+			}
+	assert(grid.size() == count);
+
+	size_t visited = 0;
+	grid.forEach([&](const morton3 m, const int v)
+	{
+		uint64_t x, y, z;
+		m.decode(x, y, z);
+		assert(ref[(x * size + y) * size + z] == v);
+		++visited;
+	});
+	assert(visited == count);
+
+	//Erasing everything frees all bricks
+	for (int x = 0; x < size; ++x)
+		for (int y = 0; y < size; ++y)
+			for (int z = 0; z < size; ++z)
+				grid.erase(morton3(x, y, z));
+	assert(grid.size() == 0 && grid.brickCount() == 0);
+
+	//Far apart voxels, one brick each
+	morton_hashgrid3d<float> sparse;
+	sparse.set(morton3(4095, 4095, 4095), 1.f);
+	sparse.set(morton3(0, 0, 0), 2.f);
+	sparse.set(morton3(7, 7, 7), 3.f);
+	sparse.set(morton3(8, 0, 0), 4.f);
+	assert(sparse.size() == 4 && sparse.brickCount() == 3);
+	assert(*sparse.neighbor(morton3(7, 0, 0), 0, 1) == 4.f && !sparse.neighbor(morton3(8, 0, 0), 1, 1));
+	*sparse.find(morton3(0, 0, 0)) = 5.f;
+	assert(sparse.get(morton3(0, 0, 0)) == 5.f);
+}
+
+/* Distances of the k nearest points, brute force */
+template<class Key>
+std::vector<double> test_knnBruteForce(const std::vector<Key>& points, const Key query, const size_t k)
+{
+	typedef morton_knn_traits<Key> traits;
+	uint64_t q[traits::dims];
+	traits::encoder::decode(query.key, q);
+	std::vector<double> d2;
+	for (const Key& p : points)
+		d2.push_back(mortonDistance2(q, p));
+	std::sort(d2.begin(), d2.end());
+	d2.resize(std::min(k, d2.size()));
+	return d2;
+}
+
+template<class Key>
+void test_knnPoints(std::vector<Key> points, const std::vector<Key>& queries)
+{
+	typedef morton_knn_traits<Key> traits;
+	std::sort(points.begin(), points.end(), [](const Key& a, const Key& b) { return a.key < b.key; });
+	const size_t n = points.size();
+
+	for (const size_t k : { 1, 5, 32 })
+	{
+		std::vector<size_t> batch(queries.size() * k);
+		std::vector<double> batch2(queries.size() * k);
+		assert(mortonKnnBatch(points.data(), n, queries.data(), queries.size(), k, batch.data(), batch2.data(), 2) == std::min(k, n));
+
+		for (size_t j = 0; j < queries.size(); ++j)
+		{
+			const std::vector<double> ref = test_knnBruteForce(points, queries[j], k);
+			std::vector<size_t> indices(k);
+			std::vector<double> d2(k);
+			assert(mortonKnn(points.data(), n, queries[j], k, indices.data(), d2.data()) == ref.size());
+
+			uint64_t q[traits::dims];
+			traits::encoder::decode(queries[j].key, q);
+			for (size_t i = 0; i < ref.size(); ++i)
+			{
+				assert(d2[i] == ref[i] && mortonDistance2(q, points[indices[i]]) == ref[i]);
+				assert(batch2[j * k + i] == ref[i] && mortonDistance2(q, points[batch[j * k + i]]) == ref[i]);
+			}
+
+			//No point twice, the first candidates being met again in the tree
+			indices.resize(ref.size());
+			std::sort(indices.begin(), indices.end());
+			assert(std::unique(indices.begin(), indices.end()) == indices.end());
+		}
+	}
+
+	//Radii beyond the coordinates, and NaN, which finds no point
+	for (const double radius : { 0.0, 1.5, 6.0, 1000.0, 1e30, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN() })
+	{
+		for (const Key& query : queries)
+		{
+			uint64_t q[traits::dims];
+			traits::encoder::decode(query.key, q);
+			size_t expected = 0;
+			for (const Key& p : points)
+				expected += mortonDistance2(q, p) <= radius * radius;
+			std::vector<size_t> found;
+			assert(mortonRadiusSearch(points.data(), n, query, radius, [&](const size_t i, const double d2)
+			{
+				assert(d2 <= radius * radius && d2 == mortonDistance2(q, points[i]));
+				found.push_back(i);
+			}) == expected);
+			assert(found.size() == expected && std::is_sorted(found.begin(), found.end()));
+		}
+	}
+}
+
+void test_knn()
+{
+	srand(5);
+	std::vector<morton3> points3(2000), queries3(200);
+	std::generate(points3.begin(), points3.end(), [](){ return morton3(rand() % 64, rand() % 64, rand() % 64); });
+	std::generate(queries3.begin(), queries3.end(), [](){ return morton3(rand() % 70, rand() % 70, rand() % 70); });
+	queries3.push_back(morton3(0x1fffff, 0x1fffff, 0x3fffff));
+	queries3.push_back(morton3(0, 0, 0));
+	test_knnPoints(points3, queries3);
+
+	//Clusters far apart
+	std::vector<morton3> clusters(300);
+	std::generate(clusters.begin(), clusters.end(), [](){ return morton3(rand() % 4 + (rand() % 2) * 100000, rand() % 4, rand() % 4 + (rand() % 2) * 2000000); });
+	test_knnPoints(clusters, queries3);
+
+	std::vector<morton2> points2(1000), queries2(100);
+	std::generate(points2.begin(), points2.end(), [](){ return morton2(rand() % 300, rand() % 300); });
+	std::generate(queries2.begin(), queries2.end(), [](){ return morton2(rand() % 300, rand() % 300); });
+	test_knnPoints(points2, queries2);
+
+	//Fewer points than k
+	std::vector<morton3> few = { morton3(1, 2, 3), morton3(4, 5, 6) };
+	test_knnPoints(few, queries3);
+	size_t index;
+	assert(mortonKnn(few.data(), 0, morton3(0, 0, 0), 3, &index) == 0);
+
+	//Hint holding the same point more than once
+	std::sort(points3.begin(), points3.end(), [](const morton3& a, const morton3& b) { return a.key < b.key; });
+	const size_t hint[4] = { 7, 7, 3, 7 };
+	size_t found[4];
+	morton_knn_search<morton3> search;
+	assert(search.query(points3.data(), points3.size(), points3[7], 4, found, nullptr, hint) == 4);
+	std::sort(found, found + 4);
+	assert(std::unique(found, found + 4) == found + 4 && std::binary_search(found, found + 4, size_t(7)));
+}
+
+/* Structure of a BVH : every primitive in one leaf, bounds of each node are the union of its children */
+size_t test_lbvhNode(const morton_lbvh& bvh, const morton_aabb* boxes, const uint32_t node, std::vector<int>& seen)
+{
+	const morton_bvh_node& n = bvh.nodes[node];
+	if (n.right == mortonBvhLeaf)
+	{
+		++seen[n.left];
+		assert(std::equal(n.bounds.lo, n.bounds.lo + 3, boxes[n.left].lo) && std::equal(n.bounds.hi, n.bounds.hi + 3, boxes[n.left].hi));
+		return 1;
+	}
+	const morton_aabb merged = mortonMerge(bvh.nodes[n.left].bounds, bvh.nodes[n.right].bounds);
+	assert(std::equal(n.bounds.lo, n.bounds.lo + 3, merged.lo) && std::equal(n.bounds.hi, n.bounds.hi + 3, merged.hi));
+	return 1 + test_lbvhNode(bvh, boxes, n.left, seen) + test_lbvhNode(bvh, boxes, n.right, seen);
+}
+
+void test_lbvh()
+{
+	srand(9);
+	morton_lbvh bvh;
+	for (const size_t n : { 1, 2, 3, 100, 5000, 200000 })
+	{
+		for (const bool duplicates : { false, true })
+		{
+			std::vector<morton_aabb> boxes(n);
+			for (morton_aabb& b : boxes)
+			{
+				for (int a = 0; a < 3; ++a)
+				{
+					b.lo[a] = duplicates ? static_cast<float>(rand() % 4) : static_cast<float>(rand()) / RAND_MAX * 100.f - 50.f;
+					b.hi[a] = b.lo[a] + static_cast<float>(rand() % 5);
+				}
+			}
+			bvh.build(boxes.data(), n, 4);
+			assert(bvh.nodes.size() == 2 * n - 1);
+			std::vector<int> seen(n);
+			assert(test_lbvhNode(bvh, boxes.data(), 0, seen) == 2 * n - 1);
+			assert(std::all_of(seen.begin(), seen.end(), [](const int s) { return s == 1; }));
+
+			//Overlap queries against brute force
+			for (int q = 0; q < 20; ++q)
+			{
+				const morton_aabb query = { { -10.f + q, -5.f, 0.f }, { -8.f + q, 5.f, 1.f + q } };
+				std::vector<uint32_t> found, expected;
+				bvh.overlap(query, [&](const uint32_t p) { found.push_back(p); });
+				for (size_t i = 0; i < n; ++i)
+				{
+					if (mortonOverlap(boxes[i], query))
+						expected.push_back(static_cast<uint32_t>(i));
+				}
+				std::sort(found.begin(), found.end());
+				assert(found == expected);
+			}
+		}
+	}
+	bvh.build(nullptr, 0);
+	assert(bvh.nodes.empty());
+}
+
+template<class T, class Codec>
+void test_hilbertDecode(const hilbert2d<T, Codec>& h, uint64_t(&c)[2]) { h.decode(c[0], c[1]); }
+
+template<class T, class Codec>
+void test_hilbertDecode(const hilbert3d<T, Codec>& h, uint64_t(&c)[3]) { h.decode(c[0], c[1], c[2]); }
+
+/* Every key of the first 2^(D * bits) is a distinct cell of the [0, 2^bits)^D cube, and consecutive keys are neighbors */
+template<class Hilbert, unsigned int D>
+void test_hilbertCurve(const unsigned int bits)
+{
+	const uint64_t cells = 1ull << (D * bits);
+	std::vector<bool> seen(cells);
+	uint64_t previous[D] = {};
+	for (uint64_t k = 0; k < cells; ++k)
+	{
+		const Hilbert h(static_cast<decltype(h.key)>(k));
+		uint64_t c[D];
+		test_hilbertDecode(h, c);
+
+		uint64_t index = 0, distance = 0;
+		for (unsigned int a = 0; a < D; ++a)
+		{
+			assert(c[a] < (1ull << bits));
+			index = index << bits | c[a];
+			distance += c[a] > previous[a] ? c[a] - previous[a] : previous[a] - c[a];
+			previous[a] = c[a];
+		}
+		assert(!seen[index]);
+		seen[index] = true;
+		assert(k == 0 || distance == 1);
+		assert(Hilbert(h.toMorton()) == h);
+	}
+}
+
+void test_hilbert()
+{
+	test_hilbertCurve<hilbert2, 2>(6);
+	test_hilbertCurve<hilbert2d<uint32_t>, 2>(5);
+	test_hilbertCurve<hilbert3, 3>(4);
+	test_hilbertCurve<hilbert3d<uint32_t>, 3>(3);
+
+	assert(hilbert2(0, 0).key == 0 && hilbert3(0, 0, 0).key == 0);
+
+	//Round trips on the whole range, and with each morton strategy
+	srand(13);
+	for (int i = 0; i < 10000; ++i)
+	{
+		const uint32_t x = rand() % 0x1fffff, y = rand() % 0x1fffff, z = rand() % 0x1fffff;
+		const hilbert3 h(x, y, z);
+		uint64_t dx, dy, dz;
+		h.decode(dx, dy, dz);
+		assert(dx == x && dy == y && dz == z);
+		assert(h.toMorton() == morton3(x, y, z) && hilbert3(morton3(x, y, z)) == h);
+		assert((hilbert3d<uint64_t, morton_lut8>(x, y, z).key == h.key));
+		assert((hilbert3d<uint64_t, morton_magicbits>(x, y, z).key == h.key));
+
+		const uint32_t x2 = static_cast<uint32_t>(rand()) << 16 ^ rand(), y2 = static_cast<uint32_t>(rand()) << 16 ^ rand();
+		const hilbert2 h2(x2, y2);
+		h2.decode(dx, dy);
+		assert(dx == x2 && dy == y2);
+		assert(hilbert2(h2.toMorton()) == h2);
+
+		const hilbert3d<uint32_t> h32(x & 1023, y & 1023, z & 1023);
+		h32.decode(dx, dy, dz);
+		assert(dx == (x & 1023) && dy == (y & 1023) && dz == (z & 1023));
+	}
+
+	//Comparisons follow the keys
+	const hilbert2 a(0, 1), b(1, 1);
+	assert(a < b && b > a && a <= a && b >= a && a != b);
+}
+
+/* Neighbors of every cell of a small grid, against neighbors computed from the coordinates */
+template<unsigned int D, unsigned int N, class Key>
+void test_neighborhood(const uint64_t (&size)[D])
+{
+	typedef mortonNd_encoder<D, uint64_t, morton_dispatch> encoder;
+	typedef typename mortonNd_traits<D, uint64_t>::coord_type coord_type;
+	const morton_neighborhood<D, N>& table = mortonNeighborhood<D, N>;
+	typedef void(*kernel)(const uint64_t*, uint64_t, morton_boundary, uint64_t*, size_t, size_t, uint32_t*);
+	std::vector<kernel> kernels = { neighborKeys_scalar<D, N> };
+	if (mortonCpu().avx2)
+		kernels.push_back(neighborKeys_avx2<D, N>);
+	if (mortonCpu().avx512f)
+		kernels.push_back(neighborKeys_avx512<D, N>);
+
+	coord_type top[D];
+	for (unsigned int a = 0; a < D; ++a)
+		top[a] = static_cast<coord_type>(size[a] - 1);
+	const Key max(encoder::encode(top));
+
+	//Every cell of the grid
+	std::vector<uint64_t> keys;
+	size_t cells = 1;
+	for (unsigned int a = 0; a < D; ++a)
+		cells *= size[a];
+	for (size_t c = 0; c < cells; ++c)
+	{
+		coord_type p[D];
+		for (size_t a = 0, v = c; a < D; v /= size[a], ++a)
+			p[a] = static_cast<coord_type>(v % size[a]);
+		keys.push_back(encoder::encode(p));
+	}
+
+	const size_t n = keys.size();
+	std::vector<uint64_t> out(N * n);
+	std::vector<uint32_t> valid(n);
+	for (const morton_boundary boundary : { MORTON_BOUNDARY_CLAMP, MORTON_BOUNDARY_SKIP, MORTON_BOUNDARY_PERIODIC })
+	{
+		std::vector<uint64_t> expected(N * n);
+		std::vector<uint32_t> expectedValid(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			uint64_t c[D];
+			encoder::decode(keys[i], c);
+			Key found[N];
+			const unsigned int count = mortonNeighbors<N>(Key(keys[i]), max, found, boundary);
+			unsigned int k = 0;
+			for (unsigned int j = 0; j < N; ++j)
+			{
+				coord_type p[D];
+				bool inside = true;
+				for (unsigned int a = 0; a < D; ++a)
+				{
+					const int64_t v = static_cast<int64_t>(c[a]) + table.offset[j][a];
+					inside &= v >= 0 && v < static_cast<int64_t>(size[a]);
+					if (boundary == MORTON_BOUNDARY_PERIODIC)
+						p[a] = static_cast<coord_type>((v + size[a]) % size[a]);
+					else
+						p[a] = static_cast<coord_type>(std::min(std::max<int64_t>(v, 0), static_cast<int64_t>(size[a]) - 1));
+				}
+				if (boundary == MORTON_BOUNDARY_SKIP && !inside)
+				{
+					expected[j * n + i] = keys[i];
+					continue;
+				}
+				expected[j * n + i] = encoder::encode(p);
+				expectedValid[i] |= 1u << j;
+				assert(found[k++].key == expected[j * n + i]);
+			}
+			assert(count == k);
+
+			//Same neighbors, in the same order
+			k = 0;
+			mortonForEachNeighbor<N>(Key(keys[i]), max, boundary, [&](const Key m) { assert(k < count && m == found[k]); ++k; });
+			assert(k == count);
+		}
+
+		for (const kernel f : kernels)
+		{
+			f(keys.data(), max.key, boundary, out.data(), n, n, valid.data());
+			assert(out == expected && valid == expectedValid);
+		}
+	}
+}
+
+void test_neighbors()
+{
+	//Offsets, last axis first
+	const morton_neighborhood<3, 26>& n26 = mortonNeighborhood<3, 26>;
+	const morton_neighborhood<3, 6>& n6 = mortonNeighborhood<3, 6>;
+	const morton_neighborhood<2, 4>& n4 = mortonNeighborhood<2, 4>;
+	assert(n26.offset[0][0] == -1 && n26.offset[0][2] == -1 && n26.offset[1][2] == 0);
+	assert(n6.offset[0][0] == -1 && n6.offset[5][0] == 1);
+	assert(n4.low[1] == 2 && n4.high[0] == 8);
+
+	test_neighborhood<2, 4, morton2>({ 5, 7 });
+	test_neighborhood<2, 8, morton2>({ 8, 3 });
+	test_neighborhood<2, 8, morton2>({ 1, 2 });
+	test_neighborhood<3, 6, morton3>({ 4, 5, 3 });
+	test_neighborhood<3, 18, morton3>({ 3, 6, 4 });
+	test_neighborhood<3, 26, morton3>({ 5, 3, 7 });
+	test_neighborhood<3, 26, morton3>({ 1, 1, 2 });
+
+	//Other key types, on the whole range
+	morton3d<uint32_t> out32[26];
+	const morton3d<uint32_t> max32(1023, 1023, 1023);
+	assert(mortonNeighbors<26>(morton3d<uint32_t>(0, 5, 1023), max32, out32, MORTON_BOUNDARY_SKIP) == 11);
+	assert(mortonNeighbors<6>(morton3d<uint32_t>(0, 5, 1023), max32, out32, MORTON_BOUNDARY_PERIODIC) == 6);
+	assert(out32[0] == morton3d<uint32_t>(1023, 5, 1023) && out32[5] == morton3d<uint32_t>(1, 5, 1023));
+	morton2 out2[8];
+	assert(mortonNeighbors<4>(morton2(0xffffffff, 7), morton2(0xffffffff, 0xffffffff), out2, MORTON_BOUNDARY_PERIODIC) == 4);
+	assert(out2[3] == morton2(0, 7) && out2[0] == morton2(0xfffffffe, 7));
+
+	//Wrappers
+	const std::vector<uint64_t> keys = { morton3(0, 0, 0).key, morton3(9, 9, 9).key, morton3(3, 4, 5).key };
+	std::vector<uint64_t> out(6 * keys.size());
+	std::vector<uint32_t> valid(keys.size());
+	neighbors3d<6>(keys.data(), morton3(9, 9, 9), MORTON_BOUNDARY_SKIP, out.data(), keys.size(), valid.data());
+	assert(valid[0] == 0x38 && valid[1] == 0x07 && valid[2] == 0x3f);
+	assert(out[0] == keys[0] && out[1] == morton3(8, 9, 9).key && out[5 * 3 + 2] == morton3(4, 4, 5).key);
+	std::vector<uint64_t> keys2 = { morton2(0, 0).key, morton2(2, 1).key };
+	std::vector<uint64_t> out2d(8 * keys2.size());
+	neighbors2d<8>(keys2.data(), morton2(2, 2), MORTON_BOUNDARY_CLAMP, out2d.data(), keys2.size());
+	assert(out2d[0] == morton2(0, 0).key && out2d[7 * 2 + 1] == morton2(2, 2).key);
+}
+
+/* Stencil on a size^3 grid, against the neighbors computed from the coordinates */
+template<unsigned int N, class T>
+void test_stencilGrid(const uint32_t size, const morton_boundary boundary, const unsigned int threads)
+{
+	const morton_neighborhood<3, N>& table = mortonNeighborhood<3, N>;
+	const size_t cells = static_cast<size_t>(size) * size * size;
+	std::vector<T> in(cells), out(cells);
+	srand(7);
+	for (T& v : in)
+		v = static_cast<T>(rand() % 100);
+
+	auto f = [](const T c, const T (&n)[N])
+	{
+		T r = c * 1000;
+		for (unsigned int j = 0; j < N; ++j)
+			r += n[j] * static_cast<T>(j + 1);
+		return r;
+	};
+	mortonStencil<N>(in.data(), out.data(), size, f, boundary, threads);
+
+	for (size_t k = 0; k < cells; ++k)
+	{
+		uint64_t c[3];
+		morton3(k).decode(c[0], c[1], c[2]);
+		T n[N];
+		for (unsigned int j = 0; j < N; ++j)
+		{
+			int64_t p[3];
+			bool inside = true;
+			for (unsigned int a = 0; a < 3; ++a)
+			{
+				p[a] = static_cast<int64_t>(c[a]) + table.offset[j][a];
+				inside &= p[a] >= 0 && p[a] < static_cast<int64_t>(size);
+				if (boundary == MORTON_BOUNDARY_PERIODIC)
+					p[a] = (p[a] + size) % size;
+				else
+					p[a] = std::min<int64_t>(std::max<int64_t>(p[a], 0), size - 1);
+			}
+			n[j] = (boundary == MORTON_BOUNDARY_SKIP && !inside) ? T() : in[morton3(p[0], p[1], p[2]).key];
+		}
+		assert(out[k] == f(in[k], n));
+	}
+}
+
+void test_stencil()
+{
+	for (const morton_boundary boundary : { MORTON_BOUNDARY_CLAMP, MORTON_BOUNDARY_SKIP, MORTON_BOUNDARY_PERIODIC })
+	{
+		test_stencilGrid<6, int>(1, boundary, 1);
+		test_stencilGrid<26, int>(4, boundary, 2);
+		//Blocks of 16^3 away from the border
+		test_stencilGrid<6, int>(64, boundary, 3);
+		test_stencilGrid<26, int>(64, boundary, 0);
+		//Blocks of 8^3
+		test_stencilGrid<18, double>(32, boundary, 4);
+	}
+}
+
+/* Keys of the box from the iterator, against the sorted keys of the grid inside it */
+template<class Key>
+void test_boxIterator(const std::vector<Key>& grid, const Key min, const Key max)
+{
+	std::vector<Key> expected;
+	for (const Key& m : grid)
+		if (mortonInBox(m, min, max))
+			expected.push_back(m);
+	std::sort(expected.begin(), expected.end(), [](const Key& a, const Key& b) { return a.key < b.key; });
+
+	const morton_box<Key> box = mortonBox(min, max);
+	std::vector<Key> keys;
+	for (const Key m : box)
+		keys.push_back(m);
+	assert(keys == expected);
+	assert(box.size() == expected.size() && static_cast<size_t>(std::distance(box.begin(), box.end())) == expected.size());
+	assert(std::vector<Key>(box.begin(), box.end()) == expected);
+}
+
+void test_box()
+{
+	std::vector<morton3> grid3;
+	for (uint32_t x = 0; x < 16; ++x)
+		for (uint32_t y = 0; y < 16; ++y)
+			for (uint32_t z = 0; z < 16; ++z)
+				grid3.push_back(morton3(x, y, z));
+	std::vector<morton2> grid2;
+	for (uint32_t x = 0; x < 64; ++x)
+		for (uint32_t y = 0; y < 64; ++y)
+			grid2.push_back(morton2(x, y));
+
+	srand(11);
+	for (int i = 0; i < 200; ++i)
+	{
+		uint32_t lo[3], hi[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			lo[a] = rand() % 16;
+			hi[a] = lo[a] + rand() % (16 - lo[a]);
+		}
+		test_boxIterator(grid3, morton3(lo[0], lo[1], lo[2]), morton3(hi[0], hi[1], hi[2]));
+		test_boxIterator(grid2, morton2(lo[0] * 4, lo[1] * 3), morton2(hi[0] * 4 + 3, hi[1] * 3 + 2));
+	}
+
+	//Single cell, empty box, aligned box
+	test_boxIterator(grid3, morton3(5, 6, 7), morton3(5, 6, 7));
+	assert(mortonBox(morton3(5, 6, 7), morton3(4, 6, 7)).begin() == mortonBox(morton3(5, 6, 7), morton3(4, 6, 7)).end());
+	assert(mortonBox(morton3(5, 6, 7), morton3(4, 6, 7)).size() == 0);
+	test_boxIterator(grid3, morton3(8, 0, 8), morton3(15, 7, 15));
+
+	//Corner of the key space, and STL algorithms
+	const morton_box<morton3d<uint32_t>> corner = mortonBox(morton3d<uint32_t>(1022, 1021, 1020), morton3d<uint32_t>(1023, 1023, 1023));
+	assert(std::count_if(corner.begin(), corner.end(), [](const morton3d<uint32_t>& m) { return m.key != 0; }) == 24);
+	assert(std::find(corner.begin(), corner.end(), morton3d<uint32_t>(1023, 1022, 1021)) != corner.end());
+	assert(std::find(corner.begin(), corner.end(), morton3d<uint32_t>(1021, 1022, 1021)) == corner.end());
+}
+
+template<unsigned int B>
+void test_brickGrid(const int size)
+{
+	typedef BrickGrid3d<uint32_t, B> brick;
+	BrickGrid3d<uint32_t, B> grid(size);
+	std::vector<bool> seen(size * size * size, false);
+	for (int x = 0; x < size; ++x)
+		for (int y = 0; y < size; ++y)
+			for (int z = 0; z < size; ++z)
+			{
+				const uint64_t i = brick::index(x, y, z);
+				assert(i < seen.size() && !seen[i]);
+				seen[i] = true;
+				grid.push(x, y, z, (x * size + y) * size + z);
+
+				//Neighbors across bricks
+				if (x + 1 < size) assert(brick::incX(i) == brick::index(x + 1, y, z));
+				if (y + 1 < size) assert(brick::incY(i) == brick::index(x, y + 1, z));
+				if (z + 1 < size) assert(brick::incZ(i) == brick::index(x, y, z + 1));
+				if (x > 0) assert(brick::decX(i) == brick::index(x - 1, y, z));
+				if (y > 0) assert(brick::decY(i) == brick::index(x, y - 1, z));
+				if (z > 0) assert(brick::decZ(i) == brick::index(x, y, z - 1));
+			}
+
+	//Rows along z are contiguous, bricks follow the morton order
+	for (int x = 0; x < size; ++x)
+		for (int y = 0; y < size; ++y)
+			for (int z = 0; z < size; z += B)
+			{
+				const uint32_t* row = grid.row(x, y, z + B - 1);
+				for (unsigned int k = 0; k < B; ++k)
+					assert(row[k] == static_cast<uint32_t>((x * size + y) * size + z + k));
+			}
+	assert(brick::index(B, 0, 0) == 4 * B * B * B && brick::index(0, 0, B) == B * B * B);
+}
+
+void test_brickGrid()
+{
+	test_brickGrid<2>(8);
+	test_brickGrid<4>(16);
+	test_brickGrid<8>(32);
+}
+
+void test_compactGrid(const int nx, const int ny, const int nz)
+{
+	CompactMortonGrid3d<uint32_t> grid(nx, ny, nz);
+	assert(grid.size() == static_cast<size_t>((nx + 7) / 8 * 8) * ((ny + 7) / 8 * 8) * ((nz + 7) / 8 * 8));
+
+	//Every cell of small grids, random cells of large ones
+	const bool all = static_cast<uint64_t>(nx) * ny * nz <= (1u << 18);
+	std::vector<int> cells;
+	if (all)
+	{
+		for (int x = 0; x < nx; ++x)
+			for (int y = 0; y < ny; ++y)
+				for (int z = 0; z < nz; ++z)
+					cells.insert(cells.end(), { x, y, z });
+	}
+	else
+	{
+		for (int i = 0; i < 100000; ++i)
+			cells.insert(cells.end(), { rand() % nx, rand() % ny, rand() % nz });
+		cells.insert(cells.end(), { nx - 1, ny - 1, nz - 1 });
+	}
+
+	std::vector<bool> seen(grid.size(), false);
+	for (size_t c = 0; c < cells.size(); c += 3)
+	{
+		const int x = cells[c], y = cells[c + 1], z = cells[c + 2];
+		const size_t i = grid.index(morton3(x, y, z));
+		assert(i < seen.size() && (!all || !seen[i]));
+		seen[i] = true;
+		grid.push(x, y, z, static_cast<uint32_t>((static_cast<uint64_t>(x) * ny + y) * nz + z));
+	}
+
+	//Neighbor keys find the same cells, and cells follow the morton order
+	for (size_t c = 0; c < cells.size(); c += 3)
+	{
+		const int x = cells[c], y = cells[c + 1], z = cells[c + 2];
+		const morton3 m(x, y, z);
+		assert(grid.get(m) == static_cast<uint32_t>((static_cast<uint64_t>(x) * ny + y) * nz + z));
+		if (x + 1 < nx) assert(grid.get(m.incX()) == grid.get(x + 1, y, z));
+		if (y + 1 < ny) assert(grid.get(m.incY()) == grid.get(x, y + 1, z));
+		if (z > 0) assert(grid.get(m.decZ()) == grid.get(x, y, z - 1));
+	}
+	for (int i = 0; i < 1000; ++i)
+	{
+		const morton3 a(rand() % nx, rand() % ny, rand() % nz), b(rand() % nx, rand() % ny, rand() % nz);
+		assert((a.key < b.key) == (grid.index(a) < grid.index(b)));
+	}
+}
+
+void test_compactGrid()
+{
+	srand(5);
+	test_compactGrid(1, 1, 1);
+	test_compactGrid(8, 8, 8);
+	test_compactGrid(13, 40, 7);
+	test_compactGrid(100, 3, 57);
+	test_compactGrid(33, 33, 33);
+
+	//Flat and long grids, whose block keys span most of the key bits
+	test_compactGrid(1024, 1024, 8);
+	test_compactGrid(8, 8, 1 << 18);
+	test_compactGrid(3, 100000, 5);
+}
+
+template<class Allocator>
+void test_allocator(const size_t alignment)
+{
+	for (const size_t n : { size_t(1), size_t(1000), size_t(1) << 20 })
+	{
+		std::vector<uint32_t, Allocator> v(n, 7);
+		assert(reinterpret_cast<uintptr_t>(v.data()) % alignment == 0);
+		for (size_t i = 0; i < n; ++i)
+			v[i] += static_cast<uint32_t>(i);
+		assert(v[n - 1] == 7 + n - 1);
+	}
+
+	MortonGrid3d<uint32_t, typename std::allocator_traits<Allocator>::template rebind_alloc<uint32_t>> grid(32);
+	grid.push(31, 2, 17, 42);
+	assert(grid.get(morton3(31, 2, 17)) == 42);
+}
+
+void test_allocator()
+{
+	test_allocator<morton_allocator<uint32_t, MORTON_PAGES_CACHE_LINE>>(64);
+	test_allocator<morton_allocator<uint32_t, MORTON_PAGES_ALIGNED>>(mortonPageSize);
+#if __linux__
+	test_allocator<morton_allocator<uint32_t, MORTON_PAGES_TRANSPARENT_HUGE>>(mortonHugePageSize);
+	test_allocator<morton_allocator<uint32_t, MORTON_PAGES_HUGETLB, true>>(mortonHugePageSize);
+#endif
+	test_allocator<morton_allocator<uint32_t, MORTON_PAGES_ALIGNED, true>>(mortonPageSize);
+}
+
+void test_file()
+{
+	const char* path = "morton_test_grid.bin";
+	const uint32_t nx = 37, ny = 20, nz = 9;
+	auto value = [](const uint32_t x, const uint32_t y, const uint32_t z) { return (x * 100 + y) * 100 + z; };
+	assert(mortonFileWrite<uint32_t>(path, nx, ny, nz, value, 2));
+
+	morton_file_grid<uint32_t> grid;
+	assert(grid.open(path));
+	assert(grid.info().tiles == 10 * 5 * 3 && grid.info().extent[0] == nx);
+	for (uint32_t x = 0; x < nx; ++x)
+		for (uint32_t y = 0; y < ny; ++y)
+			for (uint32_t z = 0; z < nz; ++z)
+			{
+				assert(grid.get(x, y, z) == value(x, y, z));
+				if (x + 1 < nx) assert(grid.get(morton3(x, y, z).incX()) == value(x + 1, y, z));
+			}
+	grid.willNeed(morton3(0, 0, 0), morton3(nx - 1, ny - 1, nz - 1));
+
+	//Each cell once, in morton order
+	size_t count = 0;
+	uint64_t last = 0;
+	grid.traverse([&](const morton3 m, const uint32_t& v)
+	{
+		uint64_t x, y, z;
+		m.decode(x, y, z);
+		assert(v == value(static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(z)));
+		assert(count == 0 || m.key > last);
+		last = m.key;
+		++count;
+	}, 4096);
+	assert(count == nx * ny * nz);
+	grid.close();
+	assert(!grid.isOpen());
+
+	//Other element type, missing file
+	morton_file_grid<float> other;
+	assert(!other.open(path));
+	assert(!other.open("morton_missing_grid.bin"));
+
+	//Header with a tile count which doesn't match the extent
+	FILE* file = std::fopen(path, "r+b");
+	morton_file_header header;
+	assert(std::fread(&header, sizeof(header), 1, file) == 1);
+	++header.tiles;
+	assert(std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fclose(file) == 0);
+	assert(!grid.open(path));
+
+	//Flat grid : the index of the tiles only holds the bits of x and y, and the file is read back whatever its shape
+	const uint32_t flat[3] = { 300, 70, 1 };
+	assert(mortonFileWrite<uint8_t>(path, flat[0], flat[1], flat[2], [](const uint32_t x, const uint32_t y, uint32_t) { return static_cast<uint8_t>(x ^ y); }, 0));
+	morton_file_grid<uint8_t> flatGrid;
+	assert(flatGrid.open(path) && flatGrid.info().tiles == 300 * 70);
+	for (uint32_t x = 0; x < flat[0]; ++x)
+		for (uint32_t y = 0; y < flat[1]; ++y)
+			assert(flatGrid.get(x, y, 0) == static_cast<uint8_t>(x ^ y));
+	count = 0;
+	flatGrid.traverse([&](const morton3, const uint8_t&) { ++count; });
+	assert(count == 300 * 70);
+	flatGrid.close();
+	std::remove(path);
+
+	//A line of 2^17 tiles : its last key is above 2^51, its index has 17 bits
+	morton_file_tiles tiles;
+	const uint32_t line[3] = { mortonFileMaxExtent, 16, 16 };
+	assert(tiles.build(line, 4) && tiles.count == (1u << 17) && tiles.rank.size() == (1u << 17) && !tiles.dense);
+	assert(tiles.rank[tiles.index(morton3((1u << 17) - 1, 0, 0).key)] == (1u << 17) - 1);
+	const uint32_t wide[3] = { mortonFileMaxExtent + 1, 1, 1 };
+	assert(!tiles.build(wide, 4) && !tiles.build(line, 4, 1000) && tiles.rank.empty());
+	const uint32_t cube[3] = { 256, 256, 256 };
+	assert(tiles.build(cube, 4) && tiles.dense && tiles.count == 4096 && tiles.index(4095) == 4095);
+}
+
+void test_externalSort()
+{
+	const char* path = "morton_test_sorted.bin";
+	const size_t n = 100000;
+	srand(13);
+	std::vector<uint64_t> input(n);
+	for (size_t i = 0; i < n; ++i)
+		input[i] = morton3(rand() % 64, rand() % 64, rand() % 16).key;
+
+	//Small reads and a memory budget of about 14 runs
+	size_t next = 0;
+	auto read = [&](uint64_t* keys, uint32_t* payload, const size_t max)
+	{
+		const size_t count = std::min(std::min<size_t>(max, 1000), n - next);
+		for (size_t i = 0; i < count; ++i, ++next)
+		{
+			keys[i] = input[next];
+			payload[i] = static_cast<uint32_t>(next);
+		}
+		return count;
+	};
+	assert(mortonExternalSort<uint32_t>(path, read, 256 << 10, 2));
+	for (const char* run : { ".run0", ".pass0.run0", ".pass1.run0" }) // Merged 2 runs at a time, in several passes
+		assert(std::fopen((std::string(path) + run).c_str(), "rb") == nullptr);
+
+	morton_sorted_file<uint32_t> sorted;
+	assert(sorted.open(path));
+	assert(sorted.size() == n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		assert(sorted.keys()[i].key == input[sorted.payload()[i]]);
+		if (i > 0)
+			assert(sorted.keys()[i - 1] < sorted.keys()[i] || (sorted.keys()[i - 1] == sorted.keys()[i] && sorted.payload()[i - 1] < sorted.payload()[i]));
+	}
+	assert(!morton_sorted_file<uint64_t>().open(path));
+	sorted.close();
+
+	//Empty input
+	assert(mortonExternalSort<uint32_t>(path, [](uint64_t*, uint32_t*, size_t) { return size_t(0); }, 1 << 20));
+	assert(sorted.open(path) && sorted.size() == 0);
+	sorted.close();
+	std::remove(path);
+}
+
+void test_packedKeys(const std::vector<uint64_t>& keys)
+{
+	const morton_packed_keys packed(keys.data(), keys.size());
+	assert(packed.size() == keys.size() && packed.blockCount() == (keys.size() + 127) / 128);
+	std::vector<uint64_t> out(keys.size());
+	packed.decode(out.data());
+	assert(out == keys);
+
+	uint64_t scalar[128], simd[128];
+	for (size_t b = 0; b < packed.blockCount(); ++b)
+	{
+		packed.decodeBlock_scalar(b, scalar);
+		if (mortonCpu().avx2)
+		{
+			packed.decodeBlock_avx2(b, simd);
+			assert(std::equal(scalar, scalar + 128, simd));
+		}
+		assert(std::equal(keys.begin() + b * 128, keys.begin() + std::min(keys.size(), b * 128 + 128), scalar));
+	}
+
+	for (size_t i = 0; i < keys.size(); i += 1 + keys.size() / 500)
+	{
+		assert(packed[i] == keys[i]);
+		for (const uint64_t k : { keys[i], keys[i] - 1, keys[i] + 1 })
+			assert(packed.lowerBound(k) == static_cast<size_t>(std::lower_bound(keys.begin(), keys.end(), k) - keys.begin()));
+	}
+	if (!keys.empty())
+		assert(packed.lowerBound(keys.back() + 1) == keys.size() || keys.back() == ~0ull);
+}
+
+void test_packedKeys()
+{
+	srand(17);
+	std::vector<uint64_t> keys;
+	test_packedKeys(keys);
+
+	//Uniform keys, over the whole key space and with a few outliers
+	for (int i = 0; i < 10000; ++i)
+		keys.push_back(morton3(rand() % 0x1fffff, rand() % 0x1fffff, rand() % 0x1fffff).key);
+	std::sort(keys.begin(), keys.end());
+	test_packedKeys(keys);
+
+	//Clustered keys, duplicates and a partial last block
+	keys.clear();
+	for (int c = 0; c < 20; ++c)
+	{
+		const uint32_t x = rand() % 100000, y = rand() % 100000, z = rand() % 100000;
+		for (int i = 0; i < 333; ++i)
+			keys.push_back(morton3(x + rand() % 16, y + rand() % 16, z + rand() % 16).key);
+	}
+	keys.push_back(~0ull);
+	std::sort(keys.begin(), keys.end());
+	test_packedKeys(keys);
+
+	//Dense grid : all differences are equal
+	keys.clear();
+	for (uint64_t k = 0; k < 1000; ++k)
+		keys.push_back(5 + 3 * k);
+	test_packedKeys(keys);
+	const morton_packed_keys dense(keys.data(), keys.size());
+	for (size_t b = 0; b + 1 < dense.blockCount(); ++b)
+		assert(dense.header(b).base == 12 && dense.header(b).bits == 0 && dense.header(b).exceptions == 3); // First row : 3, 6 and 9
+	assert(dense.memory() < keys.size());
+	keys.assign(300, 42);
+	test_packedKeys(keys);
+}
+
+/* Keys built at compile time. Magic bits are always constexpr, other strategies need MORTON_CONSTEXPR_DISPATCH. */
+typedef morton3d<uint64_t, morton_magicbits> morton3_cx;
+typedef morton2d<uint64_t, morton_magicbits> morton2_cx;
+
+constexpr uint64_t decodeX3(const morton3_cx m)
+{
+	uint64_t x = 0, y = 0, z = 0;
+	m.decode(x, y, z);
+	return x;
+}
+
+constexpr morton3_cx sum3(morton3_cx m1, const morton3_cx m2)
+{
+	m1 += m2;
+	return m1;
+}
+
+void test_constexpr()
+{
+	static_assert(morton3_cx(4, 5, 6).incX() == morton3_cx(5, 5, 6), "");
+	static_assert(morton3_cx(4, 5, 6).decZ() == morton3_cx(4, 5, 5), "");
+	static_assert(morton3_cx(1, 2, 3) + morton3_cx(4, 5, 6) == morton3_cx(5, 7, 9), "");
+	static_assert(sum3(morton3_cx(1, 2, 3), morton3_cx(4, 5, 6)) == morton3_cx(5, 7, 9), "");
+	static_assert(morton3_cx::min(morton3_cx(1, 8, 3), morton3_cx(4, 5, 6)) == morton3_cx(1, 5, 3), "");
+	static_assert(morton3_cx::max(morton3_cx(1, 8, 3), morton3_cx(4, 5, 6)) == morton3_cx(4, 8, 6), "");
+	static_assert(decodeX3(morton3_cx(123456, 7, 8)) == 123456, "");
+	static_assert(morton2_cx(3, 4).incY() == morton2_cx(3, 5), "");
+	static_assert(morton2_cx(3, 4) - morton2_cx(1, 1) == morton2_cx(2, 3), "");
+
+	//Compile time keys match the runtime ones
+	constexpr morton3_cx key3 = morton3_cx(1000, 2000, 3000);
+	assert(key3.key == morton3(1000, 2000, 3000).key);
+	constexpr morton2_cx key2 = morton2_cx(1000, 2000);
+	assert(key2.key == morton2(1000, 2000).key);
+
+#ifdef MORTON_CONSTEXPR_DISPATCH
+	static_assert(morton3(1000, 2000, 3000).key == key3.key, "");
+	static_assert(morton2(1000, 2000).key == key2.key, "");
+	static_assert(morton3d<uint64_t, morton_bmi2>(4, 5, 6).incY().key == morton3(4, 6, 6).key, "");
+	static_assert(morton3d<uint64_t, morton_lut16>(4, 5, 6).key == morton3(4, 5, 6).key, "");
+#ifdef __SIZEOF_INT128__
+	static_assert(morton3_128(1ull << 40, 0, 0).key == static_cast<morton_uint128>(1) << 122, "");
+#endif
+#endif
+}
+
+template<unsigned int D, class T>
+void test_mortonNdRoundTrip()
+{
+	typedef mortonNd<D, T, morton_magicbits> key_type;
+	typedef typename key_type::coord_type coord_type;
+	for (int i = 0; i < 1000; ++i)
+	{
+		coord_type c[D];
+		for (unsigned int a = 0; a < D; ++a)
+		{
+			const unsigned int bits = (8 * sizeof(T) + a) / D; // Axis 0 has the fewest bits
+			const uint64_t v = (static_cast<uint64_t>(rand()) << 32) ^ static_cast<uint64_t>(rand()) * 2654435761u;
+			c[a] = static_cast<coord_type>(bits >= 64 ? v : v & ((1ull << bits) - 1));
+		}
+
+		const key_type m(c);
+		uint64_t d[D];
+		m.decode(d);
+		for (unsigned int a = 0; a < D; ++a)
+		{
+			assert(d[a] == c[a]);
+			assert(m.coord(a) == c[a]);
+		}
+		assert((mortonNd<D, T, morton_dispatch>(c).key == m.key));
+		if (mortonCpu().bmi2)
+			assert((mortonNd<D, T, morton_bmi2>(c).key == m.key));
+	}
+}
+
+void test_mortonNd()
+{
+	static_assert(std::is_same<morton<2>, morton2>::value, "");
+	static_assert(std::is_same<morton<3>, morton3>::value, "");
+	static_assert(std::is_same<morton<4>, morton4>::value, "");
+
+	//Same keys as morton2d and morton3d
+	srand(42);
+	for (int i = 0; i < 10000; ++i)
+	{
+		const uint32_t x = static_cast<uint32_t>(rand()) * 2654435761u;
+		const uint32_t y = static_cast<uint32_t>(rand()) * 2246822519u;
+		const uint32_t z = static_cast<uint32_t>(rand()) * 3266489917u;
+		assert(mortonNd<2>(x, y).key == morton2(x, y).key);
+		assert(mortonNd<3>(x, y, z).key == morton3(x, y, z).key);
+		assert((mortonNd<3, uint64_t, morton_magicbits>(x, y, z).key == morton3(x, y, z).key));
+		assert((mortonNd<3, uint32_t>(x & 0x3ff, y & 0x3ff, z & 0x7ff).key == morton3d<uint32_t>(x & 0x3ff, y & 0x3ff, z & 0x7ff).key));
+	}
+
+	test_mortonNdRoundTrip<2, uint64_t>();
+	test_mortonNdRoundTrip<3, uint64_t>();
+	test_mortonNdRoundTrip<4, uint64_t>();
+	test_mortonNdRoundTrip<5, uint64_t>();
+	test_mortonNdRoundTrip<6, uint64_t>();
+	test_mortonNdRoundTrip<7, uint64_t>();
+	test_mortonNdRoundTrip<8, uint64_t>();
+	test_mortonNdRoundTrip<4, uint32_t>();
+	test_mortonNdRoundTrip<8, uint16_t>();
+#ifdef __SIZEOF_INT128__
+	test_mortonNdRoundTrip<2, morton_uint128>();
+	test_mortonNdRoundTrip<4, morton_uint128>();
+	test_mortonNdRoundTrip<7, morton_uint128>();
+	assert(morton4_128(1ull << 31, 0, 0, 0).key == static_cast<morton_uint128>(1) << 127);
+#endif
+
+	//Tesseral arithmetic
+	const morton4 m = morton4(4, 5, 6, 7);
+	assert(m.inc(0) == morton4(5, 5, 6, 7));
+	assert(m.inc(3) == morton4(4, 5, 6, 8));
+	assert(m.dec(1) == morton4(4, 4, 6, 7));
+	assert(m.dec(3) == morton4(4, 5, 6, 6));
+	assert(morton4(0, 0, 0, 0).dec(2).inc(2) == morton4(0, 0, 0, 0));
+	assert(morton4(0xffff, 0, 0, 0).inc(0) == morton4(0, 0, 0, 0));
+	assert(m + morton4(1, 2, 3, 4) == morton4(5, 7, 9, 11));
+	assert(m - morton4(1, 2, 3, 4) == morton4(3, 3, 3, 3));
+	assert(morton4::min(m, morton4(8, 3, 7, 1)) == morton4(4, 3, 6, 1));
+	assert(morton4::max(m, morton4(8, 3, 7, 1)) == morton4(8, 5, 7, 7));
+	assert((m << 2) == morton4(16, 20, 24, 28));
+	assert((morton4(16, 20, 24, 28) >> 2) == morton4(4, 5, 6, 7));
+	assert(morton4(0, 0, 0, 1) < morton4(1, 0, 0, 0));
+
+	typedef mortonNd<6, uint64_t> morton6;
+	morton6 m6 = morton6(1, 2, 3, 4, 5, 6);
+	m6 += morton6(6, 5, 4, 3, 2, 1);
+	assert(m6 == morton6(7, 7, 7, 7, 7, 7));
+	m6 -= morton6(7, 7, 7, 7, 7, 7);
+	assert(m6.key == 0);
+
+	typedef mortonNd<4, uint64_t, morton_magicbits> morton4_cx;
+	static_assert(morton4_cx(4, 5, 6, 7).inc(3) == morton4_cx(4, 5, 6, 8), "");
+	static_assert(morton4_cx(1, 2, 3, 4).coord(2) == 3, "");
+}
+
 int main(int argc, char *argv[])
 {
 	test_morton2d();
 	test_morton3d();
+	test_codecs();
+#ifdef __SIZEOF_INT128__
+	test_morton128();
+#endif
+	test_batch();
+	test_batchArithmetic();
+	test_quantizer();
+	test_sort();
+	test_range();
+	test_octree();
+	test_hashgrid();
+	test_knn();
+	test_lbvh();
+	test_hilbert();
+	test_neighbors();
+	test_stencil();
+	test_box();
+	test_brickGrid();
+	test_compactGrid();
+	test_allocator();
+	test_file();
+	test_externalSort();
+	test_packedKeys();
+	test_constexpr();
+	test_mortonNd();
 	benchmark2d();
 	benchmark3d();
+	benchmarkCodecs();
+	benchmarkBatch();
+	benchmarkBatchArithmetic();
+	benchmarkQuantizer();
+	benchmarkSort();
+	benchmarkRange();
+	benchmarkOctree();
+	benchmarkHashGrid();
+	benchmarkKnn();
+	benchmarkLbvh();
+	benchmarkHilbert();
+	benchmarkStencil();
+	benchmarkBoxIterator();
+	benchmarkExtents();
+	benchmarkAllocators();
+	benchmarkFile();
+	benchmarkExternalSort();
+	benchmarkPacked();
+	benchmarkNd();
+#ifdef __SIZEOF_INT128__
+	benchmark128();
+#endif
 	return 0;
 }
 